@@ -0,0 +1,101 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// A tiny benchmark harness
+// Each case is run a number of times and the timings summarised,
+// then printed as a table and optionally written as JSON, so
+// results from two versions can be compared by a script
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+using BenchClock = std::chrono::high_resolution_clock;
+
+// Timings in milliseconds
+struct BenchStats {
+	double min, median, mean, stddev, max;
+};
+
+inline BenchStats benchStats(std::vector<double> ms){
+	BenchStats s = { 0, 0, 0, 0, 0 };
+	if (ms.empty()) return s;
+	std::sort(ms.begin(), ms.end());
+	size_t n = ms.size();
+	s.min = ms.front();
+	s.max = ms.back();
+	s.median = (n % 2) ? ms[n / 2] : 0.5 * (ms[n / 2 - 1] + ms[n / 2]);
+	for (double t : ms) s.mean += t;
+	s.mean /= n;
+	for (double t : ms) s.stddev += (t - s.mean) * (t - s.mean);
+	s.stddev = n > 1 ? std::sqrt(s.stddev / (n - 1)) : 0;
+	return s;
+}
+
+struct BenchResult {
+	std::string name;
+	int entities;
+	int reps;
+	BenchStats ms;
+};
+
+class BenchSuite {
+public:
+	BenchSuite(int reps) :mReps(reps){}
+
+	// Call setup then time run, reps times after one warm up
+	// Only run is timed
+	void run(const std::string& name, int entities, std::function<void()> setup, std::function<void()> run){
+		std::vector<double> ms;
+		for (int i = 0; i <= mReps; i++){
+			setup();
+			auto t1 = BenchClock::now();
+			run();
+			auto t2 = BenchClock::now();
+			if (i > 0) ms.push_back(std::chrono::duration<double, std::milli>(t2 - t1).count());
+		}
+		BenchResult r = { name, entities, mReps, benchStats(ms) };
+		mResults.push_back(r);
+		print(std::cout, r);
+	}
+
+	static void printHeader(std::ostream& out){
+		out << std::left << std::setw(28) << "benchmark" << std::right << std::setw(9) << "entities"
+			<< std::setw(11) << "median ms" << std::setw(11) << "min ms" << std::setw(11) << "stddev"
+			<< std::setw(12) << "ns/entity" << "\n";
+	}
+
+	static void print(std::ostream& out, const BenchResult& r){
+		out << std::left << std::setw(28) << r.name << std::right << std::setw(9) << r.entities
+			<< std::fixed << std::setprecision(3)
+			<< std::setw(11) << r.ms.median << std::setw(11) << r.ms.min << std::setw(11) << r.ms.stddev
+			<< std::setprecision(1) << std::setw(12) << (r.entities ? 1e6 * r.ms.median / r.entities : 0.0) << "\n";
+	}
+
+	bool writeJson(const char* path){
+		std::ofstream out(path, std::ios::trunc);
+		if (!out) return false;
+		out << std::setprecision(6) << "{\n  \"reps\": " << mReps << ",\n  \"benchmarks\": [\n";
+		for (size_t i = 0; i < mResults.size(); i++){
+			const BenchResult& r = mResults[i];
+			out << "    {\"name\": \"" << r.name << "\", \"entities\": " << r.entities
+				<< ", \"min_ms\": " << r.ms.min << ", \"median_ms\": " << r.ms.median
+				<< ", \"mean_ms\": " << r.ms.mean << ", \"stddev_ms\": " << r.ms.stddev
+				<< ", \"max_ms\": " << r.ms.max << "}" << (i + 1 < mResults.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n}\n";
+		return (bool)out;
+	}
+
+protected:
+	int mReps;
+	std::vector<BenchResult> mResults;
+};
+
+#endif
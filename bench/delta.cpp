@@ -0,0 +1,106 @@
+// Loopback benchmark for delta snapshots
+// A sender world is simulated, diffed against its baseline every tick
+// and the delta applied to the baseline and to a follower world.
+// Usage: delta [numEntities] [numTicks]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+
+#include "entity.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double seconds(Clock::time_point t1, Clock::time_point t2){
+	return std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1).count();
+}
+
+static ID spawn(EntitySystem& es){
+	Entity& e = es.create();
+	Transform tr((float)(rand() % 1000), (float)(rand() % 1000));
+	e.add(tr);
+	if (rand() % 2){
+		Physics ph((float)(rand() % 10), (float)(rand() % 10));
+		e.add(ph);
+	}
+	if (rand() % 4 == 0){
+		Health h(100.f, rand() % 2 == 0);
+		e.add(h);
+	}
+	return e.id;
+}
+
+int main(int argc, char** argv){
+	int numEntities = argc > 1 ? atoi(argv[1]) : 20000;
+	int numTicks = argc > 2 ? atoi(argv[2]) : 300;
+	const double dt = 1.0 / 60;
+	srand(1);
+
+	std::unique_ptr<EntitySystem> live(new EntitySystem());
+	std::unique_ptr<EntitySystem> base(new EntitySystem());
+	std::unique_ptr<EntitySystem> follower(new EntitySystem());
+
+	std::vector<ID> ids;
+	for (int i = 0; i < numEntities; i++) ids.push_back(spawn(*live));
+	live->sync();
+
+	// Initial full state
+	std::vector<char> delta;
+	live->diff(*base, delta);
+	base->apply(delta.data(), delta.size());
+	follower->apply(delta.data(), delta.size());
+	std::cout << "initial state: " << delta.size() << " bytes\n";
+
+	double diffTime = 0, applyTime = 0;
+	size_t totalBytes = 0;
+	for (int tick = 0; tick < numTicks; tick++){
+		// Simulate: move things, poison things and churn 1% of the entities
+		for (Physics& p : live->components<Physics>()){
+			Transform& tr = live->lookup(p.entity).get<Transform>();
+			p.oldx = tr.x;
+			p.oldy = tr.y;
+			tr.x += p.vx * (float)dt;
+			tr.y += p.vy * (float)dt;
+		}
+		for (Health& h : live->components<Health>()){
+			if (h.poisoned) h.health -= 0.1f;
+		}
+		for (int i = 0; i < numEntities / 100; i++){
+			int j = rand() % ids.size();
+			live->remove(ids[j]);
+			ids[j] = spawn(*live);
+		}
+		live->sync();
+
+		delta.clear();
+		auto t1 = Clock::now();
+		live->diff(*base, delta);
+		auto t2 = Clock::now();
+		base->apply(delta.data(), delta.size());
+		auto t3 = Clock::now();
+		follower->apply(delta.data(), delta.size());
+
+		diffTime += seconds(t1, t2);
+		applyTime += seconds(t2, t3);
+		totalBytes += delta.size();
+	}
+
+	// Check the follower caught up
+	int mismatches = 0;
+	for (Transform& tr : live->components<Transform>()){
+		Entity& e = follower->lookup(tr.entity);
+		if (!e || !e.has<Transform>() || e.get<Transform>().x != tr.x || e.get<Transform>().y != tr.y) mismatches++;
+	}
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << numEntities << " entities, " << numTicks << " ticks\n";
+	std::cout << "bytes/tick:  " << (double)totalBytes / numTicks << "\n";
+	std::cout << "diff:        " << 1e6 * diffTime / numTicks << " us/tick\n";
+	std::cout << "apply:       " << 1e6 * applyTime / numTicks << " us/tick\n";
+	std::cout << "throughput:  " << (totalBytes / (1024.0 * 1024.0)) / (diffTime + applyTime) << " MB/s\n";
+	std::cout << "mismatches:  " << mismatches << "\n";
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
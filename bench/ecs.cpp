@@ -0,0 +1,260 @@
+// Benchmarks for the core entity system operations
+// Each case runs on worlds of several sizes and is repeated to get
+// statistics. Pass --json to keep the results for comparing versions.
+// Usage: ecs [--reps N] [--counts 1000,10000,...] [--allocator heap|huge|arena] [--json results.json]
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+
+#include "entity.h"
+#include "bench.h"
+
+// Stops the optimiser dropping loops whose results aren't used
+static volatile float sink;
+
+// Every entity has a Transform, half have Physics and a quarter have Health
+static void populate(EntitySystem& es, int count){
+	for (int i = 0; i < count; i++){
+		Entity& e = es.create();
+		Transform tr((float)i, (float)-i);
+		e.add(tr);
+		if (i % 2 == 0){
+			Physics ph(1.f, 0.5f);
+			e.add(ph);
+		}
+		if (i % 4 == 0){
+			Health h(100.f, i % 8 == 0);
+			e.add(h);
+		}
+	}
+	es.sync();
+}
+
+// Remove and re-add components of random entities, so the arrays
+// end up in a different order to the entities like after a long game
+static void scramble(EntitySystem& es, int count){
+	std::vector<ID> ids;
+	for (Entity& e : es.entities()) ids.push_back(e.id);
+	unsigned int seed = 12345;
+	for (int i = 0; i < count; i++){
+		seed = seed * 1103515245 + 12345;
+		Entity& e = es.lookup(ids[(seed >> 8) % ids.size()]);
+		Transform tr = e.get<Transform>();
+		e.remove<Transform>(true);
+		e.add(tr);
+		if (e.has<Physics>()){
+			Physics ph = e.get<Physics>();
+			e.remove<Physics>(true);
+			e.add(ph);
+		}
+	}
+	es.sync();
+}
+
+// The join PhysicsSystem does
+static void joinTransformPhysics(EntitySystem& es){
+	for (Physics& p : es.components<Physics>()){
+		Transform& tr = es.lookup(p.entity).get<Transform>();
+		p.oldx = tr.x;
+		p.oldy = tr.y;
+		tr.x += p.vx * 0.016f;
+		tr.y += p.vy * 0.016f;
+	}
+}
+
+static std::vector<int> parseCounts(const char* arg){
+	std::vector<int> counts;
+	for (const char* p = arg; *p; ){
+		int n = std::atoi(p);
+		if (n > 0 && n <= MAX_ENTITIES - 1) counts.push_back(n);
+		const char* comma = std::strchr(p, ',');
+		if (!comma) break;
+		p = comma + 1;
+	}
+	return counts;
+}
+
+int main(int argc, char** argv){
+	int reps = 10;
+	std::vector<int> counts = { 1000, 10000, 60000 };
+	const char* jsonPath = nullptr;
+	std::string allocatorName = "heap";
+	for (int i = 1; i + 1 < argc; i += 2){
+		if (std::strcmp(argv[i], "--reps") == 0) reps = std::atoi(argv[i + 1]);
+		else if (std::strcmp(argv[i], "--counts") == 0) counts = parseCounts(argv[i + 1]);
+		else if (std::strcmp(argv[i], "--json") == 0) jsonPath = argv[i + 1];
+		else if (std::strcmp(argv[i], "--allocator") == 0) allocatorName = argv[i + 1];
+		else {
+			std::cerr << "usage: ecs [--reps N] [--counts 1000,10000,...] [--allocator heap|huge|arena] [--json results.json]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Where the worlds' arrays live
+	HugePageAllocator huge;
+	ArenaAllocator arena;
+	Allocator* allocator = Allocator::heap();
+	if (allocatorName == "huge") allocator = &huge;
+	else if (allocatorName == "arena") allocator = &arena;
+	else if (allocatorName != "heap"){
+		std::cerr << "unknown allocator " << allocatorName << "\n";
+		return EXIT_FAILURE;
+	}
+
+	// Worlds are reset by copying an empty one, which is
+	// much cheaper than allocating all the arrays again
+	std::unique_ptr<EntitySystem> empty(new EntitySystem(allocator));
+	std::unique_ptr<EntitySystem> world(new EntitySystem(allocator));
+	std::unique_ptr<EntitySystem> other(new EntitySystem(allocator));
+	EntitySystem& es = *world;
+	auto reset = [&](){ es.copyFrom(*empty); };
+
+	BenchSuite suite(reps);
+	BenchSuite::printHeader(std::cout);
+	for (int n : counts){
+		// Create n entities with components, then destroy them all
+		suite.run("create_destroy", n, reset, [&](){
+			for (int i = 0; i < n; i++){
+				Entity& e = es.create();
+				Transform tr((float)i, 0.f);
+				e.add(tr);
+				Physics ph(1.f, 0.f);
+				e.add(ph);
+			}
+			for (Entity& e : es.entities()){
+				es.remove(e.id);
+			}
+			es.sync();
+		});
+
+		Prefab prefab("Thing");
+		prefab.add(Transform(1, 2)).add(Physics(1, 0)).add(Health(10));
+		std::vector<ID> ids;
+		suite.run("instantiate", n, [&](){ reset(); ids.clear(); }, [&](){
+			es.instantiate(prefab, n, ids);
+		});
+
+		// Read only passes over one array
+		reset();
+		populate(es, n);
+		suite.run("iterate_transform", n, [](){}, [&](){
+			float sum = 0;
+			for (Transform& tr : es.components<Transform>()) sum += tr.x;
+			sink = sum;
+		});
+		suite.run("iterate_physics", n, [](){}, [&](){
+			float sum = 0;
+			for (Physics& p : es.components<Physics>()) sum += p.vx;
+			sink = sum;
+		});
+		suite.run("iterate_health", n, [](){}, [&](){
+			float sum = 0;
+			for (Health& h : es.components<Health>()) sum += h.health;
+			sink = sum;
+		});
+
+		// Integrate Physics into the Transforms, like PhysicsSystem
+		suite.run("join_transform_physics", n, [](){}, [&](){
+			joinTransformPhysics(es);
+		});
+
+		// Entities with Transform and Physics but not Health, by index
+		// as a tool would, against checking every entity for each type
+		Query query;
+		query.with("Transform").with("Physics").without("Health");
+		QueryResult result;
+		suite.run("query", n, [](){}, [&](){
+			es.query(query, result);
+			sink = (float)result.size();
+		});
+		std::vector<ID> found;
+		std::vector<void*> columns;
+		suite.run("query_naive", n, [&](){ found.clear(); columns.clear(); }, [&](){
+			int transform = Transform::Index(), physics = Physics::Index(), health = Health::Index();
+			for (Entity& e : es.entities()){
+				if (e.hasComponent(transform) && e.hasComponent(physics) && !e.hasComponent(health)){
+					found.push_back(e.id);
+					columns.push_back(e.getComponent(transform));
+					columns.push_back(e.getComponent(physics));
+				}
+			}
+			sink = (float)found.size();
+		});
+
+		// The same join once the arrays are scrambled, the cost of
+		// sorting them back into entity order, and the join afterwards
+		reset();
+		populate(es, n);
+		scramble(es, n * 2);
+		suite.run("join_scrambled", n, [](){}, [&](){
+			joinTransformPhysics(es);
+		});
+		suite.run("defragment", n, [&](){
+			reset();
+			populate(es, n);
+			scramble(es, n * 2);
+		}, [&](){
+			es.sortByEntity<Transform>();
+			es.sortByEntity<Physics>();
+			es.defragment();
+		});
+		suite.run("join_defragmented", n, [](){}, [&](){
+			joinTransformPhysics(es);
+		});
+
+		// Half the entities were removed this frame
+		suite.run("sync_mass_removal", n, [&](){
+			reset();
+			populate(es, n);
+			bool odd = false;
+			for (Entity& e : es.entities()){
+				if (odd) es.remove(e.id);
+				odd = !odd;
+			}
+		}, [&](){
+			es.sync();
+		});
+
+		// Move every entity to another world, like a zone handing them over
+		std::vector<ID> moving, moved;
+		suite.run("migrate", n, [&](){
+			reset();
+			other->copyFrom(*empty);
+			populate(es, n);
+			moving.clear();
+			moved.clear();
+			for (Entity& e : es.entities()) moving.push_back(e.id);
+		}, [&](){
+			es.migrate(moving, *other, moved);
+			es.sync();
+		});
+
+		// Give every entity Health and take it away again
+		suite.run("add_remove_thrash", n, [&](){
+			reset();
+			populate(es, n);
+		}, [&](){
+			Health h(50.f);
+			for (Entity& e : es.entities()){
+				e.add(h);
+			}
+			for (Entity& e : es.entities()){
+				e.remove<Health>();
+			}
+			es.sync();
+		});
+	}
+
+	if (jsonPath){
+		if (!suite.writeJson(jsonPath)){
+			std::cerr << "couldn't write " << jsonPath << "\n";
+			return EXIT_FAILURE;
+		}
+		std::cout << "wrote " << jsonPath << "\n";
+	}
+	return EXIT_SUCCESS;
+}
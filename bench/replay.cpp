@@ -0,0 +1,151 @@
+// Replays a command journal (see journal.h) into fresh worlds on each
+// kind of storage, so real allocation and churn patterns recorded in
+// a game can be compared offline on identical traces.
+// Pass --record to write a synthetic journal to try it out with.
+// Usage: replay <journal> [--reps N] [--allocator heap|huge|arena|all] [--json results.json]
+//        replay --record <journal> [--frames N]
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include "entity.h"
+#include "bench.h"
+
+// Waves of spawning and despawning, with components coming and going
+static bool record(const char* path, int frames){
+	Journal journal;
+	if (!journal.open(path)) return false;
+	std::unique_ptr<EntitySystem> world(new EntitySystem());
+	EntitySystem& es = *world;
+	es.setJournal(&journal);
+
+	Prefab goblin("Goblin");
+	goblin.add(Transform(0, 0)).add(Health(10)).add(Physics(1, 0));
+	goblin.addShared(Description("A small angry goblin.")).addItem(Item::SWORD).addItem(Item::ARROW, 20);
+
+	std::vector<ID> ids;
+	unsigned int seed = 12345;
+	auto random = [&](unsigned int n){ seed = seed * 1103515245 + 12345; return (seed >> 8) % n; };
+	for (int frame = 0; frame < frames; frame++){
+		if (frame % 60 == 0 && ids.size() < 40000){
+			es.instantiate(goblin, 2000, ids);
+		}
+		for (int i = 0; i < 200 && ids.size() < 50000; i++){
+			Entity& e = es.create();
+			Transform tr((float)random(1000), (float)random(1000));
+			e.add(tr);
+			if (random(2)){
+				Physics ph((float)random(10), (float)random(10));
+				e.add(ph);
+			}
+			ids.push_back(e.id);
+		}
+		for (int i = 0; i < 500 && !ids.empty(); i++){
+			Entity& e = es.lookup(ids[random((unsigned int)ids.size())]);
+			if (e.has<Health>()) e.remove<Health>();
+			else {
+				Health h(100.f, random(4) == 0);
+				e.add(h);
+			}
+		}
+		for (int i = 0; i < 150 && !ids.empty(); i++){
+			size_t j = random((unsigned int)ids.size());
+			es.remove(ids[j]);
+			ids[j] = ids.back();
+			ids.pop_back();
+		}
+		es.sync();
+	}
+	es.setJournal(nullptr);
+	std::cout << "recorded " << journal.ops() << " ops in " << journal.bytes() << " bytes to " << path << "\n";
+	return true;
+}
+
+int main(int argc, char** argv){
+	if (argc >= 3 && std::strcmp(argv[1], "--record") == 0){
+		int frames = (argc >= 5 && std::strcmp(argv[3], "--frames") == 0) ? std::atoi(argv[4]) : 600;
+		return record(argv[2], frames) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	const char* usage = "usage: replay <journal> [--reps N] [--allocator heap|huge|arena|all] [--json results.json]\n"
+		"       replay --record <journal> [--frames N]\n";
+	if (argc < 2 || argv[1][0] == '-'){
+		std::cerr << usage;
+		return EXIT_FAILURE;
+	}
+	const char* path = argv[1];
+	int reps = 10;
+	const char* jsonPath = nullptr;
+	std::string allocatorName = "all";
+	for (int i = 2; i + 1 < argc; i += 2){
+		if (std::strcmp(argv[i], "--reps") == 0) reps = std::atoi(argv[i + 1]);
+		else if (std::strcmp(argv[i], "--json") == 0) jsonPath = argv[i + 1];
+		else if (std::strcmp(argv[i], "--allocator") == 0) allocatorName = argv[i + 1];
+		else {
+			std::cerr << usage;
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::ifstream in(path, std::ios::binary);
+	if (!in){
+		std::cerr << "couldn't read " << path << "\n";
+		return EXIT_FAILURE;
+	}
+	std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	JournalReplay journal;
+	if (!journal.parse(bytes)){
+		std::cerr << path << " isn't a journal from this build\n";
+		return EXIT_FAILURE;
+	}
+
+	// Once through to check it and count what's in it
+	std::unique_ptr<EntitySystem> world(new EntitySystem());
+	if (!world->replay(journal, UINT_MAX)) return EXIT_FAILURE;
+	int entities = (int)journal.entities().size();
+	std::cout << path << ": " << journal.frames() << " frames, " << entities << " entities\n";
+	world.reset();
+
+	HugePageAllocator huge;
+	ArenaAllocator arena;
+	std::vector<std::pair<std::string, Allocator*>> allocators;
+	if (allocatorName == "heap" || allocatorName == "all") allocators.push_back(std::make_pair("heap", Allocator::heap()));
+	if (allocatorName == "huge" || allocatorName == "all") allocators.push_back(std::make_pair("huge", (Allocator*)&huge));
+	if (allocatorName == "arena" || allocatorName == "all") allocators.push_back(std::make_pair("arena", (Allocator*)&arena));
+	if (allocators.empty()){
+		std::cerr << "unknown allocator " << allocatorName << "\n";
+		return EXIT_FAILURE;
+	}
+
+	// A new world each time, so every run allocates like the recorded one did
+	BenchSuite suite(reps);
+	BenchSuite::printHeader(std::cout);
+	bool ok = true;
+	for (auto& a : allocators){
+		suite.run("replay_" + a.first, entities, [&](){
+			world.reset();
+			arena.release();
+			world.reset(new EntitySystem(a.second));
+			journal.rewind();
+		}, [&](){
+			ok = world->replay(journal, UINT_MAX) && ok;
+		});
+	}
+	world.reset();
+	if (!ok) return EXIT_FAILURE;
+
+	if (jsonPath){
+		if (!suite.writeJson(jsonPath)){
+			std::cerr << "couldn't write " << jsonPath << "\n";
+			return EXIT_FAILURE;
+		}
+		std::cout << "wrote " << jsonPath << "\n";
+	}
+	return EXIT_SUCCESS;
+}
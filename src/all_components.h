@@ -6,9 +6,10 @@
 #include "inventory.h"
 #include "description.h"
 #include "physics.h"
+#include "shared.h"
 
 template <typename... Args> struct TypeList { static const int NUM = sizeof...(Args); };
-using ComponentTypeList = TypeList<Transform, Health, Inventory, ShortDescription, Description, Physics>;
+using ComponentTypeList = TypeList<Transform, Health, Inventory, ShortDescription, Description, Physics, Shared<Description>, Shared<Health>>;
 static const int NUM_COMPONENTS = ComponentTypeList::NUM;
 
 #endif
\ No newline at end of file
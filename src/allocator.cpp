@@ -0,0 +1,230 @@
+#include "allocator.h"
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// Shrink [p, p + bytes) to whole pages of pageSize
+static bool innerPages(void*& p, size_t& bytes, size_t pageSize){
+	uintptr_t first = ((uintptr_t)p + pageSize - 1) / pageSize * pageSize;
+	uintptr_t last = ((uintptr_t)p + bytes) / pageSize * pageSize;
+	if (last <= first) return false;
+	p = (void*)first;
+	bytes = last - first;
+	return true;
+}
+
+static size_t osPageSize(){
+#ifdef _WIN32
+	static const size_t size = [](){
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return (size_t)info.dwPageSize;
+	}();
+#else
+	static const size_t size = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	return size;
+}
+
+Allocator* Allocator::heap(){
+	static AlignedAllocator allocator;
+	return &allocator;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// AlignedAllocator
+///////////////////////////////////////////////////////////////////////////////
+
+AlignedAllocator::AlignedAllocator(size_t alignment) :mAlignment(alignment){}
+
+void* AlignedAllocator::allocate(size_t bytes, size_t alignment){
+	if (alignment < mAlignment) alignment = mAlignment;
+	if (alignment < sizeof(void*)) alignment = sizeof(void*);
+	if (bytes == 0) bytes = 1;
+	if (bytes >= MAPPED_SIZE){
+		// Fresh pages are zero already, and aren't backed until touched
+		assert(alignment <= osPageSize());
+#ifdef _WIN32
+		return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+		void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return p == MAP_FAILED ? nullptr : p;
+#endif
+	}
+
+#ifdef _WIN32
+	void* p = _aligned_malloc(bytes, alignment);
+#else
+	void* p = nullptr;
+	if (posix_memalign(&p, alignment, bytes) != 0) p = nullptr;
+#endif
+	if (p) std::memset(p, 0, bytes);
+	return p;
+}
+
+void AlignedAllocator::deallocate(void* p, size_t bytes){
+	if (!p) return;
+	if (bytes >= MAPPED_SIZE){
+#ifdef _WIN32
+		VirtualFree(p, 0, MEM_RELEASE);
+#else
+		munmap(p, bytes);
+#endif
+		return;
+	}
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+size_t AlignedAllocator::decommit(void* p, size_t bytes){
+#ifdef _WIN32
+	// Heap pages can't be decommitted
+	return 0;
+#else
+	// Private anonymous pages read as zero after MADV_DONTNEED
+	if (!innerPages(p, bytes, osPageSize())) return 0;
+	return madvise(p, bytes, MADV_DONTNEED) == 0 ? bytes : 0;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HugePageAllocator
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+
+HugePageAllocator::HugePageAllocator() :mHugePageSize(GetLargePageMinimum()), mHugeAllocations(0){
+	if (mHugePageSize == 0) mHugePageSize = 2 << 20;
+}
+
+size_t HugePageAllocator::roundUp(size_t bytes) const {
+	return (bytes + mHugePageSize - 1) / mHugePageSize * mHugePageSize;
+}
+
+void* HugePageAllocator::allocate(size_t bytes, size_t alignment){
+	// Large pages need SeLockMemoryPrivilege, so this often fails
+	void* p = VirtualAlloc(nullptr, roundUp(bytes), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	if (p){
+		mHugeAllocations++;
+		return p;
+	}
+	return VirtualAlloc(nullptr, roundUp(bytes), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void HugePageAllocator::deallocate(void* p, size_t bytes){
+	if (p) VirtualFree(p, 0, MEM_RELEASE);
+}
+
+size_t HugePageAllocator::decommit(void* p, size_t bytes){
+	// Recommitting straight away keeps the range usable,
+	// and it isn't backed again until it's touched
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	if (!innerPages(p, bytes, info.dwPageSize)) return 0;
+	if (!VirtualFree(p, bytes, MEM_DECOMMIT)) return 0;
+	VirtualAlloc(p, bytes, MEM_COMMIT, PAGE_READWRITE);
+	return bytes;
+}
+
+#else
+
+HugePageAllocator::HugePageAllocator() :mHugePageSize(2 << 20), mHugeAllocations(0){}
+
+size_t HugePageAllocator::roundUp(size_t bytes) const {
+	return (bytes + mHugePageSize - 1) / mHugePageSize * mHugePageSize;
+}
+
+void* HugePageAllocator::allocate(size_t bytes, size_t alignment){
+	size_t size = roundUp(bytes);
+	void* p;
+#ifdef MAP_HUGETLB
+	// Only works if the admin has reserved huge pages
+	p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED){
+		mHugeAllocations++;
+		return p;
+	}
+#endif
+	p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+	madvise(p, size, MADV_HUGEPAGE);
+#endif
+	return p;
+}
+
+void HugePageAllocator::deallocate(void* p, size_t bytes){
+	if (p) munmap(p, roundUp(bytes));
+}
+
+size_t HugePageAllocator::decommit(void* p, size_t bytes){
+	// NB: Fails on explicit huge pages unless the range covers whole ones
+	if (!innerPages(p, bytes, osPageSize())) return 0;
+	return madvise(p, bytes, MADV_DONTNEED) == 0 ? bytes : 0;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// ArenaAllocator
+///////////////////////////////////////////////////////////////////////////////
+
+ArenaAllocator::ArenaAllocator(Allocator* upstream, size_t blockSize)
+	:mUpstream(upstream ? upstream : Allocator::heap()), mBlockSize(blockSize), mOffset(0), mReserved(0), mUsed(0){}
+
+ArenaAllocator::~ArenaAllocator(){
+	release();
+}
+
+void* ArenaAllocator::allocate(size_t bytes, size_t alignment){
+	if (alignment == 0) alignment = 1;
+	if (!mBlocks.empty()){
+		Block& b = mBlocks.back();
+		size_t offset = (mOffset + alignment - 1) / alignment * alignment;
+		if (offset + bytes <= b.size){
+			mOffset = offset + bytes;
+			mUsed += bytes;
+			return b.data + offset;
+		}
+	}
+
+	// Blocks are fresh from upstream so are already zeroed
+	Block b;
+	b.size = bytes > mBlockSize ? bytes : mBlockSize;
+	b.data = (char*)mUpstream->allocate(b.size, alignment > 64 ? alignment : 64);
+	if (!b.data) return nullptr;
+	mReserved += b.size;
+	mUsed += bytes;
+
+	// Big allocations get a block to themselves, and
+	// the current block carries on serving small ones
+	if (bytes > mBlockSize && !mBlocks.empty()){
+		mBlocks.insert(mBlocks.end() - 1, b);
+	}
+	else {
+		mBlocks.push_back(b);
+		mOffset = bytes;
+	}
+	return b.data;
+}
+
+void ArenaAllocator::release(){
+	for (Block& b : mBlocks) mUpstream->deallocate(b.data, b.size);
+	mBlocks.clear();
+	mOffset = 0;
+	mReserved = 0;
+	mUsed = 0;
+}
@@ -0,0 +1,112 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <cstddef>
+#include <vector>
+
+// Where component storage comes from
+// Pass one to EntitySystem to back all of its arrays
+// NB: The allocator must outlive the world
+class Allocator {
+public:
+	virtual ~Allocator(){}
+
+	// Returns zeroed memory aligned to at least alignment, or nullptr
+	virtual void* allocate(size_t bytes, size_t alignment) = 0;
+
+	// PRE: p and bytes are from allocate()
+	virtual void deallocate(void* p, size_t bytes) = 0;
+
+	// Give the whole pages inside [p, p + bytes) back to the OS
+	// They stay allocated and read as zero when next touched
+	// Returns the number of bytes released, 0 if not supported
+	// PRE: the range is inside a block from allocate()
+	virtual size_t decommit(void* p, size_t bytes){ return 0; }
+
+	virtual const char* name() = 0;
+
+	// The default, an AlignedAllocator
+	static Allocator* heap();
+};
+
+// Heap memory aligned to cache lines (or more)
+// Blocks of MAPPED_SIZE or more are mapped straight from the OS instead,
+// page aligned, so their pages are only backed once they're touched
+class AlignedAllocator : public Allocator {
+public:
+	static const size_t MAPPED_SIZE = 64 << 10;
+
+	explicit AlignedAllocator(size_t alignment = 64);
+
+	void* allocate(size_t bytes, size_t alignment) override;
+	void deallocate(void* p, size_t bytes) override;
+	size_t decommit(void* p, size_t bytes) override;
+	const char* name() override { return "aligned"; }
+
+protected:
+	size_t mAlignment;
+};
+
+// Large pages straight from the OS, to cut TLB misses on big arrays
+// Tries explicit huge pages (MAP_HUGETLB, or MEM_LARGE_PAGES on Windows)
+// and falls back to normal pages, advised for transparent huge pages
+// The OS commits pages on first touch, so unused capacity costs nothing
+class HugePageAllocator : public Allocator {
+public:
+	HugePageAllocator();
+
+	void* allocate(size_t bytes, size_t alignment) override;
+	void deallocate(void* p, size_t bytes) override;
+	size_t decommit(void* p, size_t bytes) override;
+	const char* name() override { return "huge page"; }
+
+	// Number of allocations that got explicit huge pages
+	unsigned int hugeAllocations() const { return mHugeAllocations; }
+
+protected:
+	size_t roundUp(size_t bytes) const;
+
+	size_t mHugePageSize;
+	unsigned int mHugeAllocations;
+};
+
+// Carves allocations out of big blocks and never frees them individually
+// Everything goes at once in release() (or when the arena is destroyed),
+// so one world per arena makes tearing a world down a few frees
+class ArenaAllocator : public Allocator {
+public:
+	// Blocks come from upstream (default heap())
+	explicit ArenaAllocator(Allocator* upstream = nullptr, size_t blockSize = 16 << 20);
+	~ArenaAllocator();
+
+	void* allocate(size_t bytes, size_t alignment) override;
+	void deallocate(void* p, size_t bytes) override {}
+	size_t decommit(void* p, size_t bytes) override { return mUpstream->decommit(p, bytes); }
+	const char* name() override { return "arena"; }
+
+	// Free every block
+	// PRE: nothing allocated from the arena is still in use
+	void release();
+
+	// Bytes of blocks held, and bytes handed out
+	size_t reserved() const { return mReserved; }
+	size_t used() const { return mUsed; }
+
+protected:
+	ArenaAllocator(const ArenaAllocator&) = delete;
+	ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+	struct Block {
+		char* data;
+		size_t size;
+	};
+
+	Allocator* mUpstream;
+	size_t mBlockSize;
+	std::vector<Block> mBlocks;
+	size_t mOffset; // into the last block
+	size_t mReserved;
+	size_t mUsed;
+};
+
+#endif
@@ -0,0 +1,258 @@
+#include "entity.h"
+#include "string_pool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Writing
+///////////////////////////////////////////////////////////////////////////////
+
+// One column's buffers, from the record each row's value is in
+static void writeColumn(SnapshotWriter& writer, const Field& field, const std::vector<const char*>& rows, ColumnInfo& info, EntitySystem& world){
+	size_t count = rows.size();
+	if (field.type == FieldType::String){
+		StringPool& pool = StringPool::instance();
+		std::vector<int32_t> offsets(count + 1, 0);
+		std::vector<char> chars;
+		for (size_t i = 0; i < count; i++){
+			unsigned int handle;
+			std::memcpy(&handle, rows[i] + field.offset, sizeof(handle));
+			const char* str = pool.str(handle);
+			chars.insert(chars.end(), str, str + std::strlen(str));
+			offsets[i + 1] = (int32_t)chars.size();
+		}
+		info.width = 1;
+		info.offsetsOffset = writer.align();
+		writer.write(offsets.data(), offsets.size() * sizeof(int32_t));
+		info.valuesOffset = writer.align();
+		info.valuesBytes = chars.size();
+		writer.write(chars.data(), chars.size());
+	}
+	else if (field.type == FieldType::Items){
+		ItemSlab& items = world.items();
+		std::vector<int32_t> offsets(count + 1, 0);
+		std::vector<ItemAndCount> stacks;
+		for (size_t i = 0; i < count; i++){
+			ItemStacks s;
+			std::memcpy(&s, rows[i] + field.offset, sizeof(s));
+			stacks.insert(stacks.end(), items.begin(s), items.end(s));
+			offsets[i + 1] = (int32_t)stacks.size();
+		}
+		info.width = sizeof(ItemAndCount);
+		info.offsetsOffset = writer.align();
+		writer.write(offsets.data(), offsets.size() * sizeof(int32_t));
+		info.valuesOffset = writer.align();
+		info.valuesBytes = stacks.size() * sizeof(ItemAndCount);
+		writer.write(stacks.data(), (size_t)info.valuesBytes);
+	}
+	else if (field.type == FieldType::Shared){
+		std::vector<uint8_t> present(count);
+		for (size_t i = 0; i < count; i++){
+			unsigned int handle;
+			std::memcpy(&handle, rows[i] + field.offset, sizeof(handle));
+			present[i] = handle != 0;
+		}
+		info.width = 1;
+		info.valuesOffset = writer.align();
+		info.valuesBytes = count;
+		writer.write(present.data(), count);
+	}
+	else {
+		std::vector<char> values(count * field.size);
+		for (size_t i = 0; i < count; i++){
+			std::memcpy(&values[i * field.size], rows[i] + field.offset, field.size);
+		}
+		info.width = field.size;
+		info.valuesOffset = writer.align();
+		info.valuesBytes = values.size();
+		writer.write(values.data(), values.size());
+	}
+}
+
+void writeColumns(SnapshotWriter& writer, const char* name, int version, const std::vector<Field>& fields,
+	const char* records, unsigned int stride, unsigned int count, EntitySystem& world){
+	// Shared values are spread out into a column per field
+	struct Source {
+		std::string name;
+		const Field* field;
+		const Field* shared; // the Shared field for value fields, otherwise nullptr
+	};
+	std::vector<Source> sources;
+	for (const Field& f : fields){
+		sources.push_back(Source{ f.name, &f, nullptr });
+		if (f.type != FieldType::Shared) continue;
+		for (const Field& vf : world.sharedPool(f.shared)->fields()){
+			// Values can't hold handles to other values
+			if (vf.type == FieldType::Shared) continue;
+			sources.push_back(Source{ std::string(f.name) + "." + vf.name, &vf, &f });
+		}
+	}
+
+	ColumnsHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, COLUMNS_MAGIC, sizeof(header.magic));
+	header.version = COLUMNS_VERSION;
+	setSnapshotName(header.name, name);
+	header.componentVersion = version;
+	header.numRows = count;
+	header.numColumns = (uint32_t)sources.size();
+	writer.write(&header, sizeof(header));
+
+	// Column infos are patched as each column is written
+	uint64_t infoOffset = writer.offset();
+	ColumnInfo blank;
+	std::memset(&blank, 0, sizeof(blank));
+	for (size_t i = 0; i < sources.size(); i++){
+		writer.write(&blank, sizeof(blank));
+	}
+
+	std::vector<const char*> rows(count);
+	std::vector<char> defaultValue;
+	for (const Source& s : sources){
+		if (s.shared){
+			// Rows without a value get the default
+			SharedPoolBase* pool = world.sharedPool(s.shared->shared);
+			defaultValue.resize(pool->valueSize());
+			pool->defaultValue(defaultValue.data());
+			for (unsigned int i = 0; i < count; i++){
+				unsigned int handle;
+				std::memcpy(&handle, records + (size_t)i * stride + s.shared->offset, sizeof(handle));
+				rows[i] = handle ? pool->value(handle) : defaultValue.data();
+			}
+		}
+		else {
+			for (unsigned int i = 0; i < count; i++){
+				rows[i] = records + (size_t)i * stride;
+			}
+		}
+
+		ColumnInfo info;
+		std::memset(&info, 0, sizeof(info));
+		setSnapshotName(info.name, s.name.c_str());
+		info.type = (uint32_t)s.field->type;
+		writeColumn(writer, *s.field, rows, info, world);
+		writer.patch(infoOffset, info);
+		infoOffset += sizeof(ColumnInfo);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ColumnsFile
+///////////////////////////////////////////////////////////////////////////////
+
+static bool validColumn(const ColumnInfo& column, const char* data, uint64_t size, uint32_t numRows){
+	if (column.valuesOffset > size || column.valuesBytes > size - column.valuesOffset) return false;
+	FieldType type = (FieldType)column.type;
+	if (type != FieldType::String && type != FieldType::Items){
+		return column.offsetsOffset == 0 && column.width > 0 && column.valuesBytes == (uint64_t)numRows * column.width;
+	}
+
+	// Offsets must be 4 byte aligned, start at 0, never go
+	// backwards and stay inside the values
+	uint64_t offsetsBytes = ((uint64_t)numRows + 1) * sizeof(int32_t);
+	if (column.width == 0 || column.offsetsOffset % sizeof(int32_t) != 0) return false;
+	if (column.offsetsOffset > size || offsetsBytes > size - column.offsetsOffset) return false;
+	const int32_t* offsets = (const int32_t*)(data + column.offsetsOffset);
+	if (offsets[0] != 0) return false;
+	for (uint32_t i = 0; i < numRows; i++){
+		if (offsets[i + 1] < offsets[i]) return false;
+	}
+	return (uint64_t)offsets[numRows] * column.width <= column.valuesBytes;
+}
+
+bool ColumnsFile::open(const char* path){
+	if (!mFile.open(path)) return false;
+	uint64_t size = mFile.size();
+	if (size < sizeof(ColumnsHeader)) return false;
+	const ColumnsHeader& h = header();
+	if (std::memcmp(h.magic, COLUMNS_MAGIC, sizeof(h.magic)) != 0 || h.version != COLUMNS_VERSION) return false;
+	if (sizeof(ColumnsHeader) + (uint64_t)h.numColumns * sizeof(ColumnInfo) > size) return false;
+
+	const ColumnInfo* columns = (const ColumnInfo*)(mFile.data() + sizeof(ColumnsHeader));
+	for (uint32_t i = 0; i < h.numColumns; i++){
+		if (!validColumn(columns[i], mFile.data(), size, h.numRows)) return false;
+	}
+	return true;
+}
+
+const ColumnInfo* ColumnsFile::find(const char* name, FieldType type, unsigned int width) const {
+	const ColumnInfo* columns = (const ColumnInfo*)(mFile.data() + sizeof(ColumnsHeader));
+	for (uint32_t i = 0; i < header().numColumns; i++){
+		const ColumnInfo& c = columns[i];
+		if (std::strncmp(c.name, name, SNAPSHOT_NAME_SIZE - 1) == 0){
+			return (c.type == (uint32_t)type && c.width == width) ? &c : nullptr;
+		}
+	}
+	return nullptr;
+}
+
+void ColumnsFile::read(const std::vector<Field>& fields, char* const* records, EntitySystem& world) const {
+	for (const Field& f : fields){
+		readField(f, f.name, records, world);
+	}
+}
+
+void ColumnsFile::readField(const Field& field, const std::string& name, char* const* records, EntitySystem& world) const {
+	unsigned int count = numRows();
+	if (field.type == FieldType::String){
+		const ColumnInfo* column = find(name.c_str(), field.type, 1);
+		if (!column) return;
+		const int32_t* offsets = this->offsets(*column);
+		const char* chars = values(*column);
+		StringPool& pool = StringPool::instance();
+		for (unsigned int i = 0; i < count; i++){
+			unsigned int handle = pool.intern(chars + offsets[i], offsets[i + 1] - offsets[i]);
+			std::memcpy(records[i] + field.offset, &handle, sizeof(handle));
+		}
+	}
+	else if (field.type == FieldType::Items){
+		const ColumnInfo* column = find(name.c_str(), field.type, sizeof(ItemAndCount));
+		if (!column) return;
+		const int32_t* offsets = this->offsets(*column);
+		const ItemAndCount* stacks = (const ItemAndCount*)values(*column);
+		ItemSlab& items = world.items();
+		for (unsigned int i = 0; i < count; i++){
+			// NB: More than MAX_ITEMS stacks, or an unknown item or a count
+			// below 1, leaves the inventory as it was
+			items.assign(*(ItemStacks*)(records[i] + field.offset), stacks + offsets[i], stacks + offsets[i + 1]);
+		}
+	}
+	else if (field.type == FieldType::Shared){
+		const ColumnInfo* column = find(name.c_str(), field.type, 1);
+		if (!column) return;
+		const uint8_t* present = (const uint8_t*)values(*column);
+
+		// Put the values together from their columns, then add them to the pool
+		SharedPoolBase* pool = world.sharedPool(field.shared);
+		unsigned int size = pool->valueSize();
+		std::vector<char> buffer((size_t)count * size);
+		std::vector<char*> values(count);
+		for (unsigned int i = 0; i < count; i++){
+			values[i] = &buffer[(size_t)i * size];
+			pool->defaultValue(values[i]);
+		}
+		for (const Field& vf : pool->fields()){
+			if (vf.type != FieldType::Shared) readField(vf, name + "." + vf.name, values.data(), world);
+		}
+		for (unsigned int i = 0; i < count; i++){
+			unsigned int* handle = (unsigned int*)(records[i] + field.offset);
+			pool->release(*handle);
+			*handle = present[i] ? pool->acquireRaw(values[i]) : 0;
+		}
+	}
+	else if (field.type == FieldType::Bool){
+		const ColumnInfo* column = find(name.c_str(), field.type, sizeof(bool));
+		if (!column) return;
+		// Any non-zero byte is true
+		const uint8_t* src = (const uint8_t*)values(*column);
+		for (unsigned int i = 0; i < count; i++){
+			*(bool*)(records[i] + field.offset) = src[i] != 0;
+		}
+	}
+	else {
+		const ColumnInfo* column = find(name.c_str(), field.type, field.size);
+		if (!column) return;
+		const char* src = values(*column);
+		for (unsigned int i = 0; i < count; i++){
+			std::memcpy(records[i] + field.offset, src + (size_t)i * field.size, field.size);
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "component.h"
+#include "snapshot.h"
+#include "mapped_file.h"
+
+// Columnar files of one component type (see EntitySystem::exportColumns()
+// and importColumns()), for analytics and for seeding worlds from generated data
+//
+// Layout:
+//   ColumnsHeader
+//   ColumnInfo[numColumns]
+//   Each column's buffers, 64 byte aligned
+//
+// There's a column for each field, id and entity first. Buffers are
+// laid out like Arrow's, so a reader can wrap them without copying:
+//   Int, UInt, Float, Bytes: numRows values of width bytes
+//   Bool: one byte per row (Arrow packs them into bits)
+//   String: int32 offsets[numRows + 1] then the UTF-8 chars
+//   Items: int32 offsets[numRows + 1] then ItemAndCount stacks
+// A Shared field is a column of one byte flags, 0 for no value, followed
+// by a column for each field of the value named "<field>.<value field>"
+// (rows with no value hold the default). Values aren't deduplicated, as
+// the handles only mean something in the world that wrote them.
+
+static const char COLUMNS_MAGIC[4] = { 'E', 'C', 'S', 'C' };
+static const unsigned int COLUMNS_VERSION = 1;
+
+struct ColumnsHeader {
+	char magic[4];
+	uint32_t version;
+	char name[SNAPSHOT_NAME_SIZE]; // of the component type
+	uint32_t componentVersion;
+	uint32_t numRows;
+	uint32_t numColumns;
+	uint32_t pad;
+};
+
+struct ColumnInfo {
+	char name[SNAPSHOT_NAME_SIZE];
+	uint32_t type;  // FieldType
+	uint32_t width; // bytes per value, or per stack/char for String and Items
+	uint64_t offsetsOffset; // String and Items only, otherwise 0
+	uint64_t valuesOffset;
+	uint64_t valuesBytes;
+};
+
+class EntitySystem;
+
+// Write count records stride bytes apart as a columns file
+void writeColumns(SnapshotWriter& writer, const char* name, int version, const std::vector<Field>& fields,
+	const char* records, unsigned int stride, unsigned int count, EntitySystem& world);
+
+// A memory mapped columns file
+class ColumnsFile {
+public:
+	// Returns false if it's missing or malformed
+	bool open(const char* path);
+
+	const ColumnsHeader& header() const { return *(const ColumnsHeader*)mFile.data(); }
+	unsigned int numRows() const { return header().numRows; }
+
+	// Column with this name, type and width, or nullptr
+	const ColumnInfo* find(const char* name, FieldType type, unsigned int width) const;
+
+	const char* values(const ColumnInfo& column) const { return mFile.data() + column.valuesOffset; }
+	const int32_t* offsets(const ColumnInfo& column) const { return (const int32_t*)(mFile.data() + column.offsetsOffset); }
+
+	// Write the columns of the fields into count records
+	// Fields are matched by name, type and width, and missing ones are left alone
+	void read(const std::vector<Field>& fields, char* const* records, EntitySystem& world) const;
+
+protected:
+	void readField(const Field& field, const std::string& name, char* const* records, EntitySystem& world) const;
+
+	MappedFile mFile;
+};
+
+#endif
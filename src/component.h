@@ -2,16 +2,57 @@
 #define COMPONENT_H
 
 #include <ostream>
+#include <vector>
+#include <cstddef>
 #include <cassert>
 
 using ID = unsigned int;
 static const ID INVALID_ID = 0;
-static const int MAX_COMPONENTS = 16;
+static const int MAX_COMPONENTS = 16; // compile-time types, runtime ones are uncapped (see runtime_component.h)
 
 // Logging shorthand for components
 #define COM_LOG_C(var) {oss << (#var) << ": " << std::boolalpha << var << ", ";}
 #define COM_LOG(var) {oss << (#var) << ": " << std::boolalpha << var;}
 
+// Describes the layout of a component field
+// Used by serialisation to match up fields when a component changes
+enum class FieldType : unsigned int {
+	Bytes,
+	Int,
+	UInt,
+	Float,
+	Bool,
+	String, // InternedString handle, see string_pool.h
+	Items,  // ItemStacks in the world's ItemSlab, see inventory.h
+	Shared  // handle in the world's SharedPool, see shared.h
+};
+
+template <typename T> struct FieldTypeOf { static const FieldType value = FieldType::Bytes; };
+template <> struct FieldTypeOf<int> { static const FieldType value = FieldType::Int; };
+template <> struct FieldTypeOf<unsigned int> { static const FieldType value = FieldType::UInt; };
+template <> struct FieldTypeOf<float> { static const FieldType value = FieldType::Float; };
+template <> struct FieldTypeOf<bool> { static const FieldType value = FieldType::Bool; };
+
+struct Field {
+	const char* name;
+	unsigned int offset;
+	unsigned int size;
+	FieldType type;
+	int shared; // Shared fields: Index() of the Shared<C> component
+};
+
+// Offset of a member of T, measured on an instance
+// offsetof() is only defined for standard layout types, which components
+// aren't, as Component<> has members too
+template <typename T, typename M, typename Owner>
+unsigned int fieldOffset(M Owner::* member){
+	static const T object{};
+	return (unsigned int)((const char*)&(object.*member) - (const char*)&object);
+}
+
+// Field description shorthand for components
+#define COM_FIELD(type, var) Field{ (#var), fieldOffset<type>(&type::var), (unsigned int)sizeof(((type*)nullptr)->var), FieldTypeOf<decltype(((type*)nullptr)->var)>::value, 0 }
+
 // Uses CRTP to generate ids
 // (based on EntityX by AlecThomas)
 struct BaseComponent {
@@ -31,9 +72,32 @@ struct Component : public BaseComponent {
 		return index;
 	}
 
+	// Schema version, bump when the meaning of a field changes
+	static int Version(){ return 1; }
+
+	// Fields of the derived component (excluding id and entity)
+	static const std::vector<Field>& Fields(){
+		static const std::vector<Field> fields;
+		return fields;
+	}
+
+	// id and entity followed by Derived::Fields()
+	static const std::vector<Field>& AllFields(){
+		static const std::vector<Field> fields = MakeAllFields();
+		return fields;
+	}
+
 	operator bool(){
 		return id!=INVALID_ID;
 	}
+
+protected:
+	static std::vector<Field> MakeAllFields(){
+		std::vector<Field> fields = { COM_FIELD(Derived, id), COM_FIELD(Derived, entity) };
+		const std::vector<Field>& rest = Derived::Fields();
+		fields.insert(fields.end(), rest.begin(), rest.end());
+		return fields;
+	}
 };
 
 
@@ -0,0 +1,253 @@
+#include "entity.h"
+#include "string_pool.h"
+#include <algorithm>
+#include <unordered_set>
+
+bool sameDeltaField(const Field& field, const char* a, EntitySystem& aWorld, const char* b, EntitySystem& bWorld){
+	if (field.type == FieldType::Items){
+		// Slab offsets differ between worlds, so compare the stacks
+		ItemSlab& aItems = aWorld.items();
+		ItemSlab& bItems = bWorld.items();
+		ItemStacks sa, sb;
+		std::memcpy(&sa, a + field.offset, sizeof(sa));
+		std::memcpy(&sb, b + field.offset, sizeof(sb));
+		return sa.size == sb.size && std::equal(aItems.begin(sa), aItems.end(sa), bItems.begin(sb), 
+			[](const ItemAndCount& x, const ItemAndCount& y){ return x.item == y.item && x.count == y.count; });
+	}
+	else if (field.type == FieldType::Shared){
+		// Likewise handles, so compare the values
+		unsigned int ha, hb;
+		std::memcpy(&ha, a + field.offset, sizeof(ha));
+		std::memcpy(&hb, b + field.offset, sizeof(hb));
+		if (ha == 0 || hb == 0) return ha == hb;
+		SharedPoolBase* aPool = aWorld.sharedPool(field.shared);
+		SharedPoolBase* bPool = bWorld.sharedPool(field.shared);
+		for (const Field& f : aPool->fields()){
+			if (!sameDeltaField(f, aPool->value(ha), aWorld, bPool->value(hb), bWorld)) return false;
+		}
+		return true;
+	}
+	return std::memcmp(a + field.offset, b + field.offset, field.size) == 0;
+}
+
+void writeDeltaField(DeltaWriter& writer, const Field& field, const char* record, EntitySystem& world){
+	if (field.type == FieldType::Items){
+		ItemSlab& items = world.items();
+		ItemStacks stacks;
+		std::memcpy(&stacks, record + field.offset, sizeof(stacks));
+		uint32_t size = stacks.size;
+		writer.write(size);
+		writer.write(items.begin(stacks), size * sizeof(ItemAndCount));
+	}
+	else if (field.type == FieldType::String){
+		unsigned int handle;
+		std::memcpy(&handle, record + field.offset, sizeof(handle));
+		const char* str = StringPool::instance().str(handle);
+		uint32_t length = (uint32_t)std::strlen(str);
+		writer.write(length);
+		writer.write(str, length);
+	}
+	else if (field.type == FieldType::Shared){
+		unsigned int handle;
+		std::memcpy(&handle, record + field.offset, sizeof(handle));
+		uint8_t present = handle != 0;
+		writer.write(present);
+		if (present){
+			SharedPoolBase* pool = world.sharedPool(field.shared);
+			for (const Field& f : pool->fields()){
+				writeDeltaField(writer, f, pool->value(handle), world);
+			}
+		}
+	}
+	else {
+		writer.write(record + field.offset, field.size);
+	}
+}
+
+bool readDeltaField(DeltaReader& reader, const Field& field, char* record, EntitySystem& world){
+	if (field.type == FieldType::Items){
+		uint32_t size;
+		if (!reader.read(size) || size > MAX_ITEMS) return false;
+		const char* src = reader.readBytes(size * sizeof(ItemAndCount));
+		if (!src) return false;
+		std::vector<ItemAndCount> stacks(size);
+		std::memcpy(stacks.data(), src, size * sizeof(ItemAndCount));
+		ItemStacks* dst = (ItemStacks*)(record + field.offset);
+		if (!world.items().assign(*dst, stacks.data(), stacks.data() + size)) return false;
+	}
+	else if (field.type == FieldType::String){
+		uint32_t length;
+		if (!reader.read(length)) return false;
+		const char* str = reader.readBytes(length);
+		if (!str) return false;
+		unsigned int handle = StringPool::instance().intern(str, length);
+		std::memcpy(record + field.offset, &handle, sizeof(handle));
+	}
+	else if (field.type == FieldType::Shared){
+		uint8_t present;
+		if (!reader.read(present)) return false;
+		SharedPoolBase* pool = world.sharedPool(field.shared);
+		unsigned int handle = 0;
+		if (present){
+			std::vector<char> value(pool->valueSize());
+			pool->defaultValue(value.data());
+			for (const Field& f : pool->fields()){
+				if (f.type == FieldType::Shared || !readDeltaField(reader, f, value.data(), world)) return false;
+			}
+			handle = pool->acquireRaw(value.data());
+		}
+		unsigned int* dst = (unsigned int*)(record + field.offset);
+		pool->release(*dst);
+		*dst = handle;
+	}
+	else {
+		const char* src = reader.readBytes(field.size);
+		if (!src) return false;
+		std::memcpy(record + field.offset, src, field.size);
+	}
+	return true;
+}
+
+// As readDeltaField(), but only checks the field could be read into world
+static bool skipDeltaField(DeltaReader& reader, const Field& field, EntitySystem& world){
+	if (field.type == FieldType::Items){
+		uint32_t size;
+		if (!reader.read(size) || size > MAX_ITEMS) return false;
+		const char* src = reader.readBytes(size * sizeof(ItemAndCount));
+		if (!src) return false;
+		for (uint32_t i = 0; i < size; i++){
+			ItemAndCount stack;
+			std::memcpy(&stack, src + i * sizeof(ItemAndCount), sizeof(stack));
+			if (!ItemSlab::valid(stack)) return false;
+		}
+	}
+	else if (field.type == FieldType::String){
+		uint32_t length;
+		if (!reader.read(length) || !reader.readBytes(length)) return false;
+	}
+	else if (field.type == FieldType::Shared){
+		uint8_t present;
+		if (!reader.read(present)) return false;
+		if (present){
+			for (const Field& f : world.sharedPool(field.shared)->fields()){
+				if (f.type == FieldType::Shared || !skipDeltaField(reader, f, world)) return false;
+			}
+		}
+	}
+	else {
+		if (!reader.readBytes(field.size)) return false;
+	}
+	return true;
+}
+
+void EntitySystem::diff(EntitySystem& base, std::vector<char>& delta){
+	DeltaWriter writer(delta);
+	DeltaHeader header;
+	std::memcpy(header.magic, DELTA_MAGIC, sizeof(header.magic));
+	header.numDestroyed = 0;
+	header.numCreated = 0;
+	header.numComponentTypes = 0;
+	size_t headerOffset = writer.write(header);
+
+	// NB: Index 0 is the invalid entity in both
+	for (unsigned int i = 1; i < base.mEntities.size(); i++){
+		ID id = base.mEntities.objects().get(i).id;
+		if (!mEntities.has(id)){
+			writer.write(id);
+			header.numDestroyed++;
+		}
+	}
+
+	for (unsigned int i = 1; i < mEntities.size(); i++){
+		ID id = mEntities.objects().get(i).id;
+		if (!base.mEntities.has(id)){
+			writer.write(id);
+			header.numCreated++;
+		}
+	}
+
+	diffComponentArrays(base, writer, 0, header.numComponentTypes, ComponentTypeList());
+	writer.patch(headerOffset, header);
+}
+
+bool EntitySystem::validDelta(const char* delta, size_t size){
+	DeltaReader reader(delta, size);
+	DeltaHeader header;
+	if (!reader.read(header) || std::memcmp(header.magic, DELTA_MAGIC, sizeof(header.magic)) != 0) return false;
+	if (header.numDestroyed > size / sizeof(ID) || header.numCreated > size / sizeof(ID)) return false;
+
+	// Which entities are alive once the destroyed and created ones are done
+	// A live entity is destroyed if its slot is marked
+	std::vector<bool> destroyed(PackedArray<Entity>::maxObjects(), false), createdSlots(destroyed);
+	std::unordered_set<ID> created;
+	for (uint32_t i = 0; i < header.numDestroyed; i++){
+		ID id;
+		if (!reader.read(id)) return false;
+		if (has(id)) destroyed[PackedArray<Entity>::slot(id)] = true;
+	}
+	for (uint32_t i = 0; i < header.numCreated; i++){
+		ID id;
+		if (!reader.read(id)) return false;
+		unsigned int slot = PackedArray<Entity>::slot(id);
+		if (mEntities.has(id) && !destroyed[slot]) continue;
+
+		// It's inserted into its slot, so nothing else may be there
+		if ((mEntities.slotInUse(slot) && !destroyed[slot]) || createdSlots[slot]) return false;
+		createdSlots[slot] = true;
+		created.insert(id);
+	}
+
+	for (uint32_t i = 0; i < header.numComponentTypes; i++){
+		DeltaComponents dc;
+		if (!reader.read(dc) || dc.type >= (uint32_t)NUM_COMPONENTS) return false;
+		const std::vector<Field>& fields = componentFields((int)dc.type);
+		if (dc.numFields != fields.size()) return false;
+		if (dc.numRemoved > size / sizeof(ID) || !reader.readBytes(dc.numRemoved * sizeof(ID))) return false;
+
+		for (uint32_t j = 0; j < dc.numChanged; j++){
+			ID entity;
+			uint32_t mask;
+			if (!reader.read(entity) || !reader.read(mask)) return false;
+			bool alive = (has(entity) && !destroyed[PackedArray<Entity>::slot(entity)]) || created.count(entity);
+			if (!alive || (fields.size() < 32 && (mask >> fields.size()) != 0)) return false;
+			for (size_t f = 0; f < fields.size(); f++){
+				if ((mask & (1u << f)) && !skipDeltaField(reader, fields[f], *this)) return false;
+			}
+		}
+	}
+	return reader.done();
+}
+
+bool EntitySystem::apply(const char* delta, size_t size){
+	// Check everything first, so a bad delta doesn't leave the world half changed
+	if (!validDelta(delta, size)) return false;
+
+	DeltaReader reader(delta, size);
+	DeltaHeader header;
+	reader.read(header);
+	const char* destroyed = reader.readBytes(header.numDestroyed * sizeof(ID));
+	const char* created = reader.readBytes(header.numCreated * sizeof(ID));
+
+	// Destroy first as new entities may reuse the same slots
+	std::vector<ID> ids(header.numDestroyed);
+	if (!ids.empty()) std::memcpy(ids.data(), destroyed, ids.size() * sizeof(ID));
+	removeEntities(ids);
+
+	for (uint32_t i = 0; i < header.numCreated; i++){
+		ID id;
+		std::memcpy(&id, created + i * sizeof(ID), sizeof(ID));
+		if (mEntities.has(id)) continue;
+
+		Entity proto(this);
+		proto.clear();
+		mEntities.insert(id, proto);
+		mChanges.created++;
+	}
+
+	for (uint32_t i = 0; i < header.numComponentTypes; i++){
+		DeltaComponents dc;
+		reader.read(dc);
+		applyComponentArrays(reader, dc, 0, ComponentTypeList());
+	}
+	return true;
+}
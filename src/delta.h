@@ -0,0 +1,122 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include "component.h"
+
+// Delta snapshots (see EntitySystem::diff() and apply())
+//
+// Layout:
+//   DeltaHeader
+//   ID destroyed[numDestroyed]
+//   ID created[numCreated]
+//   For each component type with changes:
+//     DeltaComponents
+//     ID removed[numRemoved]  (entity ids)
+//     numChanged records of: ID entity, uint32 field mask, bytes of each field in the mask
+//
+// String fields are sent as uint32 length and text, as the receiver 
+// has its own StringPool. Items fields are sent as uint32 count and
+// the stacks, as the receiver has its own ItemSlab. Shared fields are
+// sent as a uint8 flag and the fields of the value (0 for no value),
+// as the receiver has its own SharedPool.
+//
+// A component that was added is sent as a change with every field set.
+// Entity ids are sent with their generation, so a slot that was 
+// destroyed and reused between two states shows up as a destroy and a create.
+//
+// To stream deltas tick by tick, the sender keeps a baseline world
+// that it applies its own deltas to, and diffs the live world against that.
+
+static const char DELTA_MAGIC[4] = { 'E', 'C', 'S', 'D' };
+
+struct DeltaHeader {
+	char magic[4];
+	uint32_t numDestroyed;
+	uint32_t numCreated;
+	uint32_t numComponentTypes;
+};
+
+struct DeltaComponents {
+	uint32_t type;      // position in ComponentTypeList
+	uint32_t numFields; // to catch mismatched builds
+	uint32_t numRemoved;
+	uint32_t numChanged;
+};
+
+class DeltaWriter {
+public:
+	DeltaWriter(std::vector<char>& out) :mOut(out){}
+
+	size_t write(const void* data, size_t bytes){
+		size_t offset = mOut.size();
+		const char* p = (const char*)data;
+		mOut.insert(mOut.end(), p, p + bytes);
+		return offset;
+	}
+
+	template <typename T>
+	size_t write(const T& t){
+		return write(&t, sizeof(T));
+	}
+
+	template <typename T>
+	void patch(size_t offset, const T& t){
+		std::memcpy(&mOut[offset], &t, sizeof(T));
+	}
+
+	size_t offset() const { return mOut.size(); }
+
+	// Drop everything after offset
+	void truncate(size_t offset){
+		mOut.resize(offset);
+	}
+
+protected:
+	std::vector<char>& mOut;
+};
+
+// Bounds checked reads from a delta
+class DeltaReader {
+public:
+	DeltaReader(const char* data, size_t size) :mData(data), mSize(size), mOffset(0), mOk(true){}
+
+	const char* readBytes(size_t bytes){
+		if (!mOk || bytes > mSize - mOffset){
+			mOk = false;
+			return nullptr;
+		}
+		const char* p = mData + mOffset;
+		mOffset += bytes;
+		return p;
+	}
+
+	template <typename T>
+	bool read(T& t){
+		const char* p = readBytes(sizeof(T));
+		if (p) std::memcpy(&t, p, sizeof(T));
+		return p != nullptr;
+	}
+
+	size_t offset() const { return mOffset; }
+	bool ok() const { return mOk; }
+	bool done() const { return mOffset == mSize; }
+
+protected:
+	const char* mData;
+	size_t mSize;
+	size_t mOffset;
+	bool mOk;
+};
+
+class EntitySystem;
+
+// Compare/write/read the value of one field of a record in a world
+bool sameDeltaField(const Field& field, const char* a, EntitySystem& aWorld, const char* b, EntitySystem& bWorld);
+void writeDeltaField(DeltaWriter& writer, const Field& field, const char* record, EntitySystem& world);
+bool readDeltaField(DeltaReader& reader, const Field& field, char* record, EntitySystem& world);
+
+#endif
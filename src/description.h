@@ -1,35 +1,30 @@
 #ifndef DESCRIPTION_H
 #define DESCRIPTION_H
 
-#include <array>
-#include <algorithm>
-#include <cmath>
-#include <cstdio>
-#include <cstring>
 #include <cstdarg>
 #include <sstream>
 
 #include "component.h"
-#include "fixed_string.h"
+#include "string_pool.h"
 
 struct ShortDescription: public Component<ShortDescription> {
 	static const char* Name(){ return "Short Description"; }
 
-	static const int MAX_SIZE = 32;
-	FixedString<MAX_SIZE> shortDescription;
-	ID id;
-	ID entity;
+	InternedString shortDescription;
 
 	ShortDescription(){}
 	ShortDescription(const char *fmt, ...){
 		va_list args;
 		va_start(args, fmt);
-		char buffer[1024];
-		vsprintf_s(buffer, fmt, args);
-		shortDescription.set(buffer);
+		shortDescription.setv(fmt, args);
 		va_end(args);
 	}
 
+	static const std::vector<Field>& Fields(){
+		static const std::vector<Field> fields = { COM_FIELD(ShortDescription, shortDescription) };
+		return fields;
+	}
+
 	std::string what() {
 		std::ostringstream oss;
 		oss << "shortdescription {";
@@ -42,19 +37,21 @@ struct ShortDescription: public Component<ShortDescription> {
 struct Description: public Component<Description> {
 	static const char* Name(){ return "Description"; }
 
-	static const int MAX_SIZE = 128;
-	FixedString<MAX_SIZE> description;
+	InternedString description;
 
 	Description(){}
 	Description(const char *fmt, ...){		
 		va_list args;
 		va_start(args, fmt);
-		char buffer[1024];
-		vsprintf_s(buffer, fmt, args);
-		description.set(buffer);
+		description.setv(fmt, args);
 		va_end(args);
 	}
 
+	static const std::vector<Field>& Fields(){
+		static const std::vector<Field> fields = { COM_FIELD(Description, description) };
+		return fields;
+	}
+
 	std::string what() {
 		std::ostringstream oss;
 		oss << "description {";
@@ -62,9 +59,6 @@ struct Description: public Component<Description> {
 		oss << "}";
 		return oss.str();
 	}
-	
-	ID id;
-	ID entity;
 };
 
 #endif
\ No newline at end of file
@@ -1,7 +1,14 @@
 #include "entity.h"
+#include "streamer.h"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
-Entity::Entity() :mES(nullptr), id(INVALID_ID){}
+Entity::Entity() :mES(nullptr), id(INVALID_ID){
+	// Snapshots of older schemas start from this, so nothing is left unset
+	clear();
+}
 
 Entity::Entity(EntitySystem* es) : mES(es), id(INVALID_ID) {
 
@@ -11,6 +18,7 @@ void Entity::clear(){
 	id = INVALID_ID;
 	for (int i = 0; i < NUM_COMPONENTS; i++){
 		mHasComponent[i] = false;
+		mComponents[i] = INVALID_ID;
 	}
 }
 
@@ -18,14 +26,30 @@ Entity::operator bool(){
 	return id != INVALID_ID;
 }
 
+template <typename C>
+std::string describeComponent(Entity& e, C*){
+	return e.get<C>().what();
+}
+
+// Show the contents rather than the handle
+std::string describeComponent(Entity& e, Inventory*){
+	return e.inventory().what();
+}
+
+template <typename C>
+std::string describeComponent(Entity& e, Shared<C>*){
+	C value = e.getShared<C>();
+	return "shared " + value.what();
+}
+
 template <typename First>
 void printComponent(std::ostream& out, Entity& e, const TypeList<First>& tl){
-	if (e.has<First>()) out << "- " << e.get<First>().what() << "\n";
+	if (e.has<First>()) out << "- " << describeComponent(e, (First*)nullptr) << "\n";
 }
 
 template <typename First, typename... Rest>
 void printComponent(std::ostream& out, Entity& e, const TypeList<First, Rest...>& tl){
-	if (e.has<First>()) out << "- " << e.get<First>().what() << "\n";
+	if (e.has<First>()) out << "- " << describeComponent(e, (First*)nullptr) << "\n";
 	if (sizeof...(Rest)){
 		printComponent(out, e, TypeList<Rest...>());
 	}
@@ -34,11 +58,61 @@ void printComponent(std::ostream& out, Entity& e, const TypeList<First, Rest...>
 std::ostream& operator<<(std::ostream& out, Entity& e){
 	out << "Entity {id:" << e.id << "}\n";
 	printComponent(out, e, ComponentTypeList());
+	for (int type = NUM_COMPONENTS; type < numComponentTypes(); type++){
+		if (e.hasComponent(type)) out << "- " << componentTypeName(type) << "\n";
+	}
 	return out;
 }
 
 void Entity::removeAllComponents(bool immediately){
 	removeComponents(immediately, ComponentTypeList());
+	for (int type = NUM_COMPONENTS; type < (int)mES->mComponents.size(); type++){
+		removeComponent(type, immediately);
+	}
+}
+
+void* Entity::addComponent(int type, const void* value){
+	assert(type >= NUM_COMPONENTS);
+	RuntimeArray& arr = mES->runtimeArray(type);
+	ID cid = arr.find(id);
+	if (cid != INVALID_ID){
+		arr.assign(cid, value);
+	}
+	else {
+		cid = arr.add(id, value);
+		mES->mChanges.componentsAdded++;
+		mES->mComponentChanges[type].componentsAdded++;
+	}
+	return arr.value(cid);
+}
+
+void Entity::removeComponent(int type, bool immediately){
+	assert(type >= NUM_COMPONENTS);
+	RuntimeArray& arr = mES->runtimeArray(type);
+	ID cid = arr.find(id);
+	if (cid == INVALID_ID) return;
+	if (immediately){
+		mES->destroyRuntimeComponent(type, cid);
+	}
+	else {
+		// Like remove<C>(), it's gone as far as the entity's concerned
+		arr.disown(cid);
+		mES->mComponentsToBeRemoved[type].push_back(cid);
+	}
+}
+
+ScratchAllocator& FrameContext::scratch(unsigned int worker) const {
+	return es.scratch(worker);
+}
+
+void ISystem::update(const FrameContext& ctx){
+	update(ctx.es, ctx.dt);
+}
+
+void ISystem::setupBatch(EntitySystem& es, const ID* entities, unsigned int count){
+	for (unsigned int i = 0; i < count; i++){
+		setup(es.lookup(entities[i]));
+	}
 }
 
 EntitySystem::EntityView::Iterator::Iterator(EntitySystem* es, int i) :es(es), i(i){}
@@ -72,38 +146,199 @@ EntitySystem::EntityView::Iterator EntitySystem::EntityView::end(){
 	return Iterator(es, es->mEntities.size());
 }
 
-EntitySystem::EntitySystem(){
+EntitySystem::EntitySystem(Allocator* allocator) :mAllocator(allocator ? allocator : Allocator::heap()), mEntities(mAllocator), mFrame(0), mProfiler(ECS_PROFILE_EVENTS), mStreamer(nullptr), mJournal(nullptr){
 	// Setup up the invalid entity
 	Entity& invalidEntity = create();
 	
 	// Create arrays for components
 	// Includes an invalid component with id=INVALID_ID
 	mComponents = std::vector<PackedArrayBase*>(NUM_COMPONENTS, nullptr);
+	mSharedPools = std::vector<SharedPoolBase*>(NUM_COMPONENTS, nullptr);
 	setupComponentArrays(ComponentTypeList());
+	mPrevious = std::vector<PackedArrayBase*>(NUM_COMPONENTS, nullptr);
 
 	// component removal cache
 	mComponentsToBeRemoved = std::vector<std::vector<ID>>(NUM_COMPONENTS, std::vector<ID>());
+
+	// The invalid entity doesn't count
+	mChanges = FrameCounts();
+	mComponentChanges = std::vector<FrameCounts>(NUM_COMPONENTS, FrameCounts());
+	mLastComponentChanges = mComponentChanges;
+	setupRuntimeArrays();
+	mIndexes.resize(NUM_COMPONENTS);
+
+	setWorkers(1);
 }
 
 EntitySystem::~EntitySystem(){
-	for (PackedArrayBase* b : mComponents) delete b;
+	for (auto& indexes : mIndexes){
+		for (ComponentIndexBase* index : indexes) index->detach();
+	}
+	for (PackedArrayBase* b : mComponents) destroyArray(b);
+	for (PackedArrayBase* b : mPrevious) destroyArray(b);
+	for (SharedPoolBase* p : mSharedPools) delete p;
+}
+
+size_t EntitySystem::copyFrom(EntitySystem& other){
+	if (&other == this) return 0;
+
+	size_t written = mEntities.copyIndicesFrom(other.mEntities);
+
+	// Entities point back at their world, so compare them without that
+	const size_t entityBytes = fieldOffset<Entity>(&Entity::mES);
+	for (unsigned int i = 0; i < mEntities.size(); i++){
+		Entity& e = mEntities.objects().get(i);
+		Entity& oe = other.mEntities.objects().get(i);
+		if (std::memcmp(&e, &oe, entityBytes) != 0 || e.mES != this){
+			std::memcpy(&e, &oe, sizeof(Entity));
+			e.mES = this;
+			written += sizeof(Entity);
+		}
+	}
+
+	written += copyComponentArrays(other, ComponentTypeList());
+	setupRuntimeArrays();
+	other.setupRuntimeArrays();
+	for (size_t i = NUM_COMPONENTS; i < mComponents.size(); i++){
+		written += static_cast<RuntimeArray*>(mComponents[i])->copyFrom(*static_cast<RuntimeArray*>(other.mComponents[i]));
+	}
+
+	mItems = other.mItems;
+	mTimers = other.mTimers;
+	for (int i = 0; i < NUM_COMPONENTS; i++){
+		if (mSharedPools[i]) mSharedPools[i]->copyFrom(*other.mSharedPools[i]);
+	}
+	mSystems = other.mSystems;
+	mEntitiesToBeRemoved = other.mEntitiesToBeRemoved;
+	mComponentsToBeRemoved = other.mComponentsToBeRemoved;
+	rebuildIndexes();
+	return written;
+}
+
+void EntitySystem::destroyArray(PackedArrayBase* arr){
+	if (!arr) return;
+	size_t bytes = arr->sizeOf();
+	arr->~PackedArrayBase();
+	mAllocator->deallocate(arr, bytes);
+}
+
+void EntitySystem::setupRuntimeArrays(){
+	for (int type = (int)mComponents.size(); type < numComponentTypes(); type++){
+		void* p = mAllocator->allocate(sizeof(RuntimeArray), alignof(RuntimeArray));
+		assert(p != nullptr);
+		RuntimeArray* arr = new(p) RuntimeArray(*runtimeComponentType(type), mAllocator);
+		mComponents.push_back(arr);
+		std::cout << "System: allocating " << (arr->objects().bytes() / 1024) << "kb for " << arr->type().name << " component." << std::endl;
+	}
+	mComponentsToBeRemoved.resize(mComponents.size());
+	mComponentChanges.resize(mComponents.size());
+	mLastComponentChanges.resize(mComponents.size());
+}
+
+void EntitySystem::destroyRuntimeComponent(int type, ID id){
+	RuntimeArray& arr = runtimeArray(type);
+	if (arr.has(id)){
+		arr.remove(id);
+		mChanges.componentsRemoved++;
+		mComponentChanges[type].componentsRemoved++;
+	}
+}
+
+void EntitySystem::adoptComponent(Inventory& inventory){
+	// The contents belong to whoever it was copied from
+	inventory.stacks = ItemStacks();
+}
+
+void EntitySystem::releaseComponent(Inventory& inventory){
+	mItems.release(inventory.stacks);
+}
+
+void EntitySystem::fillPrefabComponents(const Prefab& prefab, Inventory* inventories, unsigned int count){
+	const std::vector<ItemAndCount>& items = prefab.items();
+	for (unsigned int i = 0; i < count; i++){
+		inventories[i].stacks = ItemStacks();
+		if (!items.empty()){
+			mItems.assign(inventories[i].stacks, items.data(), items.data() + items.size());
+		}
+	}
 }
 
 void EntitySystem::addSystem(ISystem* system){
 	mSystems.push_back(system);
 }
 
+void EntitySystem::addIndex(ComponentIndexBase* index){
+	assert(index->component() < NUM_COMPONENTS);
+	mIndexes[index->component()].push_back(index);
+	index->attach(this);
+}
+
+void EntitySystem::removeIndex(ComponentIndexBase* index){
+	std::vector<ComponentIndexBase*>& indexes = mIndexes[index->component()];
+	auto it = std::find(indexes.begin(), indexes.end(), index);
+	if (it == indexes.end()) return;
+	indexes.erase(it);
+	index->detach();
+}
+
+void EntitySystem::touchIndexes(int type, ID entity){
+	for (ComponentIndexBase* index : mIndexes[type]) index->touch(entity);
+}
+
+void EntitySystem::rebuildIndexes(){
+	for (auto& indexes : mIndexes){
+		for (ComponentIndexBase* index : indexes) index->rebuild();
+	}
+}
+
 /// Create a new entity
 Entity& EntitySystem::create(){
 	Entity proto(this);
 	proto.clear();
 	ID id = mEntities.add(proto);
+	if (id != INVALID_ID){
+		mChanges.created++;
+		if (mJournal) mJournal->created(id);
+	}
 	return mEntities.lookup(id);
 }
 
+bool EntitySystem::instantiate(const Prefab& prefab, unsigned int count, std::vector<ID>& ids){
+	if (count == 0) return true;
+	if (mEntities.size() + count > MAX_ENTITIES || !roomForComponentArrays(prefab, count, ComponentTypeList())){
+		std::cerr << "EntitySystem: no room for " << count << " more " << prefab.name() << std::endl;
+		return false;
+	}
+
+	Entity proto(this);
+	proto.clear();
+	unsigned int first = mEntities.add(proto, count);
+	instantiateComponentArrays(prefab, first, count, ComponentTypeList());
+	mChanges.created += count;
+
+	size_t firstId = ids.size();
+	for (unsigned int i = 0; i < count; i++){
+		ids.push_back(mEntities.objects().get(first + i).id);
+	}
+	if (mJournal) mJournal->instantiated(*this, prefab, &ids[firstId], count);
+
+	for (ISystem* sys : mSystems){
+		for (int c = 0; c < NUM_COMPONENTS; c++){
+			if (prefab.has(c) && sys->implements(c)){
+				sys->setupBatch(*this, &ids[firstId], count);
+				break;
+			}
+		}
+	}
+	return true;
+}
+
 // Remove an entity
 // Won't be removed until sync()ed
 void EntitySystem::remove(ID id){
+	// Not the invalid entity, which sync() would otherwise remove
+	if (id == INVALID_ID) return;
+	if (mJournal && has(id)) mJournal->removed(id);
 	mEntitiesToBeRemoved.push_back(id);
 }
 
@@ -142,22 +377,263 @@ template <typename First, typename... Rest> void RemoveEntityFromSystem(Entity&
 	}
 }
 
+void EntitySystem::update(double dt){
+	FrameContext ctx = { *this, dt, mFrame, 0, 1 };
+	for (ISystem* sys : mSystems){
+		update(sys, ctx);
+	}
+}
+
+void EntitySystem::update(ISystem* system, const FrameContext& ctx){
+	ECS_PROFILE_SCOPE(mProfiler, system->name(), "system", countComponentsFor(system) / ctx.batches);
+	system->update(ctx);
+}
+
+void EntitySystem::setWorkers(unsigned int count){
+	if (count == 0) count = 1;
+	while (mScratch.size() < count){
+		mScratch.emplace_back(new ScratchAllocator(1 << 20, mAllocator));
+	}
+	mScratch.resize(count);
+}
+
+unsigned int EntitySystem::countComponentsFor(ISystem* sys){
+	unsigned int count = countComponentsFor(sys, ComponentTypeList());
+	for (int type = NUM_COMPONENTS; type < (int)mComponents.size(); type++){
+		if (sys->implements(type)) count += mComponents[type]->numObjects() - 1;
+	}
+	return count;
+}
+
+unsigned int EntitySystem::countQueuedComponents(){
+	unsigned int count = 0;
+	for (auto& v : mComponentsToBeRemoved) count += v.size();
+	return count;
+}
+
 void EntitySystem::sync(){	
-	for (ID id : mEntitiesToBeRemoved){
-		if (mEntities.has(id)){
+	// What happens below follows from the ops already recorded,
+	// apart from streaming, which is left out like load()
+	Journal* journal = mJournal;
+	if (journal) journal->synced();
+	mJournal = nullptr;
+
+	if (mStreamer){
+		// Partitions going out are removed along with everything else
+		ECS_PROFILE_SCOPE(mProfiler, "stream out", "sync", mStreamer->unloading());
+		mStreamer->evict(mEntitiesToBeRemoved);
+	}
+
+	{
+		ECS_PROFILE_SCOPE(mProfiler, "remove entities", "sync", mEntitiesToBeRemoved.size());
+		removeEntities(mEntitiesToBeRemoved);
+		mEntitiesToBeRemoved.clear();
+	}
+
+	{
+		ECS_PROFILE_SCOPE(mProfiler, "remove components", "sync", countQueuedComponents());
+		removeQueuedComponents(ComponentTypeList());
+		for (int type = NUM_COMPONENTS; type < (int)mComponents.size(); type++){
+			for (ID id : mComponentsToBeRemoved[type]) destroyRuntimeComponent(type, id);
+		}
+		for (auto& v : mComponentsToBeRemoved) v.clear();
+	}
+
+	if (mStreamer){
+		ECS_PROFILE_SCOPE(mProfiler, "stream in", "sync", mStreamer->loading());
+		mStreamer->integrate();
+	}
+	mJournal = journal;
+
+	{
+		ECS_PROFILE_SCOPE(mProfiler, "copy previous", "sync", mEntities.size() - 1);
+		copyPreviousArrays(ComponentTypeList());
+	}
+
+	mFrame++;
+	if (!mPublishers.empty()){
+		ECS_PROFILE_SCOPE(mProfiler, "publish", "sync", mEntities.size() - 1);
+		publishFrame();
+	}
+
+	for (auto& s : mScratch) s->reset();
+
+	{
+		ECS_PROFILE_SCOPE(mProfiler, "timers", "sync", mTimers.pending());
+		mTimers.advance();
+	}
+
+	ECS_PROFILE_END_FRAME(mProfiler, mChanges);
+	mLastChanges = mChanges;
+	mChanges = FrameCounts();
+	mLastComponentChanges.swap(mComponentChanges);
+	for (FrameCounts& c : mComponentChanges) c = FrameCounts();
+}
+
+void EntitySystem::removeEntities(const std::vector<ID>& ids){
+	for (ID id : ids){
+		if (has(id)){
 			Entity& e = mEntities.lookup(id);
 			for (ISystem* sys : mSystems){
 				RemoveEntityFromSystem(e, sys, ComponentTypeList());
+				for (int type = NUM_COMPONENTS; type < (int)mComponents.size(); type++){
+					if (sys->implements(type) && e.hasComponent(type)) sys->cleanup(e);
+				}
 			}
 			e.removeAllComponents(true);
 			e.clear();
 			mEntities.remove(id);
+			mTimers.cancelAll(id);
+			mChanges.destroyed++;
 		}
 	}
-	mEntitiesToBeRemoved.clear();
-	
-	removeQueuedComponents(ComponentTypeList());
-	for (auto v : mComponentsToBeRemoved) v.clear();
+}
+
+void EntitySystem::publishFrame(){
+	std::shared_ptr<const PublishedFrame> previous = std::atomic_load(&mPublished);
+	std::shared_ptr<PublishedFrame> frame(new PublishedFrame(mFrame, NUM_COMPONENTS));
+	for (auto& p : mPublishers){
+		frame->mArrays[p.first] = (this->*p.second)(previous.get());
+	}
+	std::atomic_store(&mPublished, std::shared_ptr<const PublishedFrame>(frame));
+}
+
+std::shared_ptr<const PublishedFrame> EntitySystem::published(){
+	return std::atomic_load(&mPublished);
+}
+
+size_t EntitySystem::compact(size_t budget, bool renumberFreelists){
+	size_t released = mEntities.releaseUnusedPages(budget);
+	for (std::vector<PackedArrayBase*>* arrays : { &mComponents, &mPrevious }){
+		for (PackedArrayBase* arr : *arrays){
+			if (arr && released < budget) released += arr->releaseUnusedPages(budget - released);
+		}
+	}
+
+	if (renumberFreelists){
+		mEntities.renumberFreelist();
+		for (PackedArrayBase* arr : mComponents){
+			if (arr) arr->renumberFreelist();
+		}
+	}
+	return released;
+}
+
+// Marks the String fields of count records
+static void markStrings(StringPool& pool, const char* records, unsigned int count, unsigned int stride, const std::vector<Field>& fields){
+	for (const Field& f : fields){
+		if (f.type != FieldType::String) continue;
+		for (unsigned int i = 0; i < count; i++){
+			unsigned int handle;
+			std::memcpy(&handle, records + (size_t)i * stride + f.offset, sizeof(handle));
+			pool.mark(handle);
+		}
+	}
+}
+
+void EntitySystem::markStrings(){
+	StringPool& pool = StringPool::instance();
+	for (std::vector<PackedArrayBase*>* arrays : { &mComponents, &mPrevious }){
+		for (size_t type = 0; type < arrays->size(); type++){
+			PackedArrayBase* arr = (*arrays)[type];
+			if (!arr) continue;
+			unsigned int offset = type < NUM_COMPONENTS ? 0 : static_cast<RuntimeArray*>(arr)->valueOffset();
+			::markStrings(pool, arr->data() + offset, arr->numObjects(), arr->stride(), componentFields((int)type));
+		}
+	}
+	for (SharedPoolBase* p : mSharedPools){
+		if (!p) continue;
+		for (unsigned int h = 0; h < p->capacity(); h++){
+			::markStrings(pool, p->value(h), 1, p->valueSize(), p->allFields());
+		}
+	}
+}
+
+unsigned int EntitySystem::collectStrings(){
+	StringPool& pool = StringPool::instance();
+	pool.beginCollect();
+	markStrings();
+	return pool.endCollect();
+}
+
+void EntitySystem::queueSort(int index, std::function<void(SortKeys&)> keys){
+	// A new sort of the same array replaces the old one
+	for (auto it = mSorts.begin(); it != mSorts.end(); ++it){
+		if (it->index == index){
+			mSorts.erase(it);
+			break;
+		}
+	}
+	SortJob job = { index, keys, std::vector<ID>(), 0, 1, false };
+	mSorts.push_back(job);
+}
+
+bool EntitySystem::defragment(double budgetMs){
+	using Clock = std::chrono::high_resolution_clock;
+	Clock::time_point start = Clock::now();
+	auto outOfTime = [&](){ return std::chrono::duration<double, std::milli>(Clock::now() - start).count() > budgetMs; };
+
+	while (!mSorts.empty()){
+		SortJob& job = mSorts.front();
+		PackedArrayBase* arr = mComponents[job.index];
+		if (!job.planned){
+			SortKeys keys;
+			keys.reserve(arr->numObjects());
+			job.keys(keys);
+			std::stable_sort(keys.begin(), keys.end(), [](const std::pair<uint64_t, ID>& a, const std::pair<uint64_t, ID>& b){
+				return a.first < b.first;
+			});
+			job.order.reserve(keys.size());
+			for (auto& k : keys) job.order.push_back(k.second);
+			job.planned = true;
+		}
+
+		// Swap each component into the next slot, skipping any
+		// removed (or moved behind the sorted part) since planning
+		unsigned int steps = 0;
+		while (job.next < job.order.size() && job.position < arr->numObjects()){
+			unsigned int p = arr->position(job.order[job.next++]);
+			if (p == UINT_MAX || p < job.position) continue;
+			arr->swapObjects(job.position++, p);
+			if ((++steps & 255) == 0 && outOfTime()) return false;
+		}
+		mSorts.erase(mSorts.begin());
+		if (outOfTime()) break;
+	}
+	return mSorts.empty();
+}
+
+void EntitySystem::stats(WorldStats& stats){
+	stats.frame = mFrame;
+	fillArrayStats(mEntities, "Entity", stats.entities);
+	stats.entities.added = mLastChanges.created;
+	stats.entities.removed = mLastChanges.destroyed;
+	stats.components.resize(mComponents.size());
+	fillComponentStats(stats, ComponentTypeList());
+	for (int type = NUM_COMPONENTS; type < (int)mComponents.size(); type++){
+		static const size_t PAGE_SIZE = 4096;
+		RuntimeArray& arr = runtimeArray(type);
+		ArrayStats& s = stats.components[type];
+		s.name = arr.type().name;
+		s.live = arr.size() - 1;
+		s.capacity = arr.objects().capacity() / arr.stride();
+		s.highWater = arr.highWater();
+		s.freelist = arr.freeSlots();
+		s.objectSize = arr.stride();
+		s.committedBytes = arr.objects().bytes();
+		s.touchedBytes = ((size_t)arr.highWater() * arr.stride() + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+		if (s.touchedBytes > s.committedBytes) s.touchedBytes = s.committedBytes;
+		s.indexBytes = arr.indexBytes();
+		s.added = mLastComponentChanges[type].componentsAdded;
+		s.removed = mLastComponentChanges[type].componentsRemoved;
+	}
+	stats.itemBytes = mItems.stacks().capacity() * sizeof(ItemAndCount);
+	stats.scratchBytes = 0;
+	stats.scratchHighWater = 0;
+	for (auto& s : mScratch){
+		stats.scratchBytes += s->reserved();
+		stats.scratchHighWater += s->highWater();
+	}
 }
 
 void EntitySystem::printDebugInfo(std::ostream& out){
@@ -165,5 +641,9 @@ void EntitySystem::printDebugInfo(std::ostream& out){
 	out << "------------------------\n";
 	out << mEntities.size() << " entities (" << (mEntities.objects().bytes() / 1024) << "kb) " << std::endl;
 	printDebugInfoForComponents(out, ComponentTypeList());
+	for (size_t i = NUM_COMPONENTS; i < mComponents.size(); i++){
+		RuntimeArray& arr = *static_cast<RuntimeArray*>(mComponents[i]);
+		out << arr.size() << " " << arr.type().name << "s (" << (arr.objects().bytes() / 1024) << "kb)" << std::endl;
+	}
 	out << "------------------------\n";
 }
\ No newline at end of file
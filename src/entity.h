@@ -2,26 +2,56 @@
 #define ENTITY_H
 
 #include <iomanip>
+#include <iostream>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
 
 #include "all_components.h"
 #include "packedarray.h"
 #include "isystem.h"
+#include "snapshot.h"
+#include "delta.h"
+#include "read_snapshot.h"
+#include "mapped_file.h"
+#include "prefab.h"
+#include "profiler.h"
+#include "stats.h"
+#include "timer_wheel.h"
+#include "runtime_component.h"
+#include "query.h"
+#include "columns.h"
+#include "partition.h"
+#include "journal.h"
 
 static const int MAX_ENTITIES = 0xffff;
 
 class EntitySystem;
+class WorldStreamer;
 class Entity {
 public:
 	ID id;
 	Entity(); 
 
 	// Add a component to the entity
-	template <typename C>	C& add(C& c = C());
+	template <typename C>	C& add(const C& c = C());
 
 	// Get a component 
 	// PRE: entity has() the component
 	template <typename C> C& get();
 
+	// Get a component to change, so secondary indexes on C see it
+	// (see index.h). get<C>() is fine for types without indexes
+	// PRE: entity has() the component
+	template <typename C> C& modify();
+
+	// Get a component as it was at the last sync()
+	// PRE: C is double buffered (see EntitySystem::doubleBuffer())
+	// and entity has() the component
+	// NB: A component added since the last sync() returns its current value
+	template <typename C> const C& previous();
+
 	// Check if entity has a component
 	template <typename C>	bool has();
 
@@ -38,6 +68,42 @@ public:
 	Transform& transform(){	return get<Transform>(); }
 	Health& health(){ return get<Health>(); }
 	Physics& physics(){ return get<Physics>(); }
+	InventoryRef inventory();
+
+	// Shared components (see shared.h)
+	// Add a Shared<C> pointing at a deduplicated copy of c
+	template <typename C> const C& addShared(const C& c);
+
+	// Value of the Shared<C> component
+	// NB: Don't retain the ref, it may move when shared values are added
+	template <typename C> const C& getShared();
+
+	// Value of the Shared<C> component to write to
+	// It's copied first if other entities use it
+	template <typename C> C& modifyShared();
+
+	template <typename C> bool hasShared(){ return has<Shared<C>>(); }
+
+	// Components by index, for runtime types (see runtime_component.h)
+	// and code that doesn't know the C++ types
+	bool hasComponent(int type);
+
+	// nullptr if the entity doesn't have it
+	// Runtime types point at the value, compile-time ones at the component
+	void* getComponent(int type);
+
+	// Add a copy of value, or the type's default if nullptr
+	// Replaces the value if the entity already has one
+	// PRE: type is a runtime type
+	void* addComponent(int type, const void* value = nullptr);
+
+	// PRE: type is a runtime type
+	void removeComponent(int type, bool immediately = false);
+
+	// Layout of an entity record for snapshots
+	// Component ids and flags are named after their component
+	// so they can be remapped when component types change
+	static const std::vector<Field>& Fields();
 	
 protected:
 
@@ -50,13 +116,32 @@ protected:
 
 	ID mComponents[NUM_COMPONENTS];
 	bool mHasComponent[NUM_COMPONENTS];
-	EntitySystem* mES;
+	EntitySystem* mES; // NB: Keep last, see EntitySystem::copyFrom()
 
 	friend class EntitySystem;
 };
 
 std::ostream& operator<<(std::ostream& out, Entity& e);
 
+// A secondary index over one component type (see index.h)
+class ComponentIndexBase {
+public:
+	virtual ~ComponentIndexBase(){}
+
+	// Index() of the component type
+	virtual int component() const = 0;
+
+	// Called by EntitySystem::addIndex() and removeIndex()
+	virtual void attach(EntitySystem* es) = 0;
+	virtual void detach() = 0;
+
+	// The entity's component was added, changed or removed
+	virtual void touch(ID entity) = 0;
+
+	// Start again from the world's components, e.g., after a load()
+	virtual void rebuild() = 0;
+};
+
 class EntitySystem {
 protected:
 	// Helpers
@@ -118,9 +203,21 @@ protected:
 	};
 
 public:
-	EntitySystem();
+	// Arrays are allocated from allocator, e.g., an ArenaAllocator
+	// per world, or the heap if nullptr (see allocator.h)
+	// NB: The allocator must outlive the world
+	explicit EntitySystem(Allocator* allocator = nullptr);
 	~EntitySystem();
 
+	// Make this world a copy of another, e.g., to roll back to
+	// a saved frame or to run a what-if simulation
+	// Only live objects are copied, and pages which are already
+	// the same are skipped, so restoring a recent copy costs
+	// roughly what changed since it was taken
+	// NB: Systems are shared with the other world
+	// Returns the number of bytes written
+	size_t copyFrom(EntitySystem& other);
+
 	// Add systems
 	// EntitySystem doesn't own it
 	void addSystem(ISystem* system);
@@ -128,6 +225,12 @@ public:
 	// Create a new entity immediately
 	Entity& create();
 
+	// Create count entities from a prefab in one go, and append their ids
+	// Each component array gets one contiguous block, and each system
+	// that implements one of the components gets a single setupBatch()
+	// Returns false if there isn't room for them all
+	bool instantiate(const Prefab& prefab, unsigned int count, std::vector<ID>& ids);
+
 	// Remove an entity and its components
 	// NB: Won't be removed until sync()ed
 	void remove(ID id);
@@ -139,6 +242,21 @@ public:
 	// NB: Don't retain the ref, it may change after a sync()
 	Entity& lookup(ID id);
 
+	// Storage for the contents of Inventory components
+	ItemSlab& items(){ return mItems; }
+
+	// Storage of a runtime component type (see runtime_component.h)
+	// PRE: type was returned by registerComponentType()
+	RuntimeArray& runtimeArray(int type);
+
+	// Values of Shared<C> components, e.g., to visit each distinct value once
+	// PRE: Shared<C> is in the ComponentTypeList
+	template <typename C>
+	SharedPool<C>& sharedPool();
+
+	// Pool for the Shared component with this Index(), or nullptr
+	SharedPoolBase* sharedPool(int index){ return mSharedPools[index]; }
+
 	// Get full list of entities
 	EntityView entities();
 	
@@ -146,29 +264,293 @@ public:
 	template <typename C>
 	ComponentView<C> components();
 
+	// Entities matching a query, and where their components are
+	// The smallest include array is walked and the other types looked
+	// up, or every entity if there are none. Reuses the storage in result
+	// Returns false if the query has unknown types
+	bool query(const Query& query, QueryResult& result);
+
+	// Keep a secondary index up to date (see index.h)
+	// EntitySystem doesn't own it
+	void addIndex(ComponentIndexBase* index);
+	void removeIndex(ComponentIndexBase* index);
+
+	// Update each system in the order they were added
+	void update(double dt);
+
+	// Update one system (see Runner)
+	void update(ISystem* system, const FrameContext& ctx);
+
+	const std::vector<ISystem*>& systems(){ return mSystems; }
+
+	// Number of sync()s so far
+	unsigned int frame() const { return mFrame; }
+
+	// Per entity timers, a tick is one sync()
+	//   es.timers().add(e.id, POISON_TICK, 30);
+	// sync() cancels the timers of removed entities, then advances the
+	// wheel one tick, and systems read what went off from fired()
+	// copyFrom() copies them, load() cancels them all
+	TimerWheel& timers(){ return mTimers; }
+
+	// Per frame scratch memory for each worker thread, reset by sync()
+	// PRE: worker < workers()
+	ScratchAllocator& scratch(unsigned int worker = 0){ return *mScratch[worker]; }
+	unsigned int workers() const { return (unsigned int)mScratch.size(); }
+	void setWorkers(unsigned int count);
+
 	// TODO: Call sync() at the end of each frame
 	// to remove queued entities, components etc
 	void sync();
+
+	// Double buffer the C array: sync() keeps a copy of it so 
+	// systems can read the previous frame with Entity::previous<C>()
+	// while one system writes the next, without locks
+	template <typename C>
+	void doubleBuffer();
+
+	// Publish an immutable copy of the C array at every sync()
+	// so other threads (rendering, telemetry) can read it
+	// while this one writes the next frame
+	template <typename C>
+	void publish();
+
+	// The arrays published by the last sync(), safe to call from any thread
+	// Hold onto the pointer for as long as you're reading
+	std::shared_ptr<const PublishedFrame> published();
 	
 	// Info
 	void printDebugInfo(std::ostream& out);
 
+	// Give memory back after lots of removals, e.g., after a despawn wave
+	// Releases the pages above the live objects of each array, at most
+	// budget bytes per call so it can be spread over frames, and
+	// optionally relinks the freelists so new objects reuse low slots
+	// Ids stay valid. Returns the bytes released, 0 once there's no more
+	// NB: Call after sync()
+	size_t compact(size_t budget = SIZE_MAX, bool renumberFreelists = false);
+
+	// Mark the strings held by the components and shared values
+	// of this world, see StringPool::beginCollect()
+	// NB: Frames published before the last sync() and entities still
+	// in a MigrationQueue aren't marked, so their strings may read as ""
+	void markStrings();
+
+	// Free the strings nothing in this world refers to
+	// Only for a process with one world, otherwise mark them all
+	// Returns the number of strings freed
+	// NB: Call after sync()
+	unsigned int collectStrings();
+
+	// Sort the C array for locality, a bit at a time (see defragment())
+	// Swap removes gradually scramble the order of each array, which
+	// turns joins like lookup(p.entity).get<Transform>() into random access
+	// Ids don't change, only where the components are stored
+
+	// Order by the owning entities' order in entities()
+	template <typename C> void sortByEntity();
+
+	// Order like the owners' Other components, those without one go last
+	template <typename C, typename Other> void sortLike();
+
+	// Order by a key, e.g., [](const Transform& tr){ return mortonKey(tr, 8.f); }
+	template <typename C> void sortBy(std::function<uint64_t(const C&)> key);
+
+	// Carry on the queued sorts for up to budgetMs
+	// The order is worked out in one go at the start of each sort,
+	// then components are swapped into place until the time runs out
+	// Changes in between frames only leave the result less sorted
+	// Returns true once there are no sorts left
+	bool defragment(double budgetMs = 1e9);
+
+	// Memory and occupancy of each array
+	// Reuses the storage in stats, so it's cheap enough to call every frame
+	void stats(WorldStats& stats);
+
+	// Entities created and destroyed, and components added and
+	// removed, in the frame ended by the last sync()
+	const FrameCounts& frameChanges(){ return mLastChanges; }
+
+	// Timings of update() and sync(), see profiler.h
+	// NB: Only recorded if built with ECS_PROFILE
+	Profiler& profiler(){ return mProfiler; }
+
+	// Write the whole world (entities, index tables 
+	// and component arrays) to a binary snapshot file
+	// NB: Pending removals are not saved, sync() first
+	bool save(const char* path);
+
+	// Replace the world with a snapshot written by save()
+	// The file is memory mapped and each array is restored 
+	// with a block copy rather than replaying create()/add()
+	// NB: Systems are not notified about the loaded entities
+	// Timers aren't saved, so all of them are cancelled
+	bool load(const char* path);
+
+	// Append a delta that turns base into this world:
+	// destroyed and created entity ids, removed components
+	// and the fields of components that changed
+	// NB: sync() both worlds first
+	void diff(EntitySystem& base, std::vector<char>& delta);
+
+	// Apply a delta written by diff()
+	// Entities are created with the same ids as in the source world
+	// and destroyed ones are removed straight away, without a sync()
+	// Returns false, changing nothing, if the delta is malformed
+	// NB: Timers aren't sent. Destroyed entities' timers are cancelled
+	// and the rest are left alone
+	bool apply(const char* delta, size_t size);
+
+	// Write the components of type C as one column per field (see columns.h)
+	// for tools that want whole arrays rather than what() strings
+	// NB: Pending removals are written too, sync() first
+	template <typename C>
+	bool exportColumns(const char* path);
+
+	// Add components of type C from a columns file, e.g., generated data
+	// A row goes on the entity in its entity column if that's alive here,
+	// replacing its component, otherwise on a new entity. New entities and
+	// their components are added in blocks, like instantiate()
+	// Fields without a column keep their default (or current) value
+	// Appends the entity each row went on to entities
+	template <typename C>
+	bool importColumns(const char* path, std::vector<ID>& entities);
+
+	// Append entities and their components in a form any world can
+	// load (see partition.h), e.g., to stream a region of the world out
+	void savePartition(const std::vector<ID>& entities, std::vector<char>& out);
+
+	// Add the next count entities of a partition and append their ids
+	// They're created in one block, and each component array gets one
+	// block, like instantiate()
+	// Returns false if there isn't room or the data isn't valid(), without
+	// adding anything, or if records are malformed (the rest still go in)
+	bool integratePartition(PartitionData& data, unsigned int count, std::vector<ID>& ids);
+
+	// Move entities and their components to another world now, e.g.,
+	// between zones stepped on the same thread (see MigrationQueue for
+	// worlds on their own threads). They're added to to in one block like
+	// instantiate(), so its systems get setupBatch(), and removed from this
+	// world straight away, so its systems get cleanup()
+	// Component records are copied array to array, with Inventory stacks
+	// and Shared values copied into to's slab and pools
+	// Timers go with them, and runtime components are copied
+	// Appends the new id of each entity, or INVALID_ID if it was dead,
+	// already being removed or given before
+	// Returns false, moving nothing, if there isn't room in to
+	// PRE: Neither world is being updated
+	bool migrate(const std::vector<ID>& entities, EntitySystem& to, std::vector<ID>& ids);
+
+	// The entity's new id, or INVALID_ID
+	ID migrate(ID entity, EntitySystem& to);
+
+	// The entities which are alive and not already queued for removal,
+	// in order without repeats, e.g., the ones that can be moved
+	void liveEntities(const std::vector<ID>& entities, std::vector<ID>& live);
+
+	// Stream partitions in and out at each sync() (see streamer.h)
+	// EntitySystem doesn't own it, nullptr to stop
+	void setStreamer(WorldStreamer* streamer){ mStreamer = streamer; }
+
+	// Record create(), instantiate(), add(), remove() and sync()
+	// to a journal (see journal.h)
+	// EntitySystem doesn't own it, nullptr to stop
+	void setJournal(Journal* journal){ mJournal = journal; }
+
+	// Carry on replaying a journal, up to and including its next frames sync()s
+	// Systems see the entities like they were made by hand
+	// Returns false if the journal is malformed or an op fails
+	bool replay(JournalReplay& journal, unsigned int frames = 1);
+
 protected:
 	/// Internal helpers
 	template <typename C>
-	C& addComponent(ID entityId, C& pc);
+	C& addComponent(ID entityId, const C& pc);
 		
 	template <typename C>
 	C& getComponent(ID id);
 
+	template <typename C>
+	const C& getPreviousComponent(ID id);
+
 	template <typename C>
 	void removeComponent(ID id);
+
+	// Remove a component straight away
+	template <typename C>
+	void destroyComponent(ID id);
+
+	// Hooks for components with data outside their array
+	// adopt: the component was just copied in
+	// release: the component is about to be removed or overwritten
+	template <typename C> void adoptComponent(C& c){}
+	template <typename C> void releaseComponent(C& c){}
+	void adoptComponent(Inventory& inventory);
+	void releaseComponent(Inventory& inventory);
+	template <typename C> void adoptComponent(Shared<C>& shared);
+	template <typename C> void releaseComponent(Shared<C>& shared);
+
+	template <typename C> void setupSharedPool(C*){}
+	template <typename C> void setupSharedPool(Shared<C>*);
 	
+	template <typename C>
+	bool roomForComponents(const Prefab& prefab, unsigned int count);
+	template <typename First>
+	bool roomForComponentArrays(const Prefab& prefab, unsigned int count, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	bool roomForComponentArrays(const Prefab& prefab, unsigned int count, const TypeList<First, Rest...>& tl);
+
+	template <typename C>
+	void instantiateComponents(const Prefab& prefab, unsigned int firstEntity, unsigned int count);
+	template <typename First>
+	void instantiateComponentArrays(const Prefab& prefab, unsigned int firstEntity, unsigned int count, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	void instantiateComponentArrays(const Prefab& prefab, unsigned int firstEntity, unsigned int count, const TypeList<First, Rest...>& tl);
+
+	// Give a batch of components from a prefab their own copies of
+	// anything kept outside the array
+	template <typename C> void fillPrefabComponents(const Prefab& prefab, C* components, unsigned int count){}
+	void fillPrefabComponents(const Prefab& prefab, Inventory* inventories, unsigned int count);
+	template <typename C> void fillPrefabComponents(const Prefab& prefab, Shared<C>* shared, unsigned int count);
+
+	// Number of live components a system might look at
+	template <typename First>
+	unsigned int countComponentsFor(ISystem* sys, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	unsigned int countComponentsFor(ISystem* sys, const TypeList<First, Rest...>& tl);
+	unsigned int countComponentsFor(ISystem* sys);
+
+	// Where an entity's component is in its array, or UINT_MAX
+	bool hasComponent(Entity& e, int type);
+	unsigned int componentPosition(Entity& e, int type);
+	QueryColumn queryColumn(int type);
+	unsigned int countQueuedComponents();
+	// Take entities out of their systems and destroy them, as sync() does
+	void removeEntities(const std::vector<ID>& ids);
+
+	template <typename T>
+	void fillArrayStats(PackedArray<T>& arr, const char* name, ArrayStats& s);
+	template <typename First>
+	void fillComponentStats(WorldStats& stats, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	void fillComponentStats(WorldStats& stats, const TypeList<First, Rest...>& tl);
+
 	template <typename First>
 	void removeQueuedComponents(const TypeList<First>& tl);
 	template <typename First, typename... Rest>
 	void removeQueuedComponents(const TypeList<First, Rest...>& tl);
 
+	// Tell the indexes on a component type that an entity's changed
+	void indexChanged(int type, ID entity){
+		if (!mIndexes[type].empty()) touchIndexes(type, entity);
+	}
+	void touchIndexes(int type, ID entity);
+	void rebuildIndexes();
+
+	// Create arrays for runtime types registered since the last call
+	void setupRuntimeArrays();
+	void destroyRuntimeComponent(int type, ID id);
+
 	template <typename C>
 	void setupComponentArray();
 	template <typename First>
@@ -181,17 +563,158 @@ protected:
 	template <typename First, typename... Rest>
 	void printDebugInfoForComponents(std::ostream& out, const TypeList<First, Rest...>& tl);
 
+	template <typename C>
+	size_t copyPreviousArray();
+	template <typename First>
+	size_t copyPreviousArrays(const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	size_t copyPreviousArrays(const TypeList<First, Rest...>& tl);
+
+	template <typename C>
+	size_t copyComponentArray(EntitySystem& other);
+	template <typename First>
+	size_t copyComponentArrays(EntitySystem& other, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	size_t copyComponentArrays(EntitySystem& other, const TypeList<First, Rest...>& tl);
+
+	template <typename C>
+	std::shared_ptr<const void> publishArray(const PublishedFrame* previous);
+	void publishFrame();
+
+	template <typename First>
+	void saveComponentArrays(SnapshotWriter& writer, SnapshotStringTable& strings, uint64_t arrayOffset, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	void saveComponentArrays(SnapshotWriter& writer, SnapshotStringTable& strings, uint64_t arrayOffset, const TypeList<First, Rest...>& tl);
+
+	template <typename First>
+	void loadComponentArrays(const MappedFile& file, SnapshotStrings& strings, SnapshotShared& shared, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	void loadComponentArrays(const MappedFile& file, SnapshotStrings& strings, SnapshotShared& shared, const TypeList<First, Rest...>& tl);
+
+	template <typename C>
+	void loadComponentArray(const MappedFile& file, SnapshotStrings& strings, SnapshotShared& shared);
+
+	template <typename T>
+	void saveArray(SnapshotWriter& writer, SnapshotStringTable& strings, uint64_t arrayOffset, PackedArray<T>& arr, const char* name, int version, const std::vector<Field>& fields);
+	template <typename T>
+	void loadArray(const MappedFile& file, SnapshotStrings& strings, SnapshotShared& shared, const SnapshotArray& sa, PackedArray<T>& arr, const std::vector<Field>& fields);
+
+	template <typename C>
+	void diffComponents(EntitySystem& base, DeltaWriter& writer, uint32_t type, uint32_t& numTypes);
+	template <typename First>
+	void diffComponentArrays(EntitySystem& base, DeltaWriter& writer, uint32_t type, uint32_t& numTypes, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	void diffComponentArrays(EntitySystem& base, DeltaWriter& writer, uint32_t type, uint32_t& numTypes, const TypeList<First, Rest...>& tl);
+
+	// Read through a delta without changing anything, false if apply() would fail
+	bool validDelta(const char* delta, size_t size);
+	template <typename C>
+	bool applyComponents(DeltaReader& reader, const DeltaComponents& dc);
+	template <typename First>
+	bool applyComponentArrays(DeltaReader& reader, const DeltaComponents& dc, uint32_t type, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	bool applyComponentArrays(DeltaReader& reader, const DeltaComponents& dc, uint32_t type, const TypeList<First, Rest...>& tl);
+
+	const SnapshotArray* findSnapshotArray(const MappedFile& file, const char* name);
+
+	template <typename C>
+	void savePartitionComponents(DeltaWriter& writer, const std::vector<ID>& entities, uint32_t type, uint32_t& numTypes);
+	template <typename First>
+	void savePartitionArrays(DeltaWriter& writer, const std::vector<ID>& entities, uint32_t type, uint32_t& numTypes, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	void savePartitionArrays(DeltaWriter& writer, const std::vector<ID>& entities, uint32_t type, uint32_t& numTypes, const TypeList<First, Rest...>& tl);
+
+	template <typename C>
+	bool integratePartitionComponents(PartitionData& data, PartitionData::Components& pc, Entity* entities, unsigned int first, unsigned int end);
+	template <typename First>
+	bool integratePartitionArrays(PartitionData& data, PartitionData::Components& pc, Entity* entities, unsigned int first, unsigned int end, uint32_t type, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	bool integratePartitionArrays(PartitionData& data, PartitionData::Components& pc, Entity* entities, unsigned int first, unsigned int end, uint32_t type, const TypeList<First, Rest...>& tl);
+
+	// migrate() copies the records of each array straight to to, in
+	// one block linked up with to's block of entities at firstEntity
+	// PRE: count is how many of the entities have a C
+	template <typename C>
+	void migrateComponents(EntitySystem& to, const std::vector<ID>& entities, unsigned int firstEntity, unsigned int count);
+	template <typename First>
+	void migrateComponentArrays(EntitySystem& to, const std::vector<ID>& entities, unsigned int firstEntity, const std::vector<unsigned int>& counts, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	void migrateComponentArrays(EntitySystem& to, const std::vector<ID>& entities, unsigned int firstEntity, const std::vector<unsigned int>& counts, const TypeList<First, Rest...>& tl);
+
+	// Give a record copied from another world its own copies of the
+	// Items and Shared values it refers to (strings are process wide)
+	void adoptFields(EntitySystem& from, char* record, const std::vector<Field>& fields);
+
+	// Replay an op on one of the entity's components
+	// An Instantiate op adds the component to prefab instead
+	template <typename C>
+	bool replayComponent(DeltaReader& reader, JournalOp op, Entity& e, Prefab* prefab);
+	template <typename First>
+	bool replayComponentArrays(DeltaReader& reader, JournalOp op, Entity& e, Prefab* prefab, int component, int type, const TypeList<First>& tl);
+	template <typename First, typename... Rest>
+	bool replayComponentArrays(DeltaReader& reader, JournalOp op, Entity& e, Prefab* prefab, int component, int type, const TypeList<First, Rest...>& tl);
+
+	template <typename C> bool readPrefabComponent(DeltaReader& reader, Prefab& prefab, C*);
+	bool readPrefabComponent(DeltaReader& reader, Prefab& prefab, Inventory*);
+	template <typename C> bool readPrefabComponent(DeltaReader& reader, Prefab& prefab, Shared<C>*);
+
 	template <typename C>
 	PackedArray<C>& array();
 
+	// (key, component id) of each live component
+	using SortKeys = std::vector<std::pair<uint64_t, ID>>;
+
+	struct SortJob {
+		int index;
+		std::function<void(SortKeys&)> keys;
+		std::vector<ID> order; // component ids, empty until planned
+		size_t next;           // into order
+		unsigned int position; // next slot to fill
+		bool planned;
+	};
+	void queueSort(int index, std::function<void(SortKeys&)> keys);
+
+	// Arrays live in mAllocator's memory
+	template <typename C>
+	PackedArray<C>* createArray();
+	void destroyArray(PackedArrayBase* arr);
+
+	template <typename C>
+	PackedArray<C>& previousArray();
+
 protected:
+	// Owns its arrays, use copyFrom() instead
+	EntitySystem(const EntitySystem&) = delete;
+	EntitySystem& operator=(const EntitySystem&) = delete;
+
+	Allocator* mAllocator;
 	PackedArray<Entity> mEntities;
-	std::vector<PackedArrayBase*> mComponents;	
+	std::vector<PackedArrayBase*> mComponents; // by Index(), then RuntimeArrays by type
+	std::vector<PackedArrayBase*> mPrevious; // double buffered arrays or nullptr
 	std::vector<ISystem*> mSystems;
+	ItemSlab mItems;
+	std::vector<SharedPoolBase*> mSharedPools; // by Shared<C> index, or nullptr
 	friend class Entity;
 
 	std::vector<ID> mEntitiesToBeRemoved;
 	std::vector<std::vector<ID> > mComponentsToBeRemoved;
+
+	using PublishFunc = std::shared_ptr<const void> (EntitySystem::*)(const PublishedFrame* previous);
+	std::vector<std::pair<int, PublishFunc>> mPublishers;
+	std::shared_ptr<const PublishedFrame> mPublished;
+	unsigned int mFrame;
+
+	FrameCounts mChanges;     // this frame so far
+	FrameCounts mLastChanges;
+	std::vector<FrameCounts> mComponentChanges; // by Index(), only components added/removed
+	std::vector<FrameCounts> mLastComponentChanges;
+	Profiler mProfiler;
+	std::vector<std::unique_ptr<ScratchAllocator>> mScratch; // by worker
+	std::vector<SortJob> mSorts;
+	TimerWheel mTimers;
+	std::vector<std::vector<ComponentIndexBase*>> mIndexes; // by Index()
+	WorldStreamer* mStreamer;
+	Journal* mJournal;
 };
 
 #include "entity.inl"
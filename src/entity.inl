@@ -3,12 +3,20 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 template <typename C>
-C& Entity::add(C& c){
+C& Entity::add(const C& c){
 	if (has<C>()){
 		// If already has the component then copy it
 		// NB: Can we add two components of same type?
+		// NB: Keeps its own id and entity
 		C& oc = get<C>();
+		ID cid = oc.id, entity = oc.entity;
+		mES->releaseComponent(oc);
 		oc = c;
+		oc.id = cid;
+		oc.entity = entity;
+		mES->adoptComponent(oc);
+		mES->indexChanged(C::Index(), id);
+		if (mES->mJournal) mES->mJournal->added(*mES, id, C::Index(), &oc);
 		return oc;
 	}
 	else {
@@ -16,16 +24,53 @@ C& Entity::add(C& c){
 		if (pc.id!=INVALID_ID){
 			mComponents[C::Index()] = pc.id;
 			mHasComponent[C::Index()] = true;
+			if (mES->mJournal) mES->mJournal->added(*mES, id, C::Index(), &pc);
 		}
 		return pc;
 	}
 }
 
+inline InventoryRef Entity::inventory(){
+	return InventoryRef(mES->items(), modify<Inventory>());
+}
+
+template <typename C>
+const C& Entity::addShared(const C& c){
+	// The value's there before add(), so the journal sees it
+	SharedPool<C>& pool = mES->sharedPool<C>();
+	Shared<C> shared;
+	shared.handle = pool.acquire(c);
+	Shared<C>& s = add(shared);
+	pool.release(shared.handle);
+	return pool.get(s.handle);
+}
+
+template <typename C>
+const C& Entity::getShared(){
+	return mES->sharedPool<C>().get(get<Shared<C>>().handle);
+}
+
+template <typename C>
+C& Entity::modifyShared(){
+	return mES->sharedPool<C>().modify(modify<Shared<C>>().handle);
+}
+
 template <typename C>
 C& Entity::get(){
 	return mES->getComponent<C>(mComponents[C::Index()]);
 }
 
+template <typename C>
+C& Entity::modify(){
+	mES->indexChanged(C::Index(), id);
+	return get<C>();
+}
+
+template <typename C>
+const C& Entity::previous(){
+	return mES->getPreviousComponent<C>(mComponents[C::Index()]);
+}
+
 template <typename C>
 bool Entity::has(){
 	return mHasComponent[C::Index()];
@@ -35,12 +80,10 @@ bool Entity::has(){
 template <typename C>	
 void Entity::remove(bool immediately){
 	if (mHasComponent[C::Index()]){
+		mES->indexChanged(C::Index(), id);
+		if (mES->mJournal) mES->mJournal->removedComponent(id, C::Index(), immediately);
 		if (immediately){
-			ID cid = mComponents[C::Index()];
-			PackedArray<C>& arr = mES->array<C>();
-			if (arr.has(cid)){
-				arr.remove(cid);
-			}
+			mES->destroyComponent<C>(mComponents[C::Index()]);
 		}
 		else {
 			mES->removeComponent<C>(mComponents[C::Index()]);
@@ -62,10 +105,50 @@ void Entity::removeComponents(bool immediately, const TypeList<First, Rest...>&
 	}
 }
 
+inline bool Entity::hasComponent(int type){
+	if (type < NUM_COMPONENTS) return mHasComponent[type];
+	return mES->runtimeArray(type).find(id) != INVALID_ID;
+}
+
+inline void* Entity::getComponent(int type){
+	if (type < NUM_COMPONENTS){
+		return mHasComponent[type] ? mES->mComponents[type]->object(mComponents[type]) : nullptr;
+	}
+	RuntimeArray& arr = mES->runtimeArray(type);
+	ID cid = arr.find(id);
+	return cid != INVALID_ID ? arr.value(cid) : nullptr;
+}
+
+template <typename T>
+bool RuntimeComponent<T>::has(Entity& e) const {
+	return e.hasComponent(mIndex);
+}
+
+template <typename T>
+T& RuntimeComponent<T>::get(Entity& e) const {
+	return *(T*)e.getComponent(mIndex);
+}
+
+template <typename T>
+T& RuntimeComponent<T>::add(Entity& e, const T& value) const {
+	return *(T*)e.addComponent(mIndex, &value);
+}
+
+template <typename T>
+void RuntimeComponent<T>::remove(Entity& e, bool immediately) const {
+	e.removeComponent(mIndex, immediately);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // EntitySystem
 ///////////////////////////////////////////////////////////////////////////////
 
+inline RuntimeArray& EntitySystem::runtimeArray(int type){
+	assert(type >= NUM_COMPONENTS && type < numComponentTypes());
+	if (type >= (int)mComponents.size()) setupRuntimeArrays();
+	return *static_cast<RuntimeArray*>(mComponents[type]);
+}
+
 template <typename C>
 EntitySystem::ComponentView<C>::Iterator::Iterator(EntitySystem* es, int i) :es(es), i(i){}
 
@@ -117,11 +200,54 @@ EntitySystem::ComponentView<C> EntitySystem::components(){
 // protected
 
 template <typename C>
-C& EntitySystem::addComponent(ID entityId, C& pc){
+C& EntitySystem::addComponent(ID entityId, const C& pc){
 	PackedArray<C>& arr = array<C>();
-	pc.entity = entityId;
 	ID id = arr.add(pc);
-	return arr.lookup(id);
+	C& c = arr.lookup(id);
+	if (id != INVALID_ID){
+		c.entity = entityId;
+		mChanges.componentsAdded++;
+		mComponentChanges[C::Index()].componentsAdded++;
+		indexChanged(C::Index(), entityId);
+	}
+	adoptComponent(c);
+	return c;
+}
+
+template <typename C>
+SharedPool<C>& EntitySystem::sharedPool(){
+	assert(mSharedPools[Shared<C>::Index()] != nullptr);
+	return *static_cast<SharedPool<C>*>(mSharedPools[Shared<C>::Index()]);
+}
+
+template <typename C>
+void EntitySystem::adoptComponent(Shared<C>& shared){
+	// One more entity refers to the value
+	sharedPool<C>().addRef(shared.handle);
+}
+
+template <typename C>
+void EntitySystem::releaseComponent(Shared<C>& shared){
+	sharedPool<C>().release(shared.handle);
+	shared.handle = 0;
+}
+
+template <typename C>
+void EntitySystem::setupSharedPool(Shared<C>*){
+	if (mSharedPools[Shared<C>::Index()] == nullptr){
+		mSharedPools[Shared<C>::Index()] = new SharedPool<C>();
+	}
+}
+
+template <typename C>
+void EntitySystem::destroyComponent(ID id){
+	PackedArray<C>& arr = array<C>();
+	if (arr.has(id)){
+		releaseComponent(arr.lookup(id));
+		arr.remove(id);
+		mChanges.componentsRemoved++;
+		mComponentChanges[C::Index()].componentsRemoved++;
+	}
 }
 
 template <typename C>
@@ -135,16 +261,28 @@ C& EntitySystem::getComponent(ID id){
 	}
 }
 
+template <typename C>
+const C& EntitySystem::getPreviousComponent(ID id){
+	assert(mPrevious[C::Index()] != nullptr);
+	PackedArray<C>& prev = previousArray<C>();
+	if (prev.has(id)){
+		return prev.lookup(id);
+	}
+	else {
+		return getComponent<C>(id);
+	}
+}
+
 template <typename C>
 void EntitySystem::removeComponent(ID id){
+	// TODO: signal component removal from system in sync()
 	mComponentsToBeRemoved[C::Index()].push_back(id);
-	std::cerr << "TODO: signal component removal from system in sync()";
 }
 
 template <typename C>
 void EntitySystem::setupComponentArray(){
 	if (mComponents[C::Index()] == nullptr){
-		mComponents[C::Index()] = new PackedArray<C>();
+		mComponents[C::Index()] = createArray<C>();
 		PackedArray<C>& arr = array<C>();
 
 		// Add invalid component
@@ -153,6 +291,7 @@ void EntitySystem::setupComponentArray(){
 		ID id = arr.add(invalid);
 		invalid = arr.lookup(id);
 		assert(invalid.id == INVALID_ID);
+		setupSharedPool((C*)nullptr);
 
 		// Log memory usage etc
 		unsigned int bytes = arr.objects().bytes();
@@ -173,23 +312,126 @@ void EntitySystem::setupComponentArrays(const TypeList<First, Rest...>& tl){
 	}
 }
 
+template <typename C>
+bool EntitySystem::roomForComponents(const Prefab& prefab, unsigned int count){
+	return !prefab.has<C>() || array<C>().size() + count <= MAX_ENTITIES;
+}
+
+template <typename First>
+bool EntitySystem::roomForComponentArrays(const Prefab& prefab, unsigned int count, const TypeList<First>& tl){
+	return roomForComponents<First>(prefab, count);
+}
+
+template <typename First, typename... Rest>
+bool EntitySystem::roomForComponentArrays(const Prefab& prefab, unsigned int count, const TypeList<First, Rest...>& tl){
+	if (!roomForComponents<First>(prefab, count)) return false;
+	if (sizeof...(Rest)){
+		return roomForComponentArrays(prefab, count, TypeList<Rest...>());
+	}
+	return true;
+}
+
+// The components are copied into one block, then linked 
+// up with the block of entities starting at firstEntity
+template <typename C>
+void EntitySystem::instantiateComponents(const Prefab& prefab, unsigned int firstEntity, unsigned int count){
+	if (!prefab.has<C>()) return;
+	PackedArray<C>& arr = array<C>();
+	C* components = &arr.objects().get(arr.add(prefab.get<C>(), count));
+	Entity* entities = &mEntities.objects().get(firstEntity);
+	for (unsigned int i = 0; i < count; i++){
+		components[i].entity = entities[i].id;
+		entities[i].mComponents[C::Index()] = components[i].id;
+		entities[i].mHasComponent[C::Index()] = true;
+		indexChanged(C::Index(), entities[i].id);
+	}
+	fillPrefabComponents(prefab, components, count);
+	mChanges.componentsAdded += count;
+	mComponentChanges[C::Index()].componentsAdded += count;
+}
+
+template <typename First>
+void EntitySystem::instantiateComponentArrays(const Prefab& prefab, unsigned int firstEntity, unsigned int count, const TypeList<First>& tl){
+	instantiateComponents<First>(prefab, firstEntity, count);
+}
+
+template <typename First, typename... Rest>
+void EntitySystem::instantiateComponentArrays(const Prefab& prefab, unsigned int firstEntity, unsigned int count, const TypeList<First, Rest...>& tl){
+	instantiateComponents<First>(prefab, firstEntity, count);
+	if (sizeof...(Rest)){
+		instantiateComponentArrays(prefab, firstEntity, count, TypeList<Rest...>());
+	}
+}
+
+// One lookup and one reference per instance
+template <typename C>
+void EntitySystem::fillPrefabComponents(const Prefab& prefab, Shared<C>* shared, unsigned int count){
+	SharedPool<C>& pool = sharedPool<C>();
+	unsigned int handle = pool.acquire(prefab.getShared<C>());
+	for (unsigned int i = 0; i < count; i++){
+		if (i > 0) pool.addRef(handle);
+		shared[i].handle = handle;
+	}
+}
+
+template <typename First>
+unsigned int EntitySystem::countComponentsFor(ISystem* sys, const TypeList<First>& tl){
+	return sys->implements(First::Index()) ? array<First>().size() - 1 : 0;
+}
+
+template <typename First, typename... Rest>
+unsigned int EntitySystem::countComponentsFor(ISystem* sys, const TypeList<First, Rest...>& tl){
+	unsigned int count = sys->implements(First::Index()) ? array<First>().size() - 1 : 0;
+	if (sizeof...(Rest)){
+		count += countComponentsFor(sys, TypeList<Rest...>());
+	}
+	return count;
+}
+
+template <typename T>
+void EntitySystem::fillArrayStats(PackedArray<T>& arr, const char* name, ArrayStats& s){
+	static const size_t PAGE_SIZE = 4096;
+	s.name = name;
+	s.live = arr.size() > 0 ? arr.size() - 1 : 0;
+	s.capacity = arr.objects().capacity();
+	s.highWater = arr.highWater();
+	s.freelist = arr.freeSlots();
+	s.objectSize = sizeof(T);
+	s.committedBytes = arr.objects().bytes();
+	s.touchedBytes = (arr.highWater() * sizeof(T) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+	if (s.touchedBytes > s.committedBytes) s.touchedBytes = s.committedBytes;
+	s.indexBytes = arr.indexBytes();
+	s.added = 0;
+	s.removed = 0;
+}
+
+template <typename First>
+void EntitySystem::fillComponentStats(WorldStats& stats, const TypeList<First>& tl){
+	ArrayStats& s = stats.components[First::Index()];
+	fillArrayStats(array<First>(), First::Name(), s);
+	s.added = mLastComponentChanges[First::Index()].componentsAdded;
+	s.removed = mLastComponentChanges[First::Index()].componentsRemoved;
+}
+
+template <typename First, typename... Rest>
+void EntitySystem::fillComponentStats(WorldStats& stats, const TypeList<First, Rest...>& tl){
+	fillComponentStats(stats, TypeList<First>());
+	if (sizeof...(Rest)){
+		fillComponentStats(stats, TypeList<Rest...>());
+	}
+}
+
 template <typename First>
 void EntitySystem::removeQueuedComponents(const TypeList<First>& tl){
-	PackedArray<First>& arr = array<First>();
 	for (ID id : mComponentsToBeRemoved[First::Index()]){
-		if (arr.has(id)){
-			arr.remove(id);
-		}
+		destroyComponent<First>(id);
 	}
 }
 
 template <typename First, typename... Rest>
 void EntitySystem::removeQueuedComponents(const TypeList<First, Rest...>& tl){
-	PackedArray<First>& arr = array<First>();
 	for (ID id : mComponentsToBeRemoved[First::Index()]){
-		if (arr.has(id)){
-			arr.remove(id);
-		}
+		destroyComponent<First>(id);
 	}
 	if (sizeof...(Rest)){
 		removeQueuedComponents(TypeList<Rest...>());
@@ -201,6 +443,48 @@ PackedArray<C>& EntitySystem::array(){
 	return *static_cast<PackedArray<C>*>(mComponents[C::Index()]);
 }
 
+template <typename C>
+void EntitySystem::sortByEntity(){
+	queueSort(C::Index(), [this](SortKeys& keys){
+		for (C& c : components<C>()){
+			keys.push_back(std::make_pair((uint64_t)mEntities.position(c.entity), c.id));
+		}
+	});
+}
+
+template <typename C, typename Other>
+void EntitySystem::sortLike(){
+	queueSort(C::Index(), [this](SortKeys& keys){
+		PackedArray<Other>& other = array<Other>();
+		for (C& c : components<C>()){
+			Entity& e = lookup(c.entity);
+			uint64_t key = e.has<Other>() ? other.position(e.mComponents[Other::Index()]) : (1ull << 32) + mEntities.position(c.entity);
+			keys.push_back(std::make_pair(key, c.id));
+		}
+	});
+}
+
+template <typename C>
+void EntitySystem::sortBy(std::function<uint64_t(const C&)> key){
+	queueSort(C::Index(), [this, key](SortKeys& keys){
+		for (C& c : components<C>()){
+			keys.push_back(std::make_pair(key(c), c.id));
+		}
+	});
+}
+
+template <typename C>
+PackedArray<C>* EntitySystem::createArray(){
+	void* p = mAllocator->allocate(sizeof(PackedArray<C>), alignof(PackedArray<C>));
+	assert(p != nullptr);
+	return new(p) PackedArray<C>(mAllocator);
+}
+
+template <typename C>
+PackedArray<C>& EntitySystem::previousArray(){
+	return *static_cast<PackedArray<C>*>(mPrevious[C::Index()]);
+}
+
 template <typename First>
 void EntitySystem::printDebugInfoForComponents(std::ostream& out, const TypeList<First>& tl){
 	PackedArray<First>& arr = array<First>();
@@ -214,4 +498,567 @@ void EntitySystem::printDebugInfoForComponents(std::ostream& out, const TypeList
 	if (sizeof...(Rest)){
 		printDebugInfoForComponents(out, TypeList<Rest...>());
 	}
-}
\ No newline at end of file
+}
+
+template <typename C>
+void EntitySystem::doubleBuffer(){
+	if (mPrevious[C::Index()] == nullptr){
+		mPrevious[C::Index()] = createArray<C>();
+		copyPreviousArray<C>();
+	}
+}
+
+// Called by sync() to freeze this frame's values
+// Only pages which changed are written
+template <typename C>
+size_t EntitySystem::copyPreviousArray(){
+	if (mPrevious[C::Index()] == nullptr) return 0;
+	return previousArray<C>().copyFrom(array<C>());
+}
+
+template <typename First>
+size_t EntitySystem::copyPreviousArrays(const TypeList<First>& tl){
+	return copyPreviousArray<First>();
+}
+
+template <typename First, typename... Rest>
+size_t EntitySystem::copyPreviousArrays(const TypeList<First, Rest...>& tl){
+	size_t written = copyPreviousArray<First>();
+	if (sizeof...(Rest)){
+		written += copyPreviousArrays(TypeList<Rest...>());
+	}
+	return written;
+}
+
+template <typename C>
+void EntitySystem::publish(){
+	for (auto& p : mPublishers){
+		if (p.first == C::Index()) return;
+	}
+	mPublishers.push_back(std::make_pair(C::Index(), &EntitySystem::publishArray<C>));
+}
+
+template <typename C>
+std::shared_ptr<const void> EntitySystem::publishArray(const PublishedFrame* previous){
+	const ReadSnapshot<C>* prev = previous ? previous->get<C>() : nullptr;
+	PackedArray<C>& arr = array<C>();
+	return ReadSnapshot<C>::make(arr.objects(), arr.size(), prev);
+}
+
+template <typename C>
+size_t EntitySystem::copyComponentArray(EntitySystem& other){
+	size_t written = array<C>().copyFrom(other.array<C>());
+	if (other.mPrevious[C::Index()] != nullptr){
+		doubleBuffer<C>();
+		written += previousArray<C>().copyFrom(other.previousArray<C>());
+	}
+	else {
+		// Nothing older to take, so previous<C>() starts out as the copy
+		written += copyPreviousArray<C>();
+	}
+	return written;
+}
+
+template <typename First>
+size_t EntitySystem::copyComponentArrays(EntitySystem& other, const TypeList<First>& tl){
+	return copyComponentArray<First>(other);
+}
+
+template <typename First, typename... Rest>
+size_t EntitySystem::copyComponentArrays(EntitySystem& other, const TypeList<First, Rest...>& tl){
+	size_t written = copyComponentArray<First>(other);
+	if (sizeof...(Rest)){
+		written += copyComponentArrays(other, TypeList<Rest...>());
+	}
+	return written;
+}
+
+template <typename T>
+void EntitySystem::saveArray(SnapshotWriter& writer, SnapshotStringTable& strings, uint64_t arrayOffset, PackedArray<T>& arr, const char* name, int version, const std::vector<Field>& fields){
+	static_assert(std::is_trivially_copyable<T>::value, "snapshots copy objects as raw bytes");
+
+	SnapshotArray sa;
+	std::memset(&sa, 0, sizeof(sa));
+	setSnapshotName(sa.name, name);
+	sa.version = version;
+	sa.objectSize = sizeof(T);
+	sa.numObjects = arr.size();
+	sa.numFields = (uint32_t)fields.size();
+	arr.repairFreelist();
+	sa.freelistEnqueue = arr.freelistEnqueue();
+	sa.freelistDequeue = arr.freelistDequeue();
+
+	sa.fieldsOffset = writeSnapshotFields(writer, fields);
+
+	sa.indicesOffset = writer.align();
+	writer.write(arr.indexData(), arr.indexBytes());
+
+	// Only the live range of the objects
+	sa.objectsOffset = writer.align();
+	writer.write(arr.objects().data(), arr.size() * sizeof(T));
+	strings.remap(writer, sa.objectsOffset, sa.numObjects, sizeof(T), fields);
+
+	writer.patch(arrayOffset, sa);
+}
+
+// PRE: sa has been validated against the file size
+template <typename T>
+void EntitySystem::loadArray(const MappedFile& file, SnapshotStrings& strings, SnapshotShared& shared, const SnapshotArray& sa, PackedArray<T>& arr, const std::vector<Field>& fields){
+	const SnapshotField* srcFields = (const SnapshotField*)(file.data() + sa.fieldsOffset);
+	const char* src = file.data() + sa.objectsOffset;
+	StaticArray<T>& objects = arr.objects();
+
+	if (sameLayout(fields, sizeof(T), sa, srcFields)){
+		std::memcpy(objects.data(), src, sa.numObjects * sizeof(T));
+	}
+	else {
+		// Schema has changed, so start from defaults and copy what we can
+		for (unsigned int i = 0; i < sa.numObjects; i++){
+			objects.set(i, T());
+			convertRecord((char*)&objects.get(i), fields, src + i * (size_t)sa.objectSize, srcFields, sa.numFields);
+		}
+	}
+	strings.remap(objects.data(), sa.numObjects, sizeof(T), fields);
+	shared.remap(objects.data(), sa.numObjects, sizeof(T), fields);
+	arr.restore(sa.numObjects, file.data() + sa.indicesOffset, sa.freelistEnqueue, sa.freelistDequeue);
+}
+
+template <typename First>
+void EntitySystem::saveComponentArrays(SnapshotWriter& writer, SnapshotStringTable& strings, uint64_t arrayOffset, const TypeList<First>& tl){
+	saveArray(writer, strings, arrayOffset, array<First>(), First::Name(), First::Version(), First::AllFields());
+}
+
+template <typename First, typename... Rest>
+void EntitySystem::saveComponentArrays(SnapshotWriter& writer, SnapshotStringTable& strings, uint64_t arrayOffset, const TypeList<First, Rest...>& tl){
+	saveArray(writer, strings, arrayOffset, array<First>(), First::Name(), First::Version(), First::AllFields());
+	if (sizeof...(Rest)){
+		saveComponentArrays(writer, strings, arrayOffset + sizeof(SnapshotArray), TypeList<Rest...>());
+	}
+}
+
+template <typename C>
+void EntitySystem::loadComponentArray(const MappedFile& file, SnapshotStrings& strings, SnapshotShared& shared){
+	PackedArray<C>& arr = array<C>();
+	const SnapshotArray* sa = findSnapshotArray(file, C::Name());
+	if (sa){
+		loadArray(file, strings, shared, *sa, arr, C::AllFields());
+	}
+	else {
+		// New component type, so just the invalid component
+		arr.clear();
+		C invalid;
+		invalid.entity = INVALID_ID;
+		arr.add(invalid);
+	}
+	copyPreviousArray<C>();
+}
+
+template <typename First>
+void EntitySystem::loadComponentArrays(const MappedFile& file, SnapshotStrings& strings, SnapshotShared& shared, const TypeList<First>& tl){
+	loadComponentArray<First>(file, strings, shared);
+}
+
+template <typename First, typename... Rest>
+void EntitySystem::loadComponentArrays(const MappedFile& file, SnapshotStrings& strings, SnapshotShared& shared, const TypeList<First, Rest...>& tl){
+	loadComponentArray<First>(file, strings, shared);
+	if (sizeof...(Rest)){
+		loadComponentArrays(file, strings, shared, TypeList<Rest...>());
+	}
+}
+
+template <typename C>
+bool EntitySystem::exportColumns(const char* path){
+	PackedArray<C>& arr = array<C>();
+	SnapshotWriter writer;
+	writeColumns(writer, C::Name(), C::Version(), C::AllFields(), arr.data() + sizeof(C), sizeof(C), arr.size() - 1, *this);
+	if (!writer.save(path)){
+		std::cerr << "EntitySystem: couldn't write columns " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+template <typename C>
+bool EntitySystem::importColumns(const char* path, std::vector<ID>& entities){
+	static_assert(std::is_trivially_copyable<C>::value, "columns are copied as raw bytes");
+	ColumnsFile file;
+	if (!file.open(path)){
+		std::cerr << "EntitySystem: " << path << " isn't a valid columns file" << std::endl;
+		return false;
+	}
+	if (std::strncmp(file.header().name, C::Name(), SNAPSHOT_NAME_SIZE - 1) != 0){
+		std::cerr << "EntitySystem: " << path << " holds " << file.header().name << " not " << C::Name() << std::endl;
+		return false;
+	}
+
+	unsigned int rows = file.numRows();
+	const ColumnInfo* entityColumn = file.find("entity", FieldType::UInt, sizeof(ID));
+	const ID* rowEntities = entityColumn ? (const ID*)file.values(*entityColumn) : nullptr;
+	// Decided up front, as new entities can get the ids of dead ones in the file
+	std::vector<bool> alive(rows);
+	unsigned int numNew = 0;
+	for (unsigned int i = 0; i < rows; i++){
+		alive[i] = rowEntities && rowEntities[i] != INVALID_ID && mEntities.has(rowEntities[i]);
+		if (!alive[i]) numNew++;
+	}
+	PackedArray<C>& arr = array<C>();
+	if (mEntities.size() + numNew > MAX_ENTITIES || arr.size() + rows > MAX_ENTITIES){
+		std::cerr << "EntitySystem: no room for the " << rows << " rows of " << path << std::endl;
+		return false;
+	}
+
+	Entity proto(this);
+	proto.clear();
+	unsigned int firstEntity = mEntities.add(proto, numNew);
+	unsigned int firstComponent = arr.add(C(), numNew);
+	mChanges.created += numNew;
+	mChanges.componentsAdded += numNew;
+	mComponentChanges[C::Index()].componentsAdded += numNew;
+
+	// Where each row's fields go
+	std::vector<char*> records(rows);
+	std::vector<ID> created;
+	created.reserve(numNew);
+	entities.reserve(entities.size() + rows);
+	for (unsigned int i = 0; i < rows; i++){
+		Entity* e;
+		if (alive[i]){
+			e = &mEntities.lookup(rowEntities[i]);
+			if (!e->has<C>()){
+				C blank;
+				e->add(blank);
+			}
+			indexChanged(C::Index(), e->id);
+			records[i] = (char*)&e->get<C>();
+		}
+		else {
+			unsigned int n = (unsigned int)created.size();
+			e = &mEntities.objects().get(firstEntity + n);
+			C& c = arr.objects().get(firstComponent + n);
+			c.entity = e->id;
+			e->mComponents[C::Index()] = c.id;
+			e->mHasComponent[C::Index()] = true;
+			indexChanged(C::Index(), e->id);
+			records[i] = (char*)&c;
+			created.push_back(e->id);
+		}
+		entities.push_back(e->id);
+	}
+	file.read(C::Fields(), records.data(), *this);
+
+	if (numNew){
+		for (ISystem* sys : mSystems){
+			if (sys->implements(C::Index())) sys->setupBatch(*this, created.data(), numNew);
+		}
+	}
+	return true;
+}
+
+template <typename C>
+void EntitySystem::diffComponents(EntitySystem& base, DeltaWriter& writer, uint32_t type, uint32_t& numTypes){
+	const std::vector<Field>& fields = C::Fields();
+	assert(fields.size() <= 32);
+	DeltaComponents dc = { type, (uint32_t)fields.size(), 0, 0 };
+	size_t headerOffset = writer.write(dc);
+
+	// Components removed from entities that are still around
+	PackedArray<C>& baseArr = base.array<C>();
+	for (unsigned int i = 1; i < baseArr.size(); i++){
+		ID entity = baseArr.objects().get(i).entity;
+		if (has(entity) && !lookup(entity).has<C>()){
+			writer.write(entity);
+			dc.numRemoved++;
+		}
+	}
+
+	// Components that were added or changed
+	PackedArray<C>& arr = array<C>();
+	for (unsigned int i = 1; i < arr.size(); i++){
+		C& c = arr.objects().get(i);
+		Entity& be = base.lookup(c.entity);
+		const char* now = (const char*)&c;
+		const char* before = be.has<C>() ? (const char*)&be.get<C>() : nullptr;
+		uint32_t mask = 0;
+		for (size_t f = 0; f < fields.size(); f++){
+			if (!before || !sameDeltaField(fields[f], now, *this, before, base)){
+				mask |= 1u << f;
+			}
+		}
+		if (mask){
+			writer.write(c.entity);
+			writer.write(mask);
+			for (size_t f = 0; f < fields.size(); f++){
+				if (mask & (1u << f)) writeDeltaField(writer, fields[f], now, *this);
+			}
+			dc.numChanged++;
+		}
+	}
+
+	if (dc.numRemoved || dc.numChanged){
+		writer.patch(headerOffset, dc);
+		numTypes++;
+	}
+	else {
+		writer.truncate(headerOffset);
+	}
+}
+
+template <typename First>
+void EntitySystem::diffComponentArrays(EntitySystem& base, DeltaWriter& writer, uint32_t type, uint32_t& numTypes, const TypeList<First>& tl){
+	diffComponents<First>(base, writer, type, numTypes);
+}
+
+template <typename First, typename... Rest>
+void EntitySystem::diffComponentArrays(EntitySystem& base, DeltaWriter& writer, uint32_t type, uint32_t& numTypes, const TypeList<First, Rest...>& tl){
+	diffComponents<First>(base, writer, type, numTypes);
+	if (sizeof...(Rest)){
+		diffComponentArrays(base, writer, type + 1, numTypes, TypeList<Rest...>());
+	}
+}
+
+template <typename C>
+bool EntitySystem::applyComponents(DeltaReader& reader, const DeltaComponents& dc){
+	const std::vector<Field>& fields = C::Fields();
+	if (dc.numFields != fields.size()) return false;
+
+	for (uint32_t i = 0; i < dc.numRemoved; i++){
+		ID entity;
+		if (!reader.read(entity)) return false;
+		if (has(entity)) lookup(entity).remove<C>(true);
+	}
+
+	for (uint32_t i = 0; i < dc.numChanged; i++){
+		ID entity;
+		uint32_t mask;
+		if (!reader.read(entity) || !reader.read(mask)) return false;
+		if (!has(entity) || (fields.size() < 32 && (mask >> fields.size()) != 0)) return false;
+
+		Entity& e = lookup(entity);
+		if (!e.has<C>()){
+			C c;
+			e.add(c);
+		}
+		char* dst = (char*)&e.modify<C>();
+		for (size_t f = 0; f < fields.size(); f++){
+			if ((mask & (1u << f)) && !readDeltaField(reader, fields[f], dst, *this)) return false;
+		}
+	}
+	return true;
+}
+
+template <typename First>
+bool EntitySystem::applyComponentArrays(DeltaReader& reader, const DeltaComponents& dc, uint32_t type, const TypeList<First>& tl){
+	if (dc.type == type) return applyComponents<First>(reader, dc);
+	return false;
+}
+
+template <typename First, typename... Rest>
+bool EntitySystem::applyComponentArrays(DeltaReader& reader, const DeltaComponents& dc, uint32_t type, const TypeList<First, Rest...>& tl){
+	if (dc.type == type) return applyComponents<First>(reader, dc);
+	if (sizeof...(Rest)){
+		return applyComponentArrays(reader, dc, type + 1, TypeList<Rest...>());
+	}
+	return false;
+}
+
+template <typename C>
+void EntitySystem::savePartitionComponents(DeltaWriter& writer, const std::vector<ID>& entities, uint32_t type, uint32_t& numTypes){
+	// Just the invalid component
+	if (array<C>().size() <= 1) return;
+
+	const std::vector<Field>& fields = C::Fields();
+	PartitionComponents pc = { type, (uint32_t)fields.size(), 0 };
+	size_t headerOffset = writer.write(pc);
+
+	for (size_t i = 0; i < entities.size(); i++){
+		Entity& e = lookup(entities[i]);
+		if (!e.has<C>()) continue;
+		const char* record = (const char*)&e.get<C>();
+		writer.write((uint32_t)i);
+		size_t sizeOffset = writer.write((uint32_t)0);
+		for (const Field& f : fields){
+			writeDeltaField(writer, f, record, *this);
+		}
+		writer.patch(sizeOffset, (uint32_t)(writer.offset() - sizeOffset - sizeof(uint32_t)));
+		pc.count++;
+	}
+
+	if (pc.count){
+		writer.patch(headerOffset, pc);
+		numTypes++;
+	}
+	else {
+		writer.truncate(headerOffset);
+	}
+}
+
+template <typename First>
+void EntitySystem::savePartitionArrays(DeltaWriter& writer, const std::vector<ID>& entities, uint32_t type, uint32_t& numTypes, const TypeList<First>& tl){
+	savePartitionComponents<First>(writer, entities, type, numTypes);
+}
+
+template <typename First, typename... Rest>
+void EntitySystem::savePartitionArrays(DeltaWriter& writer, const std::vector<ID>& entities, uint32_t type, uint32_t& numTypes, const TypeList<First, Rest...>& tl){
+	savePartitionComponents<First>(writer, entities, type, numTypes);
+	if (sizeof...(Rest)){
+		savePartitionArrays(writer, entities, type + 1, numTypes, TypeList<Rest...>());
+	}
+}
+
+// The records of pc for the entities [first, end) of the partition,
+// which were just created as the block starting at entities
+template <typename C>
+bool EntitySystem::integratePartitionComponents(PartitionData& data, PartitionData::Components& pc, Entity* entities, unsigned int first, unsigned int end){
+	size_t last = pc.next;
+	while (last < pc.records.size() && pc.records[last].entity < end) last++;
+	unsigned int count = (unsigned int)(last - pc.next);
+	const std::vector<Field>& fields = C::Fields();
+	if (pc.numFields != fields.size()){
+		pc.next = last;
+		return false;
+	}
+	if (count == 0) return true;
+
+	PackedArray<C>& arr = array<C>();
+	C* components = &arr.objects().get(arr.add(C(), count));
+	bool ok = true;
+	for (unsigned int i = 0; i < count; i++){
+		const PartitionData::Record& r = pc.records[pc.next + i];
+		Entity& e = entities[r.entity - first];
+		components[i].entity = e.id;
+		e.mComponents[C::Index()] = components[i].id;
+		e.mHasComponent[C::Index()] = true;
+		indexChanged(C::Index(), e.id);
+
+		DeltaReader reader(data.data() + r.offset, r.bytes);
+		for (const Field& f : fields){
+			ok = ok && readDeltaField(reader, f, (char*)&components[i], *this);
+		}
+	}
+	pc.next = last;
+	mChanges.componentsAdded += count;
+	mComponentChanges[C::Index()].componentsAdded += count;
+	return ok;
+}
+
+template <typename First>
+bool EntitySystem::integratePartitionArrays(PartitionData& data, PartitionData::Components& pc, Entity* entities, unsigned int first, unsigned int end, uint32_t type, const TypeList<First>& tl){
+	if (pc.type == type) return integratePartitionComponents<First>(data, pc, entities, first, end);
+	return false;
+}
+
+template <typename First, typename... Rest>
+bool EntitySystem::integratePartitionArrays(PartitionData& data, PartitionData::Components& pc, Entity* entities, unsigned int first, unsigned int end, uint32_t type, const TypeList<First, Rest...>& tl){
+	if (pc.type == type) return integratePartitionComponents<First>(data, pc, entities, first, end);
+	if (sizeof...(Rest)){
+		return integratePartitionArrays(data, pc, entities, first, end, type + 1, TypeList<Rest...>());
+	}
+	return false;
+}
+
+template <typename C>
+void EntitySystem::migrateComponents(EntitySystem& to, const std::vector<ID>& entities, unsigned int firstEntity, unsigned int count){
+	static_assert(std::is_trivially_copyable<C>::value, "migrate() copies components as raw bytes");
+	if (count == 0) return;
+	PackedArray<C>& arr = to.array<C>();
+	C* components = &arr.objects().get(arr.add(C(), count));
+	Entity* targets = &to.mEntities.objects().get(firstEntity);
+	unsigned int n = 0;
+	for (size_t i = 0; i < entities.size(); i++){
+		Entity& e = mEntities.lookup(entities[i]);
+		if (!e.mHasComponent[C::Index()]) continue;
+		C& c = components[n++];
+		ID id = c.id;
+		std::memcpy(&c, &array<C>().lookup(e.mComponents[C::Index()]), sizeof(C));
+		c.id = id;
+		c.entity = targets[i].id;
+		to.adoptFields(*this, (char*)&c, C::Fields());
+		targets[i].mComponents[C::Index()] = id;
+		targets[i].mHasComponent[C::Index()] = true;
+		to.indexChanged(C::Index(), targets[i].id);
+	}
+	to.mChanges.componentsAdded += count;
+	to.mComponentChanges[C::Index()].componentsAdded += count;
+}
+
+template <typename First>
+void EntitySystem::migrateComponentArrays(EntitySystem& to, const std::vector<ID>& entities, unsigned int firstEntity, const std::vector<unsigned int>& counts, const TypeList<First>& tl){
+	migrateComponents<First>(to, entities, firstEntity, counts[First::Index()]);
+}
+
+template <typename First, typename... Rest>
+void EntitySystem::migrateComponentArrays(EntitySystem& to, const std::vector<ID>& entities, unsigned int firstEntity, const std::vector<unsigned int>& counts, const TypeList<First, Rest...>& tl){
+	migrateComponents<First>(to, entities, firstEntity, counts[First::Index()]);
+	if (sizeof...(Rest)){
+		migrateComponentArrays(to, entities, firstEntity, counts, TypeList<Rest...>());
+	}
+}
+
+template <typename C>
+bool EntitySystem::replayComponent(DeltaReader& reader, JournalOp op, Entity& e, Prefab* prefab){
+	switch (op){
+	case JournalOp::Instantiate:
+		return readPrefabComponent(reader, *prefab, (C*)nullptr);
+
+	case JournalOp::AddComponent: {
+		// Added like the original then given its fields, like apply()
+		C c;
+		e.add(c);
+		char* dst = (char*)&e.modify<C>();
+		for (const Field& f : C::Fields()){
+			if (!readDeltaField(reader, f, dst, *this)) return false;
+		}
+		return true;
+	}
+
+	case JournalOp::RemoveComponent:
+		e.remove<C>();
+		return true;
+
+	case JournalOp::RemoveComponentNow:
+		e.remove<C>(true);
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+template <typename First>
+bool EntitySystem::replayComponentArrays(DeltaReader& reader, JournalOp op, Entity& e, Prefab* prefab, int component, int type, const TypeList<First>& tl){
+	if (component == type) return replayComponent<First>(reader, op, e, prefab);
+	return false;
+}
+
+template <typename First, typename... Rest>
+bool EntitySystem::replayComponentArrays(DeltaReader& reader, JournalOp op, Entity& e, Prefab* prefab, int component, int type, const TypeList<First, Rest...>& tl){
+	if (component == type) return replayComponent<First>(reader, op, e, prefab);
+	if (sizeof...(Rest)){
+		return replayComponentArrays(reader, op, e, prefab, component, type + 1, TypeList<Rest...>());
+	}
+	return false;
+}
+
+template <typename C>
+bool EntitySystem::readPrefabComponent(DeltaReader& reader, Prefab& prefab, C*){
+	C c;
+	for (const Field& f : C::Fields()){
+		if (!readDeltaField(reader, f, (char*)&c, *this)) return false;
+	}
+	prefab.add(c);
+	return true;
+}
+
+// The value goes in the prefab, it's shared when it's instantiated
+template <typename C>
+bool EntitySystem::readPrefabComponent(DeltaReader& reader, Prefab& prefab, Shared<C>*){
+	Shared<C> shared;
+	for (const Field& f : Shared<C>::Fields()){
+		if (!readDeltaField(reader, f, (char*)&shared, *this)) return false;
+	}
+	if (shared.handle == 0) return false;
+	SharedPool<C>& pool = sharedPool<C>();
+	prefab.addShared(pool.get(shared.handle));
+	pool.release(shared.handle);
+	return true;
+}
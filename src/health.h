@@ -10,6 +10,12 @@ struct Health: public Component<Health> {
 	bool poisoned;
 
 	Health(float health = 0.f, bool poisoned = false) :health(health), poisoned(poisoned){}
+
+	static const std::vector<Field>& Fields(){
+		static const std::vector<Field> fields = { COM_FIELD(Health, health), COM_FIELD(Health, poisoned) };
+		return fields;
+	}
+
 	std::string what() {
 		std::ostringstream oss;
 		oss << "health {";
@@ -0,0 +1,149 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <algorithm>
+
+#include "entity.h"
+
+// Secondary indexes: find entities by the value of one of their
+// components without scanning the array, e.g., everyone below 10 health
+//   OrderedIndex<Health, float> byHealth([](const Health& h){ return h.health; });
+//   es.addIndex(&byHealth);
+//   byHealth.range(0.f, 10.f, ids);
+//
+// A key can be derived from the component and the world, and a
+// component can have several, e.g., each item in an inventory
+//   HashedIndex<Inventory, Item> holders([](EntitySystem& es, const Inventory& inv, std::vector<Item>& keys){
+//       for (const ItemAndCount* s = es.items().begin(inv.stacks); s != es.items().end(inv.stacks); s++) keys.push_back(s->item);
+//   });
+//   holders.find(ARROW, ids);
+//
+// Indexes hear about components being added and removed, and about
+// changes made through Entity::modify<C>(), inventory() and modifyShared()
+// NB: Writes through get<C>() aren't seen, use modify<C>() for indexed types
+// Changed entities are re-keyed at the next lookup, so a lookup costs
+// what changed since the last one plus the size of the result
+template <typename C, typename Key, typename Map>
+class ValueIndex : public ComponentIndexBase {
+public:
+	using KeysFunc = std::function<void(EntitySystem& es, const C& c, std::vector<Key>& keys)>;
+	using KeyFunc = std::function<Key(const C& c)>;
+
+	explicit ValueIndex(KeysFunc keys) :mKeysFunc(keys), mES(nullptr){}
+	explicit ValueIndex(KeyFunc key) :mES(nullptr){
+		mKeysFunc = [key](EntitySystem& es, const C& c, std::vector<Key>& keys){ keys.push_back(key(c)); };
+	}
+
+	~ValueIndex(){
+		if (mES) mES->removeIndex(this);
+	}
+
+	int component() const override { return C::Index(); }
+
+	void attach(EntitySystem* es) override {
+		mES = es;
+		rebuild();
+	}
+
+	void detach() override {
+		mES = nullptr;
+		mEntries.clear();
+		mKeys.clear();
+		mDirty.clear();
+	}
+
+	void touch(ID entity) override {
+		mDirty.push_back(entity);
+	}
+
+	void rebuild() override {
+		mEntries.clear();
+		mKeys.clear();
+		mDirty.clear();
+		for (C& c : mES->components<C>()){
+			mDirty.push_back(c.entity);
+		}
+	}
+
+	// Append the entities with a key
+	void find(const Key& key, std::vector<ID>& entities){
+		refresh();
+		auto it = mEntries.find(key);
+		if (it != mEntries.end()) entities.insert(entities.end(), it->second.begin(), it->second.end());
+	}
+
+	size_t count(const Key& key){
+		refresh();
+		auto it = mEntries.find(key);
+		return it != mEntries.end() ? it->second.size() : 0;
+	}
+
+	// Append the entities with keys in [lo, hi), lowest key first
+	// NB: OrderedIndex only
+	void range(const Key& lo, const Key& hi, std::vector<ID>& entities){
+		refresh();
+		for (auto it = mEntries.lower_bound(lo); it != mEntries.end() && it->first < hi; ++it){
+			entities.insert(entities.end(), it->second.begin(), it->second.end());
+		}
+	}
+
+	// Number of distinct keys
+	size_t keys(){
+		refresh();
+		return mEntries.size();
+	}
+
+protected:
+	void refresh(){
+		if (mDirty.empty()) return;
+		assert(mES != nullptr);
+		std::sort(mDirty.begin(), mDirty.end());
+		mDirty.erase(std::unique(mDirty.begin(), mDirty.end()), mDirty.end());
+
+		std::vector<Key> keys;
+		for (ID entity : mDirty){
+			keys.clear();
+			if (mES->has(entity)){
+				Entity& e = mES->lookup(entity);
+				if (e.has<C>()) mKeysFunc(*mES, e.get<C>(), keys);
+			}
+
+			// Often touched without its keys changing, e.g., inventory()
+			auto old = mKeys.find(entity);
+			if (old != mKeys.end()){
+				if (old->second == keys) continue;
+				for (const Key& key : old->second) erase(key, entity);
+				mKeys.erase(old);
+			}
+			if (keys.empty()) continue;
+			for (const Key& key : keys) mEntries[key].insert(entity);
+			mKeys[entity] = keys;
+		}
+		mDirty.clear();
+	}
+
+	void erase(const Key& key, ID entity){
+		auto it = mEntries.find(key);
+		if (it == mEntries.end()) return;
+		it->second.erase(entity);
+		if (it->second.empty()) mEntries.erase(it);
+	}
+
+	KeysFunc mKeysFunc;
+	EntitySystem* mES;
+	Map mEntries;                                   // key -> entities
+	std::unordered_map<ID, std::vector<Key>> mKeys; // entity -> keys it's filed under
+	std::vector<ID> mDirty;                         // entities to re-key
+};
+
+template <typename C, typename Key>
+using HashedIndex = ValueIndex<C, Key, std::unordered_map<Key, std::unordered_set<ID>>>;
+
+template <typename C, typename Key>
+using OrderedIndex = ValueIndex<C, Key, std::map<Key, std::unordered_set<ID>>>;
+
+#endif
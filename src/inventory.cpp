@@ -1,5 +1,7 @@
 #include "inventory.h"
 #include <cassert>
+#include <algorithm>
+#include <climits>
 
 std::ostream& operator<<(std::ostream& oss, Item item){
 	switch (item){
@@ -11,3 +13,146 @@ std::ostream& operator<<(std::ostream& oss, Item item){
 	return oss;
 }
 
+bool itemFromName(const std::string& name, Item& item){
+	for (int i = Item::SWORD; i <= Item::ARROW; i++){
+		std::ostringstream oss;
+		oss << (Item)i;
+		if (oss.str() == name){
+			item = (Item)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static int sizeClassFor(unsigned int n){
+	int sizeClass = 0;
+	while ((1u << sizeClass) < n) sizeClass++;
+	return sizeClass;
+}
+
+ItemSlab::ItemSlab(){
+	for (int i = 0; i < NUM_CLASSES; i++) mFree[i] = END;
+}
+
+bool ItemSlab::add(ItemStacks& stacks, Item item, int count){
+	if (!valid(ItemAndCount(item, count))) return false;
+	ItemAndCount* first = mStacks.data() + stacks.offset;
+	for (unsigned int i = 0; i < stacks.size; i++){
+		if (first[i].item == item){
+			if (first[i].count > INT_MAX - count) return false;
+			first[i].count += count;
+			return true;
+		}
+	}
+	if (!reserve(stacks, stacks.size + 1)) return false;
+	mStacks[stacks.offset + stacks.size++] = ItemAndCount(item, count);
+	return true;
+}
+
+int ItemSlab::remove(ItemStacks& stacks, Item item, int count){
+	if (count <= 0) return 0;
+	ItemAndCount* first = mStacks.data() + stacks.offset;
+	for (unsigned int i = 0; i < stacks.size; i++){
+		if (first[i].item == item){
+			int removed = count < first[i].count ? count : first[i].count;
+			first[i].count -= removed;
+			if (first[i].count == 0){
+				// Order doesn't matter, so swap the last stack in
+				first[i] = first[--stacks.size];
+				if (stacks.size == 0) release(stacks);
+			}
+			return removed;
+		}
+	}
+	return 0;
+}
+
+int ItemSlab::count(const ItemStacks& stacks, Item item) const {
+	for (const ItemAndCount* i = begin(stacks); i != end(stacks); ++i){
+		if (i->item == item) return i->count;
+	}
+	return 0;
+}
+
+bool ItemSlab::assign(ItemStacks& stacks, const ItemAndCount* first, const ItemAndCount* last){
+	unsigned int n = (unsigned int)(last - first);
+	if (n > MAX_ITEMS) return false;
+	for (const ItemAndCount* i = first; i != last; ++i){
+		if (!valid(*i)) return false;
+	}
+	release(stacks);
+	if (n == 0) return true;
+	if (!reserve(stacks, n)) return false;
+	std::copy(first, last, mStacks.begin() + stacks.offset);
+	stacks.size = (unsigned short)n;
+	return true;
+}
+
+bool ItemSlab::valid(const ItemAndCount& stack){
+	return stack.item >= Item::SWORD && stack.item <= Item::ARROW && stack.count > 0;
+}
+
+bool ItemSlab::valid(const ItemStacks& stacks) const {
+	if (stacks.sizeClass == ItemStacks::NO_BLOCK) return stacks.size == 0;
+	if (stacks.sizeClass >= NUM_CLASSES || stacks.size > (1u << stacks.sizeClass)) return false;
+	if (stacks.offset > mStacks.size() || (1u << stacks.sizeClass) > mStacks.size() - stacks.offset) return false;
+	for (const ItemAndCount* i = begin(stacks); i != end(stacks); ++i){
+		if (!valid(*i)) return false;
+	}
+	return true;
+}
+
+bool ItemSlab::validFreelists() const {
+	for (int sizeClass = 0; sizeClass < NUM_CLASSES; sizeClass++){
+		// Every block is at least a stack, so a longer list has a loop
+		size_t steps = 0;
+		for (unsigned int offset = mFree[sizeClass]; offset != END; offset = (unsigned int)mStacks[offset].count){
+			if (offset > mStacks.size() || (1u << sizeClass) > mStacks.size() - offset) return false;
+			if (++steps > mStacks.size()) return false;
+		}
+	}
+	return true;
+}
+
+void ItemSlab::release(ItemStacks& stacks){
+	if (stacks.sizeClass != ItemStacks::NO_BLOCK){
+		free(stacks.offset, stacks.sizeClass);
+	}
+	stacks = ItemStacks();
+}
+
+bool ItemSlab::reserve(ItemStacks& stacks, unsigned int n){
+	if (n > MAX_ITEMS) return false;
+	if (stacks.sizeClass != ItemStacks::NO_BLOCK && n <= (1u << stacks.sizeClass)) return true;
+
+	// Move up a size class
+	int sizeClass = sizeClassFor(n);
+	unsigned int offset = allocate(sizeClass);
+	if (stacks.size > 0){
+		std::copy(mStacks.begin() + stacks.offset, mStacks.begin() + stacks.offset + stacks.size, mStacks.begin() + offset);
+	}
+	if (stacks.sizeClass != ItemStacks::NO_BLOCK){
+		free(stacks.offset, stacks.sizeClass);
+	}
+	stacks.offset = offset;
+	stacks.sizeClass = (unsigned char)sizeClass;
+	return true;
+}
+
+unsigned int ItemSlab::allocate(int sizeClass){
+	unsigned int offset = mFree[sizeClass];
+	if (offset != END){
+		// NB: The next free block is kept in the first stack's count
+		mFree[sizeClass] = (unsigned int)mStacks[offset].count;
+		return offset;
+	}
+	offset = (unsigned int)mStacks.size();
+	mStacks.resize(mStacks.size() + (1u << sizeClass));
+	return offset;
+}
+
+void ItemSlab::free(unsigned int offset, int sizeClass){
+	mStacks[offset].count = (int)mFree[sizeClass];
+	mFree[sizeClass] = offset;
+}
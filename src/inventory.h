@@ -1,8 +1,9 @@
 #ifndef INVENTORY_H
 #define INVENTORY_H
 #include "component.h"
-#include <array>
+#include <vector>
 #include <sstream>
+#include <string>
 
 static const int MAX_ITEMS = 64;
 enum Item {
@@ -14,39 +15,141 @@ enum Item {
 
 std::ostream& operator<<(std::ostream& oss, Item item);
 
+// Look up an item by the name it prints as
+bool itemFromName(const std::string& name, Item& item);
+
+struct ItemAndCount {
+	Item item;
+	int count;
+	ItemAndCount() :count(0){}
+	ItemAndCount(Item item) :item(item), count(1){}
+	ItemAndCount(Item item, int count) :item(item), count(count){}
+};
+
+// Refers to a run of item stacks in an ItemSlab
+struct ItemStacks {
+	static const unsigned char NO_BLOCK = 0xff;
+
+	unsigned int offset;
+	unsigned short size;
+	unsigned char sizeClass;
+
+	ItemStacks() :offset(0), size(0), sizeClass(NO_BLOCK){}
+};
+
+template <> struct FieldTypeOf<ItemStacks> { static const FieldType value = FieldType::Items; };
+
+// Storage for the contents of inventories
+// Blocks come in power of two size classes (1 to MAX_ITEMS stacks)
+// and freed blocks are kept on a list per class
+class ItemSlab {
+public:
+	static const int NUM_CLASSES = 7;
+	static_assert((1 << (NUM_CLASSES - 1)) == MAX_ITEMS, "size classes must reach MAX_ITEMS");
+
+	ItemSlab();
+
+	const ItemAndCount* begin(const ItemStacks& stacks) const { return mStacks.data() + stacks.offset; }
+	const ItemAndCount* end(const ItemStacks& stacks) const { return mStacks.data() + stacks.offset + stacks.size; }
+
+	// Add count items, merging into an existing stack of the same item
+	// Returns false if the inventory already holds MAX_ITEMS stacks,
+	// or count isn't positive
+	bool add(ItemStacks& stacks, Item item, int count = 1);
+
+	// Remove up to count items, returns the number removed
+	// (0 if count isn't positive)
+	int remove(ItemStacks& stacks, Item item, int count = 1);
+
+	int count(const ItemStacks& stacks, Item item) const;
+
+	// Replace the contents
+	// Returns false, leaving them as they were, if there are more than
+	// MAX_ITEMS stacks or one isn't valid
+	bool assign(ItemStacks& stacks, const ItemAndCount* first, const ItemAndCount* last);
+
+	// A known item and a positive count
+	static bool valid(const ItemAndCount& stack);
+
+	// Check stacks from outside (e.g., a file) are a block in this slab
+	// holding valid stacks
+	bool valid(const ItemStacks& stacks) const;
+
+	// Check the free lists after the raw state has been replaced
+	bool validFreelists() const;
+
+	// Give the block back
+	void release(ItemStacks& stacks);
+
+	// Raw state, for snapshots
+	std::vector<ItemAndCount>& stacks(){ return mStacks; }
+	unsigned int* freelists(){ return mFree; }
+
+protected:
+	// Make room for at least n stacks
+	bool reserve(ItemStacks& stacks, unsigned int n);
+
+	unsigned int allocate(int sizeClass);
+	void free(unsigned int offset, int sizeClass);
+
+	static const unsigned int END = ~0u;
+
+	std::vector<ItemAndCount> mStacks;
+	unsigned int mFree[NUM_CLASSES]; // first free block of each class
+};
+
 struct Inventory: public Component<Inventory> {
 	static const char* Name(){ return "Inventory"; }
 
-	struct ItemAndCount {
-		Item item;
-		int count;
-		ItemAndCount() :count(0){}
-		ItemAndCount(Item item) :item(item), count(1){}
-		ItemAndCount(Item item, int count) :item(item), count(count){}
+	using ItemAndCount = ::ItemAndCount;
 
-	};
-	std::array<ItemAndCount, MAX_ITEMS> items;
+	// The contents live in the world's ItemSlab
+	// Use Entity::inventory() to change them
+	// NB: Copying an Inventory doesn't copy its contents
+	ItemStacks stacks;
 
-	Inventory(std::initializer_list<ItemAndCount> contents = std::initializer_list<ItemAndCount>()){
-		items.fill(ItemAndCount());
-		std::copy(contents.begin(), contents.end(), items.begin());
+	static const std::vector<Field>& Fields(){
+		static const std::vector<Field> fields = { COM_FIELD(Inventory, stacks) };
+		return fields;
 	}
 
 	std::string what() {
+		std::ostringstream oss;
+		oss << "inventory {" << stacks.size << " stacks}";
+		return oss.str();
+	}
+};
+
+// Inventory and the slab its contents are stored in
+class InventoryRef {
+public:
+	InventoryRef(ItemSlab& slab, Inventory& inventory) :mSlab(slab), mInventory(inventory){}
+
+	bool add(Item item, int count = 1){ return mSlab.add(mInventory.stacks, item, count); }
+	int remove(Item item, int count = 1){ return mSlab.remove(mInventory.stacks, item, count); }
+	int count(Item item) const { return mSlab.count(mInventory.stacks, item); }
+	void clear(){ mSlab.release(mInventory.stacks); }
+
+	// Number of stacks
+	unsigned int size() const { return mInventory.stacks.size; }
+	const ItemAndCount* begin() const { return mSlab.begin(mInventory.stacks); }
+	const ItemAndCount* end() const { return mSlab.end(mInventory.stacks); }
+
+	std::string what() const {
 		std::ostringstream oss;
 		oss << "inventory {";
-		for (auto item : items){
-			if (item.count>0){
-				oss << item.item;
-				if (item.count > 1) oss << " (" << item.count << "), ";
-				else oss << ", ";
-			}
+		for (const ItemAndCount& item : *this){
+			oss << item.item;
+			if (item.count > 1) oss << " (" << item.count << "), ";
+			else oss << ", ";
 		}
 		oss << "}";
 		return oss.str();
 	}
-};
-
 
+protected:
+	ItemSlab& mSlab;
+	Inventory& mInventory;
+};
 
 #endif
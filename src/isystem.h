@@ -1,8 +1,34 @@
 #ifndef ISYSTEM_H
 #define ISYSTEM_H
 
+#include "component.h"
+#include "scratch.h"
+
 class Entity;
 class EntitySystem;
+
+// Passed to each system's update() (see EntitySystem::update() and Runner)
+struct FrameContext {
+	EntitySystem& es;
+	double dt;
+	unsigned int frame;
+
+	// A system run in staggered batches only updates batch of batches
+	// this time (see Runner::add()), it's 0 of 1 otherwise
+	unsigned int batch;
+	unsigned int batches;
+
+	// Memory that's reset at the next sync()
+	// Each worker thread gets its own, 0 is the updating thread
+	ScratchAllocator& scratch(unsigned int worker = 0) const;
+
+	// The part [first, last) of count things in this batch
+	void batchRange(unsigned int count, unsigned int& first, unsigned int& last) const {
+		first = (unsigned int)((unsigned long long)count * batch / batches);
+		last = (unsigned int)((unsigned long long)count * (batch + 1) / batches);
+	}
+};
+
 class ISystem {
 public:	
 	virtual ~ISystem(){};
@@ -11,7 +37,12 @@ public:
 	virtual bool implements(int componentIndex) = 0;
 	virtual void setup(Entity& e){};
 	virtual void cleanup(Entity& e){};
-	virtual void update(EntitySystem& es, double dt) = 0;
+	// Called once for a batch of new entities (see EntitySystem::instantiate())
+	// Calls setup() for each unless overridden
+	virtual void setupBatch(EntitySystem& es, const ID* entities, unsigned int count);
+	virtual void update(EntitySystem& es, double dt){}
+	// Calls update(es, dt) unless overridden
+	virtual void update(const FrameContext& ctx);
 	virtual const char* name() = 0;
 };
 
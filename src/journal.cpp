@@ -0,0 +1,254 @@
+#include "entity.h"
+#include <iostream>
+
+static_assert(NUM_COMPONENTS <= 256, "journals write component types as a byte");
+
+bool readJournalVarint(DeltaReader& reader, uint32_t& value){
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7){
+		uint8_t byte;
+		if (!reader.read(byte)) return false;
+		value |= (uint32_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Journal
+///////////////////////////////////////////////////////////////////////////////
+
+Journal::Journal() :mWriter(mData), mSlots(MAX_OBJECTS, Slot{ INVALID_ID, 0 }), mEntities(0), mOps(0), mWritten(0){
+	JournalHeader header;
+	std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+	header.numComponentTypes = NUM_COMPONENTS;
+	mWriter.write(header);
+	for (int type = 0; type < NUM_COMPONENTS; type++){
+		mWriter.write((uint32_t)componentFields(type).size());
+	}
+}
+
+Journal::~Journal(){
+	close();
+}
+
+bool Journal::open(const char* path){
+	mFile.open(path, std::ios::binary | std::ios::trunc);
+	if (!mFile){
+		std::cerr << "Journal: couldn't write " << path << std::endl;
+		return false;
+	}
+	flush();
+	return true;
+}
+
+void Journal::close(){
+	if (mFile.is_open()){
+		flush();
+		mFile.close();
+	}
+}
+
+void Journal::flush(){
+	if (!mFile.is_open()) return;
+	mFile.write(mData.data(), mData.size());
+	mWritten += mData.size();
+	mData.clear();
+}
+
+void Journal::writeOp(JournalOp op){
+	if (mFile.is_open() && mData.size() >= BLOCK_BYTES) flush();
+	mWriter.write((uint8_t)op);
+	mOps++;
+}
+
+void Journal::writeVarint(uint32_t value){
+	while (value >= 0x80){
+		mWriter.write((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	mWriter.write((uint8_t)value);
+}
+
+void Journal::writeFields(EntitySystem& es, int type, const void* component){
+	for (const Field& f : componentFields(type)){
+		writeDeltaField(mWriter, f, (const char*)component, es);
+	}
+}
+
+uint32_t Journal::entity(ID id){
+	Slot& slot = mSlots[id & INDEX_MASK];
+	if (slot.id != id){
+		// Came from something that isn't recorded
+		created(id);
+	}
+	return slot.number;
+}
+
+void Journal::created(ID entity){
+	writeOp(JournalOp::Create);
+	mSlots[entity & INDEX_MASK] = Slot{ entity, mEntities++ };
+}
+
+void Journal::instantiated(EntitySystem& es, const Prefab& prefab, const ID* entities, unsigned int count){
+	// Every instance starts out the same, so only the first is written
+	Entity& first = es.lookup(entities[0]);
+	uint32_t numTypes = 0;
+	for (int type = 0; type < NUM_COMPONENTS; type++){
+		if (prefab.has(type)) numTypes++;
+	}
+	writeOp(JournalOp::Instantiate);
+	writeVarint(count);
+	writeVarint(numTypes);
+	for (int type = 0; type < NUM_COMPONENTS; type++){
+		if (!prefab.has(type)) continue;
+		mWriter.write((uint8_t)type);
+		writeFields(es, type, first.getComponent(type));
+	}
+	for (unsigned int i = 0; i < count; i++){
+		mSlots[entities[i] & INDEX_MASK] = Slot{ entities[i], mEntities++ };
+	}
+}
+
+void Journal::added(EntitySystem& es, ID entity, int type, const void* component){
+	if (type >= NUM_COMPONENTS) return;
+	uint32_t number = this->entity(entity);
+	writeOp(JournalOp::AddComponent);
+	writeVarint(number);
+	mWriter.write((uint8_t)type);
+	writeFields(es, type, component);
+}
+
+void Journal::removedComponent(ID entity, int type, bool immediately){
+	if (type >= NUM_COMPONENTS) return;
+	uint32_t number = this->entity(entity);
+	writeOp(immediately ? JournalOp::RemoveComponentNow : JournalOp::RemoveComponent);
+	writeVarint(number);
+	mWriter.write((uint8_t)type);
+}
+
+void Journal::removed(ID entity){
+	uint32_t number = this->entity(entity);
+	writeOp(JournalOp::Remove);
+	writeVarint(number);
+}
+
+void Journal::synced(){
+	writeOp(JournalOp::Sync);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// JournalReplay
+///////////////////////////////////////////////////////////////////////////////
+
+bool JournalReplay::parse(std::vector<char>& data){
+	mData.swap(data);
+	mStart = 0;
+	rewind();
+
+	DeltaReader reader(mData.data(), mData.size());
+	JournalHeader header;
+	if (!reader.read(header) || std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0) return false;
+	if (header.numComponentTypes != NUM_COMPONENTS) return false;
+	for (int type = 0; type < NUM_COMPONENTS; type++){
+		uint32_t numFields;
+		if (!reader.read(numFields) || numFields != componentFields(type).size()) return false;
+	}
+	mStart = reader.offset();
+	rewind();
+	return true;
+}
+
+void JournalReplay::rewind(){
+	mOffset = mStart;
+	mEntities.clear();
+	mFrames = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// EntitySystem
+///////////////////////////////////////////////////////////////////////////////
+
+bool EntitySystem::replay(JournalReplay& journal, unsigned int frames){
+	DeltaReader reader(journal.data() + journal.offset(), journal.size() - journal.offset());
+	std::vector<ID>& entities = journal.entities();
+	unsigned int synced = 0;
+	bool ok = true;
+	while (ok && synced < frames && !reader.done()){
+		uint8_t op;
+		if (!reader.read(op)){
+			ok = false;
+			break;
+		}
+		switch ((JournalOp)op){
+		case JournalOp::Create:
+			entities.push_back(create().id);
+			break;
+
+		case JournalOp::Instantiate: {
+			uint32_t count, numTypes;
+			ok = readJournalVarint(reader, count) && readJournalVarint(reader, numTypes);
+			Prefab prefab("journal");
+			for (uint32_t i = 0; ok && i < numTypes; i++){
+				uint8_t type;
+				ok = reader.read(type) && type < NUM_COMPONENTS &&
+					replayComponentArrays(reader, JournalOp::Instantiate, lookup(INVALID_ID), &prefab, type, 0, ComponentTypeList());
+			}
+			size_t first = entities.size();
+			if (ok && !instantiate(prefab, count, entities)){
+				// Numbered all the same, but ops on them will fail
+				entities.resize(first + count, INVALID_ID);
+			}
+			break;
+		}
+
+		case JournalOp::AddComponent:
+		case JournalOp::RemoveComponent:
+		case JournalOp::RemoveComponentNow: {
+			uint32_t number;
+			uint8_t type;
+			ok = readJournalVarint(reader, number) && reader.read(type) && number < entities.size() &&
+				has(entities[number]) && type < NUM_COMPONENTS &&
+				replayComponentArrays(reader, (JournalOp)op, lookup(entities[number]), nullptr, type, 0, ComponentTypeList());
+			break;
+		}
+
+		case JournalOp::Remove: {
+			uint32_t number;
+			ok = readJournalVarint(reader, number) && number < entities.size() && has(entities[number]);
+			if (ok) remove(entities[number]);
+			break;
+		}
+
+		case JournalOp::Sync:
+			sync();
+			synced++;
+			break;
+
+		default:
+			ok = false;
+		}
+	}
+
+	if (!ok){
+		std::cerr << "EntitySystem: journal is malformed at byte " << journal.offset() + reader.offset() << std::endl;
+		journal.setOffset(journal.size());
+	}
+	else {
+		journal.setOffset(journal.offset() + reader.offset());
+	}
+	journal.setFrames(journal.frames() + synced);
+	return ok;
+}
+
+bool EntitySystem::readPrefabComponent(DeltaReader& reader, Prefab& prefab, Inventory*){
+	// The items go in the prefab's list rather than this world's slab
+	Inventory inventory;
+	if (!readDeltaField(reader, Inventory::Fields()[0], (char*)&inventory, *this)) return false;
+	prefab.add(Inventory());
+	for (const ItemAndCount* ic = mItems.begin(inventory.stacks); ic != mItems.end(inventory.stacks); ++ic){
+		prefab.addItem(ic->item, ic->count);
+	}
+	mItems.release(inventory.stacks);
+	return true;
+}
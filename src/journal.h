@@ -0,0 +1,160 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+#include "component.h"
+#include "delta.h"
+
+// Command journals (see EntitySystem::setJournal() and replay())
+//
+// Layout:
+//   JournalHeader
+//   uint32 numFields[numComponentTypes]  (to catch mismatched builds)
+//   ops, each a uint8 JournalOp and then:
+//     Create:             nothing, the entity is the next one
+//     Instantiate:        count, numTypes, then numTypes of: uint8 type, the fields of the first instance
+//     AddComponent:       entity, uint8 type, the fields
+//     RemoveComponent:    entity, uint8 type
+//     RemoveComponentNow: entity, uint8 type
+//     Remove:             entity
+//     Sync:               nothing
+//
+// Counts and entities are varints (7 bits a byte, low first). Entities
+// are numbered in the order they were created, from 0, so a journal
+// replays the same on any world whatever ids it hands out. Fields are
+// written like delta snapshots (see delta.h), so String, Items and
+// Shared fields don't depend on the world that wrote them.
+//
+// Only structural changes are recorded, e.g., get<Transform>().x = 1
+// and changes to an Inventory's items aren't. An entity the journal
+// hasn't seen, like one from load() or integratePartition(), is recorded
+// as created the first time it's used. Runtime component types aren't recorded.
+
+static const char JOURNAL_MAGIC[4] = { 'E', 'C', 'S', 'J' };
+
+struct JournalHeader {
+	char magic[4];
+	uint32_t numComponentTypes;
+};
+
+enum class JournalOp : uint8_t {
+	Create,
+	Instantiate,
+	AddComponent,
+	RemoveComponent,
+	RemoveComponentNow,
+	Remove,
+	Sync
+};
+
+class EntitySystem;
+class Prefab;
+
+// Records what's done to a world, e.g., in production, to replay
+// offline against different storage (see bench/replay.cpp)
+//
+//   Journal journal;
+//   journal.open("session.journal");
+//   es.setJournal(&journal);
+//
+// Ops are kept in memory, or appended to the file in blocks once open()ed
+// Start recording on an empty world, as entities that are already
+// there are replayed without their components
+class Journal {
+public:
+	Journal();
+
+	// Writes out what's left
+	~Journal();
+
+	// Append ops to a file rather than keeping them in memory
+	// Returns false if it can't be written
+	bool open(const char* path);
+	void close();
+
+	// The journal so far, when it isn't being written to a file
+	const std::vector<char>& data() const { return mData; }
+
+	// Ops and bytes recorded so far, including ones already written out
+	unsigned int ops() const { return mOps; }
+	size_t bytes() const { return mWritten + mData.size(); }
+
+	// Called by EntitySystem and Entity
+	void created(ID entity);
+	void instantiated(EntitySystem& es, const Prefab& prefab, const ID* entities, unsigned int count);
+	void added(EntitySystem& es, ID entity, int type, const void* component);
+	void removedComponent(ID entity, int type, bool immediately);
+	void removed(ID entity);
+	void synced();
+
+protected:
+	Journal(const Journal&) = delete;
+	Journal& operator=(const Journal&) = delete;
+
+	// Number of the entity, recording it as created if it's new
+	uint32_t entity(ID id);
+	void writeOp(JournalOp op);
+	void writeVarint(uint32_t value);
+	void writeFields(EntitySystem& es, int type, const void* component);
+	void flush();
+
+	struct Slot {
+		ID id;
+		uint32_t number;
+	};
+
+	static const int MAX_OBJECTS = 0x10000;
+	static const int INDEX_MASK = 0xffff;
+	static const size_t BLOCK_BYTES = 1 << 20; // written out at a time
+
+	std::vector<char> mData;
+	DeltaWriter mWriter;
+	std::vector<Slot> mSlots; // by id & INDEX_MASK
+	uint32_t mEntities;
+	unsigned int mOps;
+	std::ofstream mFile;
+	size_t mWritten;
+};
+
+// A journal checked and ready to replay a frame at a time
+// (see EntitySystem::replay())
+class JournalReplay {
+public:
+	JournalReplay() :mStart(0), mOffset(0), mFrames(0){}
+
+	// Returns false if it isn't a journal from this build
+	bool parse(std::vector<char>& data);
+
+	const char* data() const { return mData.data(); }
+	size_t size() const { return mData.size(); }
+
+	// Where replay() carries on from
+	size_t offset() const { return mOffset; }
+	void setOffset(size_t offset){ mOffset = offset; }
+	bool done() const { return mOffset == mData.size(); }
+
+	// Ids in the replaying world by entity number
+	std::vector<ID>& entities(){ return mEntities; }
+
+	// Sync ops replayed
+	unsigned int frames() const { return mFrames; }
+	void setFrames(unsigned int frames){ mFrames = frames; }
+
+	// Back to the start, e.g., to replay it into another world
+	void rewind();
+
+protected:
+	std::vector<char> mData;
+	size_t mStart; // of the ops
+	size_t mOffset;
+	std::vector<ID> mEntities;
+	unsigned int mFrames;
+};
+
+// Varints as Journal writes them
+bool readJournalVarint(DeltaReader& reader, uint32_t& value);
+
+#endif
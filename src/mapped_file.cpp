@@ -0,0 +1,94 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() :mData(nullptr), mSize(0), mFile(INVALID_HANDLE_VALUE), mMapping(nullptr){}
+
+bool MappedFile::open(const char* path){
+	close();
+	mFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0){
+		close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping == nullptr){
+		close();
+		return false;
+	}
+
+	mData = (const char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (mData == nullptr){
+		close();
+		return false;
+	}
+	mSize = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::close(){
+	if (mData) UnmapViewOfFile(mData);
+	if (mMapping) CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+	mData = nullptr;
+	mSize = 0;
+	mMapping = nullptr;
+	mFile = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() :mData(nullptr), mSize(0), mFile(-1){}
+
+bool MappedFile::open(const char* path){
+	close();
+	mFile = ::open(path, O_RDONLY);
+	if (mFile < 0) return false;
+
+	struct stat st;
+	if (fstat(mFile, &st) != 0 || st.st_size == 0){
+		close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (data == MAP_FAILED){
+		close();
+		return false;
+	}
+
+	// We read the whole thing front to back
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	mData = (const char*)data;
+	mSize = (size_t)st.st_size;
+	return true;
+}
+
+void MappedFile::close(){
+	if (mData) munmap((void*)mData, mSize);
+	if (mFile >= 0) ::close(mFile);
+	mData = nullptr;
+	mSize = 0;
+	mFile = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile(){
+	close();
+}
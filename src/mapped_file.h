@@ -0,0 +1,37 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+// A read-only memory mapped file
+// Pages are brought in by the OS on demand, so opening 
+// a large file is cheap and reading it doesn't go through
+// an intermediate buffer
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char* path);
+	void close();
+
+	bool isOpen() const { return mData != nullptr; }
+	const char* data() const { return mData; }
+	size_t size() const { return mSize; }
+
+protected:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const char* mData;
+	size_t mSize;
+
+#ifdef _WIN32
+	void* mFile;
+	void* mMapping;
+#else
+	int mFile;
+#endif
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "migration.h"
+#include <iostream>
+#include <unordered_set>
+
+///////////////////////////////////////////////////////////////////////////////
+// CarriedState
+///////////////////////////////////////////////////////////////////////////////
+
+CarriedState::~CarriedState(){
+	for (Value& v : mValues){
+		const ComponentType& type = *runtimeComponentType(v.type);
+		if (type.destroy) type.destroy(v.value);
+		Allocator::heap()->deallocate(v.value, type.size);
+	}
+}
+
+void CarriedState::gather(EntitySystem& from, const std::vector<ID>& entities){
+	for (uint32_t i = 0; i < entities.size(); i++){
+		size_t firstTimer = mTimers.size();
+		from.timers().timersOf(entities[i], mTimers);
+		for (size_t t = firstTimer; t < mTimers.size(); t++) mTimers[t].entity = i;
+
+		Entity& e = from.lookup(entities[i]);
+		for (int type = NUM_COMPONENTS; type < numComponentTypes(); type++){
+			const void* value = e.getComponent(type);
+			if (!value) continue;
+			const ComponentType& ct = *runtimeComponentType(type);
+			void* copy = Allocator::heap()->allocate(ct.size, ct.alignment);
+			if (ct.copy) ct.copy(copy, value);
+			else std::memcpy(copy, value, ct.size);
+			mValues.push_back(Value{ i, type, copy });
+		}
+	}
+}
+
+void CarriedState::restore(EntitySystem& to, unsigned int first, unsigned int count, const ID* ids){
+	unsigned int end = first + count;
+	for (; mNextTimer < mTimers.size() && mTimers[mNextTimer].entity < end; mNextTimer++){
+		const PendingTimer& t = mTimers[mNextTimer];
+		to.timers().add(ids[t.entity - first], t.event, t.ticks);
+	}
+	for (; mNextValue < mValues.size() && mValues[mNextValue].entity < end; mNextValue++){
+		const Value& v = mValues[mNextValue];
+		to.lookup(ids[v.entity - first]).addComponent(v.type, v.value);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// MigrationQueue
+///////////////////////////////////////////////////////////////////////////////
+
+MigrationQueue::MigrationQueue(EntitySystem& to) :mTo(to), mPending(0){}
+
+void MigrationQueue::send(EntitySystem& from, const std::vector<ID>& entities){
+	assert(&from != &mTo);
+	std::vector<ID> alive;
+	from.liveEntities(entities, alive);
+	if (alive.empty()) return;
+
+	// Packing doesn't touch the destination, and nor does parsing
+	std::vector<char> bytes;
+	from.savePartition(alive, bytes);
+	std::unique_ptr<Batch> batch(new Batch());
+	batch->data.parse(bytes);
+	batch->carried.gather(from, alive);
+	for (ID id : alive) from.remove(id);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mSent.push_back(std::move(batch));
+	mPending += (unsigned int)alive.size();
+}
+
+unsigned int MigrationQueue::receive(unsigned int budget){
+	mArrived.clear();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (auto& batch : mSent) mReceiving.push_back(std::move(batch));
+		mSent.clear();
+	}
+
+	unsigned int added = 0, lost = 0;
+	unsigned int left = budget ? budget : UINT_MAX;
+	while (!mReceiving.empty() && left > 0){
+		PartitionData& data = mReceiving.front()->data;
+		unsigned int first = data.integrated();
+		mIds.clear();
+		mTo.integratePartition(data, left, mIds);
+		bool malformed = false;
+		if (data.integrated() == first && !data.done()){
+			// No room, try again next time
+			if (data.valid()) break;
+			// It would never go in, so it's dropped
+			malformed = true;
+		}
+
+		mReceiving.front()->carried.restore(mTo, first, (unsigned int)mIds.size(), mIds.data());
+		for (size_t i = 0; i < mIds.size(); i++){
+			mArrived.push_back(MigratedEntity{ data.saved()[first + i], mIds[i] });
+		}
+		added += (unsigned int)mIds.size();
+		left -= (unsigned int)mIds.size();
+		if (malformed) lost += data.numEntities() - data.integrated();
+		if (data.done() || malformed) mReceiving.pop_front();
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mPending -= added + lost;
+	return added;
+}
+
+unsigned int MigrationQueue::pending(){
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPending;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// EntitySystem
+///////////////////////////////////////////////////////////////////////////////
+
+void EntitySystem::adoptFields(EntitySystem& from, char* record, const std::vector<Field>& fields){
+	for (const Field& f : fields){
+		if (f.type == FieldType::Items){
+			ItemStacks src, dst;
+			std::memcpy(&src, record + f.offset, sizeof(src));
+			mItems.assign(dst, from.mItems.begin(src), from.mItems.end(src));
+			std::memcpy(record + f.offset, &dst, sizeof(dst));
+		}
+		else if (f.type == FieldType::Shared){
+			unsigned int handle;
+			std::memcpy(&handle, record + f.offset, sizeof(handle));
+			if (handle){
+				SharedPoolBase* pool = from.sharedPool(f.shared);
+				std::vector<char> value(pool->value(handle), pool->value(handle) + pool->valueSize());
+				adoptFields(from, value.data(), pool->fields());
+				handle = sharedPool(f.shared)->acquireRaw(value.data());
+			}
+			std::memcpy(record + f.offset, &handle, sizeof(handle));
+		}
+	}
+}
+
+bool EntitySystem::migrate(const std::vector<ID>& entities, EntitySystem& to, std::vector<ID>& ids){
+	if (&to == this){
+		ids.insert(ids.end(), entities.begin(), entities.end());
+		return true;
+	}
+
+	std::vector<ID> alive;
+	liveEntities(entities, alive);
+	unsigned int count = (unsigned int)alive.size();
+
+	std::vector<unsigned int> counts(NUM_COMPONENTS, 0);
+	for (ID id : alive){
+		Entity& e = mEntities.lookup(id);
+		for (int type = 0; type < NUM_COMPONENTS; type++){
+			if (e.mHasComponent[type]) counts[type]++;
+		}
+	}
+	bool room = to.mEntities.size() + count <= MAX_ENTITIES;
+	for (int type = 0; type < NUM_COMPONENTS; type++){
+		room = room && to.mComponents[type]->numObjects() + counts[type] <= MAX_ENTITIES;
+	}
+	if (!room){
+		std::cerr << "EntitySystem: no room to migrate " << count << " entities" << std::endl;
+		return false;
+	}
+
+	std::vector<ID> moved;
+	moved.reserve(count);
+	if (count){
+		Entity proto(&to);
+		proto.clear();
+		unsigned int block = to.mEntities.add(proto, count);
+		Entity* targets = &to.mEntities.objects().get(block);
+		for (unsigned int i = 0; i < count; i++){
+			moved.push_back(targets[i].id);
+		}
+		to.mChanges.created += count;
+		migrateComponentArrays(to, alive, block, counts, ComponentTypeList());
+
+		for (ISystem* sys : to.mSystems){
+			for (int type = 0; type < NUM_COMPONENTS; type++){
+				if (counts[type] && sys->implements(type)){
+					sys->setupBatch(to, moved.data(), count);
+					break;
+				}
+			}
+		}
+	}
+	CarriedState carried;
+	carried.gather(*this, alive);
+	carried.restore(to, 0, count, moved.data());
+
+	// Gone now rather than at the next sync(), the journal still
+	// records a remove(), which comes to the same after a sync()
+	if (mJournal){
+		for (ID id : alive) mJournal->removed(id);
+	}
+	removeEntities(alive);
+
+	// In the order they were given
+	size_t next = 0;
+	for (ID id : entities){
+		bool wasAlive = next < alive.size() && alive[next] == id;
+		ids.push_back(wasAlive ? moved[next++] : INVALID_ID);
+	}
+	return true;
+}
+
+void EntitySystem::liveEntities(const std::vector<ID>& entities, std::vector<ID>& live){
+	// Each one taken goes in here too, so it isn't taken again
+	std::unordered_set<ID> skip(mEntitiesToBeRemoved.begin(), mEntitiesToBeRemoved.end());
+	live.reserve(live.size() + entities.size());
+	for (ID id : entities){
+		if (has(id) && skip.insert(id).second) live.push_back(id);
+	}
+}
+
+ID EntitySystem::migrate(ID entity, EntitySystem& to){
+	std::vector<ID> ids;
+	migrate(std::vector<ID>(1, entity), to, ids);
+	return ids.empty() ? INVALID_ID : ids[0];
+}
@@ -0,0 +1,117 @@
+#ifndef MIGRATION_H
+#define MIGRATION_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "entity.h"
+
+// An entity that came in from another world, and its id there
+struct MigratedEntity {
+	ID from;
+	ID entity;
+};
+
+// What partitions don't hold, the timers and runtime components of
+// entities, so they can go with them (see migrate() and MigrationQueue)
+// Gathered from the world they leave and given back as they're added to
+// the next, a range at a time. Values are copied with their type's hooks
+class CarriedState {
+public:
+	CarriedState() :mNextTimer(0), mNextValue(0){}
+	~CarriedState();
+
+	// Copy what the entities have, numbering them by position
+	void gather(EntitySystem& from, const std::vector<ID>& entities);
+
+	// Give entities [first, first + count) theirs, now they're ids in to
+	// PRE: Ranges come in order, like integratePartition() adds them
+	void restore(EntitySystem& to, unsigned int first, unsigned int count, const ID* ids);
+
+protected:
+	CarriedState(const CarriedState&) = delete;
+	CarriedState& operator=(const CarriedState&) = delete;
+
+	struct Value {
+		uint32_t entity; // number
+		int type;
+		void* value;
+	};
+
+	// In entity number order
+	std::vector<PendingTimer> mTimers; // entity is the number
+	std::vector<Value> mValues;
+	size_t mNextTimer;
+	size_t mNextValue;
+};
+
+// Entities on their way into a world from other worlds, e.g., with a
+// world per zone, each stepped on its own thread
+//
+// send() packs up entities on the thread stepping their world, and they
+// are removed from it at its next sync(), so its systems get cleanup() as
+// usual. receive() adds them on the thread stepping this queue's world,
+// in one block per batch like instantiate(), so its systems get setupBatch().
+// Neither thread touches the other's world, so they don't have to wait
+// for each other.
+//
+//   MigrationQueue toB(b);
+//   // zone A's thread
+//   toB.send(a, leaving);
+//   a.sync();
+//   // zone B's thread
+//   toB.receive();
+//   for (const MigratedEntity& m : toB.arrived()) ...
+//   b.sync();
+//
+// Components travel like partitions (see partition.h), so Inventory
+// contents and Shared values are copied into the new world's slab and pools.
+// Timers go with the ticks they had left when sent, and runtime
+// components are copied (see CarriedState)
+// NB: The entity is still in its old world until that world's sync()
+class MigrationQueue {
+public:
+	explicit MigrationQueue(EntitySystem& to);
+
+	// Pack up the entities of from and remove them at its next sync()
+	// Dead ones, ones already being removed and repeats are skipped
+	// PRE: Called by the thread stepping from, and from isn't this queue's world
+	void send(EntitySystem& from, const std::vector<ID>& entities);
+
+	// Add what's been sent, at most budget entities (0 for no limit)
+	// A batch that doesn't fit waits for the next call
+	// PRE: Called by the thread stepping this queue's world
+	// Returns the number added
+	unsigned int receive(unsigned int budget = 0);
+
+	// The entities added by the last receive()
+	const std::vector<MigratedEntity>& arrived() const { return mArrived; }
+
+	// Entities sent but not added yet
+	unsigned int pending();
+
+	EntitySystem& world(){ return mTo; }
+
+protected:
+	MigrationQueue(const MigrationQueue&) = delete;
+	MigrationQueue& operator=(const MigrationQueue&) = delete;
+
+	struct Batch {
+		PartitionData data;
+		CarriedState carried;
+	};
+
+	EntitySystem& mTo;
+	std::deque<std::unique_ptr<Batch>> mReceiving; // only touched by receive()
+	std::vector<MigratedEntity> mArrived;
+	std::vector<ID> mIds;
+
+	// Shared with the sending threads
+	std::mutex mMutex;
+	std::vector<std::unique_ptr<Batch>> mSent;
+	unsigned int mPending;
+};
+
+#endif
@@ -4,26 +4,46 @@
 #include <climits>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
+#include <type_traits>
 
 #include "component.h"
+#include "allocator.h"
 
 // A simple resizable array for PODs
 // Unlike vector() doesn't initialise until it wants to
+// Storage comes from an Allocator (see allocator.h) and starts zeroed
 template <typename T>
 class StaticArray {
 public:
+	explicit StaticArray(Allocator* allocator = nullptr)
+		:mAllocator(allocator ? allocator : Allocator::heap()), mData(nullptr), mBytes(0){}
+
+	~StaticArray(){
+		if (mData) mAllocator->deallocate(mData, mBytes);
+	}
+
 	void accommodate(unsigned int size){
-		mData.resize(size * sizeof(T));
+		size_t bytes = (size_t)size * sizeof(T);
+		if (bytes == mBytes) return;
+		char* data = (char*)mAllocator->allocate(bytes, ALIGNMENT);
+		assert(data != nullptr);
+		if (mData){
+			std::memcpy(data, mData, bytes < mBytes ? bytes : mBytes);
+			mAllocator->deallocate(mData, mBytes);
+		}
+		mData = data;
+		mBytes = bytes;
 	}
 
 	T& get(unsigned int index){
-		assert(index*sizeof(T) < mData.size());
+		assert(index*sizeof(T) < mBytes);
 		return *(T*)&mData[index * sizeof(T)];
 	}
 
 	void set(unsigned int index, const T& t){
-		assert(index*sizeof(T) < mData.size());
+		assert(index*sizeof(T) < mBytes);
 		// Call the copy constructor to initialise everything
 		// ((T*)&mData[index * sizeof(T)])->T(t); 
 
@@ -35,21 +55,80 @@ public:
 	}
 
 	unsigned int capacity() const {
-		return (unsigned int)(mData.size() / sizeof(T));
+		return (unsigned int)(mBytes / sizeof(T));
 	}
 
 	// Number of bytes used by this array
 	unsigned int bytes() const {
-		return (unsigned int)mData.size();
+		return (unsigned int)mBytes;
+	}
+
+	// Raw storage, for bulk copies
+	char* data(){
+		return mData;
+	}
+
+	// Give the pages in [offset, offset + bytes) back to the OS
+	// They read as zero afterwards, returns the bytes released
+	size_t decommit(size_t offset, size_t bytes){
+		assert(offset + bytes <= mBytes);
+		return mAllocator->decommit(mData + offset, bytes);
+	}
+
+	Allocator* allocator(){
+		return mAllocator;
 	}
 
 protected:
-	std::vector<char> mData; // just some bytes 
+	StaticArray(const StaticArray&) = delete;
+	StaticArray& operator=(const StaticArray&) = delete;
+
+	static const size_t ALIGNMENT = 64;
+
+	Allocator* mAllocator;
+	char* mData; // just some bytes 
+	size_t mBytes;
 };
 
+// Copy src over dst a page at a time, skipping pages that are already the same
+// Restoring a recent copy of an array then only writes what changed
+// Returns the number of bytes written
+inline size_t copyChangedPages(void* dst, const void* src, size_t bytes){
+	static const size_t PAGE_SIZE = 4096;
+	char* d = (char*)dst;
+	const char* s = (const char*)src;
+	size_t written = 0;
+	for (size_t offset = 0; offset < bytes; offset += PAGE_SIZE){
+		size_t n = (bytes - offset < PAGE_SIZE) ? (bytes - offset) : PAGE_SIZE;
+		if (std::memcmp(d + offset, s + offset, n) != 0){
+			std::memcpy(d + offset, s + offset, n);
+			written += n;
+		}
+	}
+	return written;
+}
+
 class PackedArrayBase {
 public:
 	virtual ~PackedArrayBase(){}
+
+	// sizeof() the concrete array, to give its memory back
+	virtual size_t sizeOf() const = 0;
+
+	// See PackedArray
+	virtual size_t releaseUnusedPages(size_t budget) = 0;
+	virtual void renumberFreelist() = 0;
+	virtual unsigned int numObjects() = 0;
+	virtual unsigned int position(ID id) = 0;
+	virtual void swapObjects(unsigned int a, unsigned int b) = 0;
+
+	// The object with this id, or nullptr
+	virtual void* object(ID id) = 0;
+
+	// Raw storage, object i is at data() + i * stride()
+	// Components start with their id then their entity
+	virtual char* data() = 0;
+	virtual unsigned int stride() const = 0;
 };
 
 // PackedArray: stores things in a static array 
@@ -60,7 +139,7 @@ public:
 template <typename T>
 class PackedArray : public PackedArrayBase {
 public:
-	PackedArray(){
+	explicit PackedArray(Allocator* allocator = nullptr) :mHighWater(0), mObjects(allocator){
 		mObjects.accommodate(MAX_OBJECTS);
 		clear();
 	}
@@ -69,6 +148,10 @@ public:
 
 	}
 
+	size_t sizeOf() const override {
+		return sizeof(PackedArray<T>);
+	}
+
 	bool has(ID id) {
 		Index &in = mIndices[id & INDEX_MASK];
 		return in.id == id && in.index != USHRT_MAX;
@@ -78,14 +161,28 @@ public:
 		return mObjects.get(mIndices[id&INDEX_MASK].index);
 	}
 
+	void* object(ID id) override {
+		return has(id) ? &lookup(id) : nullptr;
+	}
+
+	char* data() override {
+		return mObjects.data();
+	}
+
+	unsigned int stride() const override {
+		return sizeof(T);
+	}
+
 	// Add a new object 
 	// by optionally copying a prototype
 	ID add(const T& proto = T()) {
+		repairFreelist();
 		Index &in = mIndices[mFreelistDequeue];
 		mFreelistDequeue = in.next;
 		// NB: id is now incremented on entity removal
 		// in.id += NEW_OBJECT_ID_ADD;		
 		in.index = mNumObjects++;
+		updateHighWater();
 		mObjects.set(in.index, proto);
 		T &o = mObjects.get(in.index);
 		// TODO: Do we need to call reset?
@@ -96,6 +193,74 @@ public:
 		return o.id;
 	}
 
+	// Add count copies of a prototype in one go
+	// They're stored contiguously, returns the index of the first
+	// PRE: there's room for them
+	unsigned int add(const T& proto, unsigned int count) {
+		repairFreelist();
+		unsigned int first = mNumObjects;
+		assert(first + count < MAX_OBJECTS);
+		if (count == 0) return first;
+
+		if (std::is_trivially_copyable<T>::value){
+			// Copy the prototype once, then keep doubling what's been copied
+			mObjects.set(first, proto);
+			char* base = (char*)&mObjects.get(first);
+			for (unsigned int n = 1; n < count; n *= 2){
+				unsigned int m = (count - n < n) ? count - n : n;
+				std::memcpy(base + n * sizeof(T), base, m * sizeof(T));
+			}
+		}
+		else {
+			for (unsigned int i = 0; i < count; i++){
+				mObjects.set(first + i, proto);
+			}
+		}
+
+		for (unsigned int i = 0; i < count; i++){
+			Index &in = mIndices[mFreelistDequeue];
+			mFreelistDequeue = in.next;
+			in.index = mNumObjects++;
+			mObjects.get(in.index).id = in.id;
+		}
+		updateHighWater();
+		return first;
+	}
+
+	// Slot an id is stored in, the same for all its generations
+	static unsigned int slot(ID id){
+		return id & INDEX_MASK;
+	}
+
+	// Whether any generation is in a slot, i.e., insert() would fail
+	bool slotInUse(unsigned int slot){
+		return mIndices[slot].index != USHRT_MAX;
+	}
+
+	// Id of the object in a slot
+	// PRE: slotInUse(slot)
+	ID slotId(unsigned int slot){
+		return mIndices[slot].id;
+	}
+
+	// Add an object with a specific id 
+	// (e.g., one replicated from another array)
+	// Returns INVALID_ID if the slot is in use
+	ID insert(ID id, const T& proto = T()) {
+		Index &in = mIndices[id&INDEX_MASK];
+		if (in.index != USHRT_MAX) return INVALID_ID;
+		in.id = id;
+		in.index = mNumObjects++;
+		updateHighWater();
+		mObjects.set(in.index, proto);
+		T &o = mObjects.get(in.index);
+		o.id = id;
+		// The slot was taken from the middle of the freelist
+		// so it gets relinked before the next add()
+		mFreelistDirty = true;
+		return id;
+	}
+
 	// Remove an object from this packed array
 	// TODO: Don't forget to cleanup object from its systems
 	// // this->cleanup(id);
@@ -107,7 +272,12 @@ public:
 		// NB: struct copy here
 		// Copy object from end to here
 		// TODO: Should do a move instead?
-		o = mObjects.get(mNumObjects - 1);
+		// The last object doesn't move, and its id may have been
+		// cleared (e.g., by Entity::clear()) so isn't looked up
+		if (in.index != mNumObjects - 1){
+			o = mObjects.get(mNumObjects - 1);
+			mIndices[o.id&INDEX_MASK].index = in.index;
+		}
 		// Call destructor of object at end
 		// Just in case it needs to clean up
 
@@ -115,7 +285,6 @@ public:
 		mObjects.get(mNumObjects - 1).~T();
 		mNumObjects--;
 
-		mIndices[o.id&INDEX_MASK].index = in.index;
 		in.index = USHRT_MAX;
 		mIndices[mFreelistEnqueue].next = id&INDEX_MASK;
 		mFreelistEnqueue = id&INDEX_MASK;
@@ -129,6 +298,164 @@ public:
 		return mNumObjects;
 	}
 
+	unsigned int numObjects() override {
+		return mNumObjects;
+	}
+
+	// Where id is in objects(), or UINT_MAX if it isn't there
+	unsigned int position(ID id) override {
+		return has(id) ? mIndices[id & INDEX_MASK].index : UINT_MAX;
+	}
+
+	// Swap two objects and fix up their indices, e.g., to sort them
+	// Ids stay the same
+	void swapObjects(unsigned int a, unsigned int b) override {
+		assert(a < mNumObjects && b < mNumObjects);
+		if (a == b) return;
+		T& oa = mObjects.get(a);
+		T& ob = mObjects.get(b);
+		T tmp = oa;
+		oa = ob;
+		ob = tmp;
+		mIndices[oa.id & INDEX_MASK].index = (uint16)a;
+		mIndices[ob.id & INDEX_MASK].index = (uint16)b;
+	}
+
+	// Most objects held at once since the last releaseUnusedPages()
+	// i.e., how much of objects() has been written
+	unsigned int highWater() const {
+		return mHighWater;
+	}
+
+	// Number of unused slots on the freelist
+	unsigned int freeSlots() const {
+		return MAX_OBJECTS - mNumObjects;
+	}
+
+	// Bulk access to the index table and freelist
+	// They are plain data so can be saved and restored as a block
+	// (e.g., by snapshots) without replaying add()/remove()
+	const void* indexData() const {
+		return mIndices;
+	}
+
+	static unsigned int indexBytes(){
+		return sizeof(Index) * MAX_OBJECTS;
+	}
+
+	static unsigned int maxObjects(){
+		return MAX_OBJECTS;
+	}
+
+	// Check an index table and freelist from outside (e.g., a file)
+	// before restore()ing them, so they can't point past the objects
+	static bool validIndices(unsigned int numObjects, const void* indices, unsigned int enqueue, unsigned int dequeue){
+		if (numObjects > MAX_OBJECTS || enqueue >= MAX_OBJECTS || dequeue >= MAX_OBJECTS) return false;
+		const Index* in = (const Index*)indices;
+		std::vector<bool> used(numObjects, false);
+		unsigned int live = 0;
+		for (int i = 0; i < MAX_OBJECTS; ++i) {
+			if (in[i].index == USHRT_MAX) continue;
+			if (in[i].index >= numObjects || used[in[i].index]) return false;
+			used[in[i].index] = true;
+			live++;
+		}
+		if (live != numObjects) return false;
+		if (numObjects == MAX_OBJECTS) return true;
+
+		// add() walks the freelist from dequeue, so it must run through
+		// every free slot, each once, and end at enqueue
+		std::vector<bool> linked(MAX_OBJECTS, false);
+		unsigned int i = dequeue, numLinked = 0;
+		for (;;){
+			if (in[i].index != USHRT_MAX || linked[i]) return false;
+			linked[i] = true;
+			numLinked++;
+			if (i == enqueue) break;
+			i = in[i].next;
+		}
+		return numLinked == MAX_OBJECTS - numObjects;
+	}
+
+	unsigned int freelistEnqueue() const { return mFreelistEnqueue; }
+	unsigned int freelistDequeue() const { return mFreelistDequeue; }
+
+	// Copy the index table and freelist of another array
+	// Returns the number of bytes written
+	size_t copyIndicesFrom(PackedArray<T>& other){
+		mNumObjects = other.mNumObjects;
+		mFreelistEnqueue = other.mFreelistEnqueue;
+		mFreelistDequeue = other.mFreelistDequeue;
+		mFreelistDirty = other.mFreelistDirty;
+		updateHighWater();
+		return copyChangedPages(mIndices, other.mIndices, indexBytes());
+	}
+
+	// Become a copy of another array
+	// Only the live objects are copied, and only the pages which differ
+	// Returns the number of bytes written
+	size_t copyFrom(PackedArray<T>& other){
+		size_t written = copyIndicesFrom(other);
+		return written + copyChangedPages(mObjects.data(), other.mObjects.data(), mNumObjects * sizeof(T));
+	}
+
+	// Give the pages above the live objects back to the OS, highest first
+	// Releases at most budget bytes, and returns how many it did
+	// Only storage past size() is touched, so ids stay valid
+	size_t releaseUnusedPages(size_t budget) override {
+		static const size_t PAGE_SIZE = 4096;
+		size_t live = ((size_t)mNumObjects * sizeof(T) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+		size_t touched = ((size_t)mHighWater * sizeof(T) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+		if (touched > mObjects.bytes()) touched = mObjects.bytes();
+		if (touched <= live) return 0;
+
+		size_t bytes = touched - live;
+		if (bytes > budget) bytes = budget / PAGE_SIZE * PAGE_SIZE;
+		if (bytes == 0) return 0;
+
+		size_t released = mObjects.decommit(touched - bytes, bytes);
+		if (released > 0){
+			mHighWater = (unsigned int)((touched - bytes) / sizeof(T));
+		}
+		return released;
+	}
+
+	// Relink the free slots in ascending order, so new objects take
+	// the lowest slots first instead of the ones freed most recently
+	// Live ids are untouched
+	void renumberFreelist() override {
+		mFreelistDirty = true;
+		repairFreelist();
+	}
+
+	// Relink the freelist after insert()s
+	void repairFreelist(){
+		if (!mFreelistDirty) return;
+		int first = -1, last = -1;
+		for (int i = 0; i < MAX_OBJECTS; ++i) {
+			if (mIndices[i].index == USHRT_MAX){
+				if (last >= 0) mIndices[last].next = (uint16)i;
+				else first = i;
+				last = i;
+			}
+		}
+		assert(first >= 0);
+		mFreelistDequeue = (uint16)first;
+		mFreelistEnqueue = (uint16)last;
+		mFreelistDirty = false;
+	}
+
+	// PRE: objects [0,numObjects) have been written to objects()
+	void restore(unsigned int numObjects, const void* indices, unsigned int enqueue, unsigned int dequeue){
+		assert(numObjects <= MAX_OBJECTS);
+		mNumObjects = numObjects;
+		updateHighWater();
+		std::memcpy(mIndices, indices, indexBytes());
+		mFreelistEnqueue = (uint16)enqueue;
+		mFreelistDequeue = (uint16)dequeue;
+		mFreelistDirty = false;
+	}
+
 	void clear(){
 		mNumObjects = 0;
 		for (unsigned i = 0; i < MAX_OBJECTS; ++i) {
@@ -138,9 +465,14 @@ public:
 		}
 		mFreelistDequeue = 0;
 		mFreelistEnqueue = MAX_OBJECTS - 1;
+		mFreelistDirty = false;
 	}
 
 protected:
+	void updateHighWater(){
+		if (mNumObjects > mHighWater) mHighWater = mNumObjects;
+	}
+
 	static const int MAX_OBJECTS = 0x10000; //  0xffff;
 	static const int INDEX_MASK = 0xffff;
 	static const int NEW_OBJECT_ID_ADD = 0x10000;
@@ -153,11 +485,13 @@ protected:
 	};
 
 	unsigned int mNumObjects;
+	unsigned int mHighWater;
 	StaticArray<T> mObjects;
 	Index mIndices[MAX_OBJECTS];
 
 	uint16 mFreelistEnqueue;
 	uint16 mFreelistDequeue;
+	bool mFreelistDirty;
 };
 
 
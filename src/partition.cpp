@@ -0,0 +1,115 @@
+#include "entity.h"
+#include <iostream>
+
+///////////////////////////////////////////////////////////////////////////////
+// PartitionData
+///////////////////////////////////////////////////////////////////////////////
+
+bool PartitionData::parse(std::vector<char>& data){
+	mData.swap(data);
+	mSaved.clear();
+	mComponents.clear();
+	mIntegrated = 0;
+	mValid = false;
+
+	DeltaReader reader(mData.data(), mData.size());
+	PartitionHeader header;
+	if (!reader.read(header) || std::memcmp(header.magic, PARTITION_MAGIC, sizeof(header.magic)) != 0) return false;
+	const char* saved = reader.readBytes((size_t)header.numEntities * sizeof(ID));
+	if (!saved) return false;
+	mSaved.resize(header.numEntities);
+	if (header.numEntities) std::memcpy(mSaved.data(), saved, mSaved.size() * sizeof(ID));
+
+	// Types and the entities within each type are in order, so
+	// integrating a range of entities walks each type from where it left off
+	for (uint32_t t = 0; t < header.numComponentTypes; t++){
+		PartitionComponents pc;
+		if (!reader.read(pc)) return false;
+		if (!mComponents.empty() && pc.type <= mComponents.back().type) return false;
+		if (pc.type >= NUM_COMPONENTS || pc.numFields != componentFields(pc.type).size()) return false;
+		Components c;
+		c.type = pc.type;
+		c.numFields = pc.numFields;
+		c.next = 0;
+		c.records.reserve(pc.count);
+		for (uint32_t i = 0; i < pc.count; i++){
+			Record r;
+			if (!reader.read(r.entity) || !reader.read(r.bytes)) return false;
+			if (r.entity >= header.numEntities || (!c.records.empty() && r.entity <= c.records.back().entity)) return false;
+			const char* fields = reader.readBytes(r.bytes);
+			if (!fields) return false;
+			r.offset = (uint64_t)(fields - mData.data());
+			c.records.push_back(r);
+		}
+		mComponents.push_back(std::move(c));
+	}
+	mValid = reader.done();
+	return mValid;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// EntitySystem
+///////////////////////////////////////////////////////////////////////////////
+
+void EntitySystem::savePartition(const std::vector<ID>& entities, std::vector<char>& out){
+	DeltaWriter writer(out);
+	PartitionHeader header;
+	std::memcpy(header.magic, PARTITION_MAGIC, sizeof(header.magic));
+	header.numEntities = (uint32_t)entities.size();
+	header.numComponentTypes = 0;
+	size_t headerOffset = writer.write(header);
+	writer.write(entities.data(), entities.size() * sizeof(ID));
+	savePartitionArrays(writer, entities, 0, header.numComponentTypes, ComponentTypeList());
+	writer.patch(headerOffset, header);
+}
+
+bool EntitySystem::integratePartition(PartitionData& data, unsigned int count, std::vector<ID>& ids){
+	unsigned int first = data.integrated();
+	unsigned int end = (count < data.numEntities() - first) ? first + count : data.numEntities();
+	count = end - first;
+	if (count == 0) return true;
+	if (!data.valid()){
+		std::cerr << "EntitySystem: partition is malformed" << std::endl;
+		return false;
+	}
+
+	bool room = mEntities.size() + count <= MAX_ENTITIES;
+	for (PartitionData::Components& pc : data.components()){
+		size_t last = pc.next;
+		while (last < pc.records.size() && pc.records[last].entity < end) last++;
+		room = room && mComponents[pc.type]->numObjects() + (last - pc.next) <= MAX_ENTITIES;
+	}
+	if (!room){
+		std::cerr << "EntitySystem: no room for " << count << " more entities of a partition" << std::endl;
+		return false;
+	}
+
+	Entity proto(this);
+	proto.clear();
+	unsigned int block = mEntities.add(proto, count);
+	Entity* entities = &mEntities.objects().get(block);
+	mChanges.created += count;
+	size_t firstId = ids.size();
+	for (unsigned int i = 0; i < count; i++){
+		ids.push_back(entities[i].id);
+	}
+
+	bool ok = true;
+	for (PartitionData::Components& pc : data.components()){
+		ok = integratePartitionArrays(data, pc, entities, first, end, 0, ComponentTypeList()) && ok;
+	}
+	data.setIntegrated(end);
+	if (!ok){
+		std::cerr << "EntitySystem: partition has malformed records" << std::endl;
+	}
+
+	for (ISystem* sys : mSystems){
+		for (PartitionData::Components& pc : data.components()){
+			if (sys->implements(pc.type)){
+				sys->setupBatch(*this, &ids[firstId], count);
+				break;
+			}
+		}
+	}
+	return ok;
+}
@@ -0,0 +1,106 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <functional>
+
+#include "component.h"
+
+// World partitions (see EntitySystem::savePartition() and WorldStreamer)
+//
+// Layout:
+//   PartitionHeader
+//   ID saved[numEntities]  (ids in the world that wrote it)
+//   For each component type with components:
+//     PartitionComponents
+//     count records of: uint32 entity (0 to numEntities - 1), uint32 bytes, the fields
+//
+// Fields are written like delta snapshots (see delta.h), so String,
+// Items and Shared fields don't depend on the world that wrote them.
+// Entities get new ids when they're loaded, as the saved ones may have
+// been reused meanwhile; WorldStreamer::loaded() maps one to the other.
+// Runtime component types aren't saved.
+
+static const char PARTITION_MAGIC[4] = { 'E', 'C', 'S', 'P' };
+
+struct PartitionHeader {
+	char magic[4];
+	uint32_t numEntities;
+	uint32_t numComponentTypes;
+};
+
+struct PartitionComponents {
+	uint32_t type;      // position in ComponentTypeList
+	uint32_t numFields; // to catch mismatched builds
+	uint32_t count;
+};
+
+// A cell of the world, by Transform position
+struct PartitionKey {
+	int x;
+	int y;
+
+	bool operator==(const PartitionKey& rhs) const { return x == rhs.x && y == rhs.y; }
+	bool operator!=(const PartitionKey& rhs) const { return !(*this == rhs); }
+};
+
+struct PartitionKeyHash {
+	size_t operator()(const PartitionKey& key) const {
+		return std::hash<uint64_t>()(((uint64_t)(uint32_t)key.x << 32) | (uint32_t)key.y);
+	}
+};
+
+inline PartitionKey partitionOf(float x, float y, float cellSize){
+	PartitionKey key = { (int)std::floor(x / cellSize), (int)std::floor(y / cellSize) };
+	return key;
+}
+
+// A partition file checked and split into records, ready to be
+// added to a world a bit at a time
+// Parsing doesn't touch a world, so it can be done on another thread
+class PartitionData {
+public:
+	struct Record {
+		uint32_t entity; // into saved
+		uint32_t bytes;
+		uint64_t offset; // of the fields
+	};
+
+	struct Components {
+		uint32_t type;
+		uint32_t numFields;
+		std::vector<Record> records; // by entity
+		size_t next;                 // first record not in the world yet
+	};
+
+	PartitionData() :mIntegrated(0), mValid(false){}
+
+	// Returns false if the data is malformed, or from a build
+	// with different component types
+	bool parse(std::vector<char>& data);
+
+	// The last parse() succeeded
+	// integratePartition() won't add anything from a malformed partition
+	bool valid() const { return mValid; }
+
+	unsigned int numEntities() const { return (unsigned int)mSaved.size(); }
+	const std::vector<ID>& saved() const { return mSaved; }
+	const char* data() const { return mData.data(); }
+	std::vector<Components>& components(){ return mComponents; }
+
+	// Entities already added to a world, the rest are [integrated(), numEntities())
+	unsigned int integrated() const { return mIntegrated; }
+	void setIntegrated(unsigned int count){ mIntegrated = count; }
+	bool done() const { return mIntegrated == mSaved.size(); }
+
+protected:
+	std::vector<char> mData;
+	std::vector<ID> mSaved;
+	std::vector<Components> mComponents;
+	unsigned int mIntegrated;
+	bool mValid;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define PHYSICS_H
 
 #include "component.h"
+#include "transform.h"
 
 struct Physics : public Component<Physics> {
 	static const char* Name(){ return "Physics"; }
@@ -15,6 +16,15 @@ struct Physics : public Component<Physics> {
 	Thing* thing;
 
 	Physics(float vx = 0.f, float vy = 0.f) :vx(vx), vy(vy){}
+
+	static const std::vector<Field>& Fields(){
+		static const std::vector<Field> fields = {
+			COM_FIELD(Physics, vx), COM_FIELD(Physics, vy),
+			COM_FIELD(Physics, oldx), COM_FIELD(Physics, oldy)
+		};
+		return fields;
+	}
+
 	std::string what() {
 		std::ostringstream oss;
 		oss << "physics {";
@@ -27,4 +37,12 @@ struct Physics : public Component<Physics> {
 	}
 };
 
+// Where to draw an entity between the last two fixed steps
+// oldx/oldy is where it was before the last step and
+// alpha is how far on the next step is (see Runner::alpha())
+inline vec2 interpolate(const Physics& p, const Transform& tr, float alpha){
+	vec2 v = { p.oldx + (tr.x - p.oldx) * alpha, p.oldy + (tr.y - p.oldy) * alpha };
+	return v;
+}
+
 #endif
\ No newline at end of file
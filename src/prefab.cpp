@@ -0,0 +1,245 @@
+#include "prefab.h"
+#include "string_pool.h"
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <cctype>
+
+using PrefabPairs = std::vector<std::pair<std::string, std::string>>;
+
+Prefab::Prefab(const std::string& name) :mName(name), mComponents(NUM_COMPONENTS), mShared(NUM_COMPONENTS){}
+
+Prefab& Prefab::addItem(Item item, int count){
+	if (!ItemSlab::valid(ItemAndCount(item, count))) return *this;
+	if (!has<Inventory>()) add(Inventory());
+	for (ItemAndCount& ic : mItems){
+		if (ic.item == item){
+			ic.count += count;
+			return *this;
+		}
+	}
+	if (mItems.size() < MAX_ITEMS){
+		mItems.push_back(ItemAndCount(item, count));
+	}
+	return *this;
+}
+
+static void markRecord(StringPool& pool, const std::vector<char>& record, const std::vector<Field>& fields){
+	if (record.empty()) return;
+	for (const Field& f : fields){
+		if (f.type != FieldType::String) continue;
+		unsigned int handle;
+		std::memcpy(&handle, record.data() + f.offset, sizeof(handle));
+		pool.mark(handle);
+	}
+}
+
+template <typename C>
+static void markComponent(StringPool& pool, const std::vector<char>& record, const std::vector<char>& value, C*){
+	markRecord(pool, record, C::AllFields());
+}
+
+// Strings of the value, the record only has its handle
+template <typename C>
+static void markComponent(StringPool& pool, const std::vector<char>& record, const std::vector<char>& value, Shared<C>*){
+	markRecord(pool, value, C::AllFields());
+}
+
+template <typename First>
+static void markComponents(StringPool& pool, const std::vector<std::vector<char>>& records, const std::vector<std::vector<char>>& values, const TypeList<First>& tl){
+	markComponent(pool, records[First::Index()], values[First::Index()], (First*)nullptr);
+}
+
+template <typename First, typename... Rest>
+static void markComponents(StringPool& pool, const std::vector<std::vector<char>>& records, const std::vector<std::vector<char>>& values, const TypeList<First, Rest...>& tl){
+	markComponent(pool, records[First::Index()], values[First::Index()], (First*)nullptr);
+	if (sizeof...(Rest)){
+		markComponents(pool, records, values, TypeList<Rest...>());
+	}
+}
+
+void Prefab::markStrings() const {
+	markComponents(StringPool::instance(), mComponents, mShared, ComponentTypeList());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loading
+///////////////////////////////////////////////////////////////////////////////
+
+static std::string trim(const std::string& s){
+	size_t first = 0, last = s.size();
+	while (first < last && std::isspace((unsigned char)s[first])) first++;
+	while (last > first && std::isspace((unsigned char)s[last - 1])) last--;
+	return s.substr(first, last - first);
+}
+
+// Split "key = value, key = "quoted value", ..."
+static bool parsePairs(const std::string& text, PrefabPairs& pairs){
+	size_t i = 0;
+	while (i < text.size()){
+		size_t eq = text.find('=', i);
+		if (eq == std::string::npos) return trim(text.substr(i)).empty();
+		std::string key = trim(text.substr(i, eq - i));
+		if (key.empty()) return false;
+
+		i = eq + 1;
+		while (i < text.size() && std::isspace((unsigned char)text[i])) i++;
+		std::string value;
+		bool quoted = i < text.size() && text[i] == '"';
+		if (quoted){
+			size_t close = text.find('"', i + 1);
+			if (close == std::string::npos) return false;
+			value = text.substr(i + 1, close - i - 1);
+			i = close + 1;
+		}
+		size_t comma = text.find(',', i);
+		if (comma == std::string::npos) comma = text.size();
+		std::string rest = trim(text.substr(i, comma - i));
+		if (!quoted) value = rest;
+		else if (!rest.empty()) return false;
+		i = comma + 1;
+
+		pairs.push_back(std::make_pair(key, value));
+	}
+	return true;
+}
+
+static bool setPrefabField(char* record, const std::vector<Field>& fields, const std::string& key, const std::string& value){
+	for (const Field& f : fields){
+		if (key != f.name) continue;
+
+		char* dst = record + f.offset;
+		const char* str = value.c_str();
+		char* end = nullptr;
+		switch (f.type){
+		case FieldType::Int: {
+			int v = (int)std::strtol(str, &end, 0);
+			std::memcpy(dst, &v, sizeof(v));
+			break;
+		}
+		case FieldType::UInt: {
+			unsigned int v = (unsigned int)std::strtoul(str, &end, 0);
+			std::memcpy(dst, &v, sizeof(v));
+			break;
+		}
+		case FieldType::Float: {
+			float v = std::strtof(str, &end);
+			std::memcpy(dst, &v, sizeof(v));
+			break;
+		}
+		case FieldType::Bool: {
+			if (value != "true" && value != "false") return false;
+			bool v = value == "true";
+			std::memcpy(dst, &v, sizeof(v));
+			return true;
+		}
+		case FieldType::String: {
+			unsigned int handle = StringPool::instance().intern(str, value.size());
+			std::memcpy(dst, &handle, sizeof(handle));
+			return true;
+		}
+		default:
+			return false;
+		}
+		return end != str && *end == '\0';
+	}
+	return false;
+}
+
+template <typename C>
+static bool parseComponent(Prefab& prefab, const PrefabPairs& pairs, C*){
+	C c = prefab.has<C>() ? prefab.get<C>() : C();
+	for (auto& p : pairs){
+		if (!setPrefabField((char*)&c, C::Fields(), p.first, p.second)) return false;
+	}
+	prefab.add(c);
+	return true;
+}
+
+// Item names and counts
+static bool parseComponent(Prefab& prefab, const PrefabPairs& pairs, Inventory*){
+	if (!prefab.has<Inventory>()) prefab.add(Inventory());
+	for (auto& p : pairs){
+		Item item;
+		char* end = nullptr;
+		long count = std::strtol(p.second.c_str(), &end, 0);
+		if (!itemFromName(p.first, item) || end == p.second.c_str() || *end != '\0' || count <= 0) return false;
+		prefab.addItem(item, (int)count);
+	}
+	return true;
+}
+
+// Fields of the value
+template <typename C>
+static bool parseComponent(Prefab& prefab, const PrefabPairs& pairs, Shared<C>*){
+	C c = prefab.has<Shared<C>>() ? prefab.getShared<C>() : C();
+	for (auto& p : pairs){
+		if (!setPrefabField((char*)&c, C::Fields(), p.first, p.second)) return false;
+	}
+	prefab.addShared(c);
+	return true;
+}
+
+template <typename First>
+static bool parseComponents(Prefab& prefab, const std::string& name, const PrefabPairs& pairs, bool& found, const TypeList<First>& tl){
+	if (name != First::Name()) return true;
+	found = true;
+	return parseComponent(prefab, pairs, (First*)nullptr);
+}
+
+template <typename First, typename... Rest>
+static bool parseComponents(Prefab& prefab, const std::string& name, const PrefabPairs& pairs, bool& found, const TypeList<First, Rest...>& tl){
+	if (name == First::Name()){
+		found = true;
+		return parseComponent(prefab, pairs, (First*)nullptr);
+	}
+	if (sizeof...(Rest)){
+		return parseComponents(prefab, name, pairs, found, TypeList<Rest...>());
+	}
+	return true;
+}
+
+static bool prefabError(const char* path, int lineNumber, const char* what){
+	std::cerr << "Prefab: " << path << ":" << lineNumber << ": " << what << std::endl;
+	return false;
+}
+
+bool Prefab::load(const char* path, std::vector<Prefab>& prefabs){
+	std::ifstream in(path);
+	if (!in){
+		std::cerr << "Prefab: couldn't open " << path << std::endl;
+		return false;
+	}
+
+	const size_t NONE = ~size_t(0);
+	size_t current = NONE;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line)){
+		lineNumber++;
+		line = trim(line);
+		if (line.empty() || line[0] == '#') continue;
+
+		if (line[0] == '['){
+			if (line.back() != ']') return prefabError(path, lineNumber, "expected ]");
+			prefabs.push_back(Prefab(trim(line.substr(1, line.size() - 2))));
+			current = prefabs.size() - 1;
+			continue;
+		}
+
+		if (current == NONE) return prefabError(path, lineNumber, "component outside a [prefab]");
+		size_t colon = line.find(':');
+		PrefabPairs pairs;
+		if (colon == std::string::npos || !parsePairs(line.substr(colon + 1), pairs)){
+			return prefabError(path, lineNumber, "expected Component: field = value, ...");
+		}
+
+		bool found = false;
+		std::string name = trim(line.substr(0, colon));
+		if (!parseComponents(prefabs[current], name, pairs, found, ComponentTypeList())){
+			return prefabError(path, lineNumber, "bad field or value");
+		}
+		if (!found) return prefabError(path, lineNumber, "unknown component");
+	}
+	return true;
+}
@@ -0,0 +1,114 @@
+#ifndef PREFAB_H
+#define PREFAB_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+
+#include "all_components.h"
+
+// A bundle of components to stamp out lots of entities at once
+// (see EntitySystem::instantiate())
+//
+// Build one in code:
+//   Prefab goblin("Goblin");
+//   goblin.add(Transform(0, 0)).add(Health(10)).addItem(Item::SWORD);
+//
+// Or load them from a text file, a name in brackets then one component per line:
+//   [Goblin]
+//   Transform: x = 0, y = 0
+//   Health: health = 10
+//   Short Description: shortDescription = "Goblin"
+//   Shared Description: description = "A small angry goblin."
+//   Inventory: Sword = 1, Arrow = 20
+//
+// Fields are matched by name through Fields(), and the ones left out
+// keep the component's defaults. Shared components take the fields of
+// their value. Strings can't contain quotes. Lines starting with # are comments.
+class Prefab {
+public:
+	Prefab(const std::string& name = "");
+
+	const std::string& name() const { return mName; }
+
+	template <typename C> Prefab& add(const C& c);
+
+	// Each instance gets a Shared<C> with this value
+	template <typename C> Prefab& addShared(const C& c);
+
+	// Each instance gets an Inventory holding these items
+	// Counts below 1 are ignored
+	Prefab& addItem(Item item, int count = 1);
+
+	template <typename C> bool has() const { return has(C::Index()); }
+	bool has(int index) const { return !mComponents[index].empty(); }
+
+	// PRE: has<C>()
+	template <typename C> const C& get() const;
+
+	// PRE: has<Shared<C>>()
+	template <typename C> const C& getShared() const;
+
+	const std::vector<ItemAndCount>& items() const { return mItems; }
+
+	template <typename C> void remove();
+
+	// Mark the strings this prefab holds, see StringPool::beginCollect()
+	void markStrings() const;
+
+	// Append the prefabs in a file
+	// Returns false (and logs the line) if the file can't be read or is malformed
+	static bool load(const char* path, std::vector<Prefab>& prefabs);
+
+protected:
+	template <typename C>
+	static void setRecord(std::vector<char>& record, const C& c);
+
+	std::string mName;
+	std::vector<std::vector<char>> mComponents; // records by Index(), empty if missing
+	std::vector<std::vector<char>> mShared;     // values of Shared components by Index()
+	std::vector<ItemAndCount> mItems;
+};
+
+template <typename C>
+void Prefab::setRecord(std::vector<char>& record, const C& c){
+	static_assert(std::is_trivially_copyable<C>::value, "prefabs are instantiated with memcpy");
+	record.resize(sizeof(C));
+	std::memcpy(record.data(), &c, sizeof(C));
+	C* stored = (C*)record.data();
+	stored->id = INVALID_ID;
+	stored->entity = INVALID_ID;
+}
+
+template <typename C>
+Prefab& Prefab::add(const C& c){
+	setRecord(mComponents[C::Index()], c);
+	return *this;
+}
+
+template <typename C>
+Prefab& Prefab::addShared(const C& c){
+	setRecord(mComponents[Shared<C>::Index()], Shared<C>());
+	setRecord(mShared[Shared<C>::Index()], c);
+	return *this;
+}
+
+template <typename C>
+const C& Prefab::get() const {
+	return *(const C*)mComponents[C::Index()].data();
+}
+
+template <typename C>
+const C& Prefab::getShared() const {
+	return *(const C*)mShared[Shared<C>::Index()].data();
+}
+
+template <typename C>
+void Prefab::remove(){
+	mComponents[C::Index()].clear();
+	mShared[C::Index()].clear();
+	if (C::Index() == Inventory::Index()) mItems.clear();
+}
+
+#endif
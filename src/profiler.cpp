@@ -0,0 +1,124 @@
+#include "profiler.h"
+#include <fstream>
+#include <iomanip>
+#include <map>
+
+Profiler::Profiler(size_t capacity) :mEvents(capacity), mNext(0), mWrapped(false), mEpoch(std::chrono::high_resolution_clock::now()), mFrame(0), mFrameStart(0){}
+
+int64_t Profiler::now() const {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - mEpoch).count();
+}
+
+void Profiler::record(const char* name, const char* category, int64_t start, int64_t end, unsigned int count){
+	if (mEvents.empty()) return;
+	ProfileEvent& e = mEvents[mNext];
+	e.name = name;
+	e.category = category;
+	e.frame = mFrame;
+	e.count = count;
+	e.start = start;
+	e.duration = end - start;
+	e.changes = FrameCounts();
+	if (++mNext == mEvents.size()){
+		mNext = 0;
+		mWrapped = true;
+	}
+}
+
+void Profiler::endFrame(const FrameCounts& changes){
+	int64_t end = now();
+	unsigned int count = changes.created + changes.destroyed + changes.componentsAdded + changes.componentsRemoved;
+	record("frame", "frame", mFrameStart, end, count);
+	if (!mEvents.empty()){
+		mEvents[(mNext + mEvents.size() - 1) % mEvents.size()].changes = changes;
+	}
+	mFrameStart = end;
+	mFrame++;
+}
+
+std::vector<ProfileEvent> Profiler::events() const {
+	std::vector<ProfileEvent> events;
+	if (mWrapped) events.insert(events.end(), mEvents.begin() + mNext, mEvents.end());
+	events.insert(events.end(), mEvents.begin(), mEvents.begin() + mNext);
+	return events;
+}
+
+std::vector<ProfileSummary> Profiler::summary(unsigned int frames) const {
+	// Keyed on the name pointer, names are literals or owned by systems
+	std::map<const char*, ProfileSummary> byName;
+	std::vector<const char*> order;
+	for (const ProfileEvent& e : events()){
+		if (e.frame >= mFrame || e.frame + frames < mFrame) continue;
+		auto it = byName.find(e.name);
+		if (it == byName.end()){
+			ProfileSummary s = { e.name, e.category, 0, 0, 0, 0, 0 };
+			it = byName.insert(std::make_pair(e.name, s)).first;
+			order.push_back(e.name);
+		}
+		ProfileSummary& s = it->second;
+		double ms = e.duration / 1e6;
+		s.calls++;
+		s.meanMs += ms;
+		s.maxMs = ms > s.maxMs ? ms : s.maxMs;
+		s.lastMs = ms;
+		s.meanCount += e.count;
+	}
+
+	std::vector<ProfileSummary> summary;
+	for (const char* name : order){
+		ProfileSummary s = byName[name];
+		s.meanMs /= s.calls;
+		s.meanCount /= s.calls;
+		summary.push_back(s);
+	}
+	return summary;
+}
+
+static void writeJsonString(std::ostream& out, const char* str){
+	out << '"';
+	for (const char* p = str; *p; p++){
+		if (*p == '"' || *p == '\\') out << '\\';
+		if ((unsigned char)*p >= 0x20) out << *p;
+	}
+	out << '"';
+}
+
+void Profiler::writeChromeTrace(std::ostream& out) const {
+	out << "{\"traceEvents\":[\n";
+	out << std::fixed << std::setprecision(3);
+	bool first = true;
+	for (const ProfileEvent& e : events()){
+		if (!first) out << ",\n";
+		first = false;
+
+		// Complete events, times in microseconds
+		out << "{\"name\":";
+		writeJsonString(out, e.name);
+		out << ",\"cat\":";
+		writeJsonString(out, e.category);
+		out << ",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << e.start / 1e3 << ",\"dur\":" << e.duration / 1e3
+			<< ",\"args\":{\"frame\":" << e.frame << ",\"entities\":" << e.count << "}}";
+
+		// Plus a counter track for the structural changes
+		if (e.category[0] == 'f'){
+			out << ",\n{\"name\":\"changes\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":" << (e.start + e.duration) / 1e3
+				<< ",\"args\":{\"created\":" << e.changes.created << ",\"destroyed\":" << e.changes.destroyed
+				<< ",\"componentsAdded\":" << e.changes.componentsAdded << ",\"componentsRemoved\":" << e.changes.componentsRemoved << "}}";
+		}
+	}
+	out << "\n]}\n";
+}
+
+bool Profiler::writeChromeTrace(const char* path) const {
+	std::ofstream out(path, std::ios::trunc);
+	if (!out) return false;
+	writeChromeTrace(out);
+	return (bool)out;
+}
+
+void Profiler::clear(){
+	mNext = 0;
+	mWrapped = false;
+	mFrame = 0;
+	mFrameStart = now();
+}
@@ -0,0 +1,122 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Frame profiler
+// Records how long each system update and each phase of sync() takes,
+// how many entities it looked at, and the structural changes of each frame.
+// Events go in a fixed size ring buffer, so the oldest are overwritten.
+// Export them with writeChromeTrace() (open the file in chrome://tracing)
+// or poll summary() for rolling averages.
+//
+// Recording is compiled out unless ECS_PROFILE is defined
+
+// Structural changes in a frame
+struct FrameCounts {
+	unsigned int created;
+	unsigned int destroyed;
+	unsigned int componentsAdded;
+	unsigned int componentsRemoved;
+
+	FrameCounts() :created(0), destroyed(0), componentsAdded(0), componentsRemoved(0){}
+};
+
+struct ProfileEvent {
+	const char* name;     // NB: Not copied, e.g., a literal or ISystem::name()
+	const char* category; // "system", "sync" or "frame"
+	unsigned int frame;
+	unsigned int count;   // entities processed
+	int64_t start;        // ns since the profiler was made
+	int64_t duration;     // ns
+	FrameCounts changes;  // frame events only
+};
+
+// Statistics for one event name over the last few frames
+struct ProfileSummary {
+	std::string name;
+	std::string category;
+	unsigned int calls;
+	double meanMs;
+	double maxMs;
+	double lastMs;
+	double meanCount;
+};
+
+class Profiler {
+public:
+	explicit Profiler(size_t capacity = 16384);
+
+	// ns since the profiler was made
+	int64_t now() const;
+
+	void record(const char* name, const char* category, int64_t start, int64_t end, unsigned int count);
+
+	// Close the current frame (see EntitySystem::sync())
+	void endFrame(const FrameCounts& changes);
+
+	// Number of frames ended
+	unsigned int frame() const { return mFrame; }
+
+	// Events still in the buffer, oldest first
+	std::vector<ProfileEvent> events() const;
+
+	// Per name statistics over the last frames (ended) frames
+	std::vector<ProfileSummary> summary(unsigned int frames = 60) const;
+
+	// Chrome trace event format
+	void writeChromeTrace(std::ostream& out) const;
+	bool writeChromeTrace(const char* path) const;
+
+	void clear();
+
+protected:
+	std::vector<ProfileEvent> mEvents;
+	size_t mNext;
+	bool mWrapped;
+	std::chrono::high_resolution_clock::time_point mEpoch;
+	unsigned int mFrame;
+	int64_t mFrameStart;
+};
+
+// Records the time until the end of the enclosing block
+class ProfileScope {
+public:
+	ProfileScope(Profiler& profiler, const char* name, const char* category, unsigned int count)
+		:mProfiler(profiler), mName(name), mCategory(category), mCount(count), mStart(profiler.now()){}
+
+	~ProfileScope(){
+		mProfiler.record(mName, mCategory, mStart, mProfiler.now(), mCount);
+	}
+
+protected:
+	Profiler& mProfiler;
+	const char* mName;
+	const char* mCategory;
+	unsigned int mCount;
+	int64_t mStart;
+};
+
+// Ring buffer size of each world's profiler
+// Nothing is recorded without ECS_PROFILE, so worlds don't hold one
+#ifdef ECS_PROFILE
+static const size_t ECS_PROFILE_EVENTS = 16384;
+#else
+static const size_t ECS_PROFILE_EVENTS = 0;
+#endif
+
+#ifdef ECS_PROFILE
+#define ECS_PROFILE_CONCAT_(a, b) a##b
+#define ECS_PROFILE_CONCAT(a, b) ECS_PROFILE_CONCAT_(a, b)
+#define ECS_PROFILE_SCOPE(profiler, name, category, count) ProfileScope ECS_PROFILE_CONCAT(profileScope, __LINE__)((profiler), (name), (category), (count))
+#define ECS_PROFILE_END_FRAME(profiler, changes) (profiler).endFrame(changes)
+#else
+#define ECS_PROFILE_SCOPE(profiler, name, category, count)
+#define ECS_PROFILE_END_FRAME(profiler, changes)
+#endif
+
+#endif
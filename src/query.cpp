@@ -0,0 +1,171 @@
+#include "entity.h"
+#include <iostream>
+
+///////////////////////////////////////////////////////////////////////////////
+// ComponentMask
+///////////////////////////////////////////////////////////////////////////////
+
+ComponentMask& ComponentMask::set(int type){
+	assert(type >= 0);
+	size_t word = (size_t)type / 64;
+	if (word >= mBits.size()) mBits.resize(word + 1, 0);
+	mBits[word] |= 1ull << (type % 64);
+	return *this;
+}
+
+ComponentMask& ComponentMask::reset(int type){
+	size_t word = (size_t)type / 64;
+	if (word < mBits.size()) mBits[word] &= ~(1ull << (type % 64));
+	return *this;
+}
+
+bool ComponentMask::test(int type) const {
+	size_t word = (size_t)type / 64;
+	return word < mBits.size() && (mBits[word] & (1ull << (type % 64))) != 0;
+}
+
+bool ComponentMask::empty() const {
+	for (uint64_t bits : mBits){
+		if (bits) return false;
+	}
+	return true;
+}
+
+std::vector<int> ComponentMask::types() const {
+	std::vector<int> types;
+	for (size_t word = 0; word < mBits.size(); word++){
+		for (int bit = 0; bit < 64; bit++){
+			if (mBits[word] & (1ull << bit)) types.push_back((int)(word * 64 + bit));
+		}
+	}
+	return types;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Query
+///////////////////////////////////////////////////////////////////////////////
+
+int Query::find(const char* name){
+	int type = findComponentType(name);
+	if (type < 0) mUnknown.push_back(name);
+	return type;
+}
+
+Query& Query::with(const char* name){
+	int type = find(name);
+	if (type >= 0) include.set(type);
+	return *this;
+}
+
+Query& Query::without(const char* name){
+	int type = find(name);
+	if (type >= 0) exclude.set(type);
+	return *this;
+}
+
+Query& Query::maybe(const char* name){
+	int type = find(name);
+	if (type >= 0) optional.set(type);
+	return *this;
+}
+
+int QueryResult::column(int type) const {
+	for (size_t c = 0; c < columns.size(); c++){
+		if (columns[c].type == type) return (int)c;
+	}
+	return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// EntitySystem
+///////////////////////////////////////////////////////////////////////////////
+
+bool EntitySystem::hasComponent(Entity& e, int type){
+	if (type < NUM_COMPONENTS) return e.mHasComponent[type];
+	return static_cast<RuntimeArray*>(mComponents[type])->find(e.id) != INVALID_ID;
+}
+
+unsigned int EntitySystem::componentPosition(Entity& e, int type){
+	if (type < NUM_COMPONENTS){
+		return e.mHasComponent[type] ? mComponents[type]->position(e.mComponents[type]) : UINT_MAX;
+	}
+	RuntimeArray& arr = *static_cast<RuntimeArray*>(mComponents[type]);
+	ID id = arr.find(e.id);
+	return id != INVALID_ID ? arr.position(id) : UINT_MAX;
+}
+
+QueryColumn EntitySystem::queryColumn(int type){
+	PackedArrayBase* arr = mComponents[type];
+	unsigned int offset = type < NUM_COMPONENTS ? 0 : static_cast<RuntimeArray*>(arr)->valueOffset();
+	QueryColumn column = { type, arr->data(), arr->stride(), offset };
+	return column;
+}
+
+bool EntitySystem::query(const Query& query, QueryResult& result){
+	result.clear();
+	if (!query.valid()){
+		std::cerr << "EntitySystem: query names unknown component " << query.unknownNames()[0] << std::endl;
+		return false;
+	}
+
+	setupRuntimeArrays();
+	std::vector<int> include = query.include.types();
+	std::vector<int> exclude = query.exclude.types();
+	std::vector<int> optional = query.optional.types();
+	for (std::vector<int>* types : { &include, &exclude, &optional }){
+		for (int type : *types){
+			if (type >= (int)mComponents.size()){
+				std::cerr << "EntitySystem: query has unknown component type " << type << std::endl;
+				return false;
+			}
+		}
+	}
+
+	for (int type : include) result.columns.push_back(queryColumn(type));
+	for (int type : optional) result.columns.push_back(queryColumn(type));
+
+	// Walk the smallest include array, or every entity
+	int driver = -1;
+	unsigned int count = mEntities.size();
+	for (int type : include){
+		if (mComponents[type]->numObjects() < count){
+			driver = type;
+			count = mComponents[type]->numObjects();
+		}
+	}
+	const char* driverData = driver >= 0 ? mComponents[driver]->data() : nullptr;
+	size_t driverStride = driver >= 0 ? mComponents[driver]->stride() : 0;
+
+	result.entities.reserve(count);
+	result.positions.reserve((size_t)count * result.columns.size());
+	for (unsigned int i = 1; i < count; i++){
+		Entity* e;
+		if (driver >= 0){
+			ID entity = *(const ID*)(driverData + i * driverStride + sizeof(ID));
+			e = &mEntities.lookup(entity);
+		}
+		else {
+			e = &mEntities.objects().get(i);
+		}
+
+		// Check membership first, it's in the entity for compile-time types
+		// NB: The driver's component may be queued for removal
+		bool match = true;
+		for (size_t c = 0; c < include.size() && match; c++){
+			match = hasComponent(*e, include[c]);
+		}
+		for (size_t c = 0; c < exclude.size() && match; c++){
+			match = !hasComponent(*e, exclude[c]);
+		}
+		if (!match) continue;
+
+		result.entities.push_back(e->id);
+		for (int type : include){
+			result.positions.push_back(type == driver ? i : componentPosition(*e, type));
+		}
+		for (int type : optional){
+			result.positions.push_back(componentPosition(*e, type));
+		}
+	}
+	return true;
+}
@@ -0,0 +1,89 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <vector>
+#include <climits>
+#include <cstdint>
+
+#include "component.h"
+
+// A set of component types by index, compile-time or runtime
+class ComponentMask {
+public:
+	ComponentMask& set(int type);
+	ComponentMask& reset(int type);
+	bool test(int type) const;
+	bool empty() const;
+
+	// The types that are set, lowest first
+	std::vector<int> types() const;
+
+protected:
+	std::vector<uint64_t> mBits;
+};
+
+// Finds entities by component types when the C++ types aren't
+// known, e.g., in tools and scripts (see EntitySystem::query())
+//   Query q;
+//   q.include("Transform").include("Physics").exclude("Health");
+struct Query {
+	ComponentMask include;  // has all of these
+	ComponentMask exclude;  // and none of these
+	ComponentMask optional; // also get these where the entity has them
+
+	// By name, an unknown name makes query() fail
+	Query& with(const char* name);
+	Query& without(const char* name);
+	Query& maybe(const char* name);
+
+	bool valid() const { return mUnknown.empty(); }
+	const std::vector<const char*>& unknownNames() const { return mUnknown; }
+
+protected:
+	int find(const char* name);
+
+	std::vector<const char*> mUnknown;
+};
+
+// Where a component type is stored
+// Object i of the array is at data + i * stride, and for runtime
+// types its value is offset bytes in (the C++ struct otherwise)
+struct QueryColumn {
+	int type;
+	char* data;
+	unsigned int stride;
+	unsigned int offset;
+};
+
+// Matching entities and where their components are
+// There's a column for each include type then each optional type,
+// lowest index first, and positions has one per column for each entity
+// NB: Only valid until components are next added or removed
+struct QueryResult {
+	static const unsigned int MISSING = UINT_MAX;
+
+	std::vector<ID> entities;
+	std::vector<QueryColumn> columns;
+	std::vector<unsigned int> positions; // entities.size() rows of columns.size()
+
+	size_t size() const { return entities.size(); }
+
+	// Column of a type, or -1
+	int column(int type) const;
+
+	// The component (or runtime value), or nullptr if an optional one is missing
+	void* get(size_t row, int column) const {
+		unsigned int p = positions[row * columns.size() + column];
+		if (p == MISSING) return nullptr;
+		const QueryColumn& c = columns[column];
+		return c.data + (size_t)p * c.stride + c.offset;
+	}
+
+	void clear(){
+		entities.clear();
+		columns.clear();
+		positions.clear();
+	}
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef READ_SNAPSHOT_H
+#define READ_SNAPSHOT_H
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <type_traits>
+
+#include "packedarray.h"
+
+// An immutable copy of a component array that other threads can read
+// while the simulation carries on (see EntitySystem::publish())
+// The objects are kept in fixed size pages so a new snapshot shares
+// every page that hasn't changed with the previous one
+template <typename C>
+class ReadSnapshot {
+public:
+	static const unsigned int PAGE_BYTES = 4096;
+	static const unsigned int PER_PAGE = (PAGE_BYTES / sizeof(C)) > 0 ? (PAGE_BYTES / sizeof(C)) : 1;
+
+	class Iterator : public std::iterator<std::input_iterator_tag, C> {
+	public:
+		Iterator(const ReadSnapshot<C>* snapshot, unsigned int i) :snapshot(snapshot), i(i){}
+		Iterator& operator++(){ ++i; return *this; }
+		bool operator==(const Iterator& rhs) const { return i == rhs.i; }
+		bool operator!=(const Iterator& rhs) const { return i != rhs.i; }
+		const C& operator*() const { return (*snapshot)[i]; }
+
+	protected:
+		const ReadSnapshot<C>* snapshot;
+		unsigned int i;
+	};
+
+	// Skips the invalid component, like EntitySystem::components()
+	Iterator begin() const { return Iterator(this, 1); }
+	Iterator end() const { return Iterator(this, mSize); }
+
+	unsigned int size() const { return mSize; }
+
+	const C& operator[](unsigned int i) const {
+		return mPages[i / PER_PAGE]->get(i % PER_PAGE);
+	}
+
+	// Number of pages shared with the previous snapshot
+	unsigned int sharedPages() const { return mSharedPages; }
+	unsigned int numPages() const { return (unsigned int)mPages.size(); }
+
+	// Copy the first n objects, sharing pages with previous where they match
+	static std::shared_ptr<const ReadSnapshot<C>> make(StaticArray<C>& objects, unsigned int n, const ReadSnapshot<C>* previous){
+		static_assert(std::is_trivially_copyable<C>::value, "snapshots copy objects as raw bytes");
+		std::shared_ptr<ReadSnapshot<C>> snapshot(new ReadSnapshot<C>());
+		snapshot->mSize = n;
+		snapshot->mSharedPages = 0;
+		unsigned int numPages = (n + PER_PAGE - 1) / PER_PAGE;
+		snapshot->mPages.reserve(numPages);
+		for (unsigned int p = 0; p < numPages; p++){
+			unsigned int first = p * PER_PAGE;
+			unsigned int count = (n - first < PER_PAGE) ? (n - first) : PER_PAGE;
+			const char* live = (const char*)&objects.get(first);
+			if (previous && p < previous->mPages.size()){
+				const std::shared_ptr<const Page>& old = previous->mPages[p];
+				if (old->count == count && std::memcmp(old->data, live, count * sizeof(C)) == 0){
+					snapshot->mPages.push_back(old);
+					snapshot->mSharedPages++;
+					continue;
+				}
+			}
+			std::shared_ptr<Page> page(new Page());
+			page->count = count;
+			std::memcpy(page->data, live, count * sizeof(C));
+			snapshot->mPages.push_back(page);
+		}
+		return snapshot;
+	}
+
+protected:
+	ReadSnapshot(){}
+
+	struct Page {
+		typename std::aligned_storage<sizeof(C) * PER_PAGE, std::alignment_of<C>::value>::type data[1];
+		unsigned int count;
+
+		const C& get(unsigned int i) const {
+			return ((const C*)data)[i];
+		}
+	};
+
+	std::vector<std::shared_ptr<const Page>> mPages;
+	unsigned int mSize;
+	unsigned int mSharedPages;
+};
+
+// The component arrays published by one sync()
+class PublishedFrame {
+public:
+	PublishedFrame(unsigned int frame, unsigned int numComponents) :mFrame(frame), mArrays(numComponents){}
+
+	// Number of sync()s before this was published
+	unsigned int frame() const { return mFrame; }
+
+	// Returns nullptr if C isn't published
+	template <typename C>
+	const ReadSnapshot<C>* get() const {
+		return static_cast<const ReadSnapshot<C>*>(mArrays[C::Index()].get());
+	}
+
+protected:
+	unsigned int mFrame;
+	std::vector<std::shared_ptr<const void>> mArrays;
+	friend class EntitySystem;
+};
+
+#endif
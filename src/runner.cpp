@@ -0,0 +1,57 @@
+#include "runner.h"
+#include <algorithm>
+#include <cmath>
+
+Runner::Runner(EntitySystem& es, double step, unsigned int maxSteps)
+	:mES(es), mStep(step), mMaxSteps(maxSteps ? maxSteps : 1), mAccumulator(0), mDropped(0), mSteps(0){}
+
+void Runner::add(ISystem* system, unsigned int every, unsigned int batches){
+	if (every == 0) every = 1;
+	if (batches == 0) batches = 1;
+
+	// Stagger systems with the same rate
+	unsigned int phase = 0;
+	for (const Scheduled& s : mSchedule){
+		if (s.every == every) phase++;
+	}
+	Scheduled s = { system, every, batches, phase % every, 0 };
+	mSchedule.push_back(s);
+
+	const std::vector<ISystem*>& systems = mES.systems();
+	if (std::find(systems.begin(), systems.end(), system) == systems.end()){
+		mES.addSystem(system);
+	}
+}
+
+void Runner::addAtRate(ISystem* system, double hz, unsigned int batches){
+	double every = hz > 0 ? std::floor(1.0 / (hz * mStep) + 0.5) : 1;
+	add(system, every < 1 ? 1 : (unsigned int)every, batches);
+}
+
+unsigned int Runner::advance(double elapsed){
+	mAccumulator += elapsed;
+	double most = mMaxSteps * mStep;
+	if (mAccumulator > most){
+		mDropped += mAccumulator - most;
+		mAccumulator = most;
+	}
+
+	unsigned int steps = 0;
+	while (mAccumulator >= mStep && steps < mMaxSteps){
+		step();
+		mAccumulator -= mStep;
+		steps++;
+	}
+	return steps;
+}
+
+void Runner::step(){
+	for (Scheduled& s : mSchedule){
+		if ((mSteps + s.phase) % s.every != 0) continue;
+		FrameContext ctx = { mES, mStep * s.every * s.batches, mES.frame(), s.runs % s.batches, s.batches };
+		mES.update(s.system, ctx);
+		s.runs++;
+	}
+	mES.sync();
+	mSteps++;
+}
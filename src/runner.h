@@ -0,0 +1,73 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <vector>
+
+#include "entity.h"
+
+// Fixed timestep main loop
+// Call advance() each frame with the real time that passed. It runs as
+// many fixed steps as that covers, each ending with a sync(), and keeps
+// the remainder for next time. Each system runs every so many steps, and
+// an expensive one can be split into batches that take turns, which
+// spreads its cost over several steps.
+//
+//   Runner runner(es, 1.0 / 60);
+//   runner.add(&physics);        // 60 Hz
+//   runner.addAtRate(&health, 10);
+//   runner.add(&ai, 4, 4);       // a quarter of the AI every 4 steps
+//   ...
+//   runner.advance(frameSeconds);
+//   draw at interpolate(p, tr, runner.alpha())
+class Runner {
+public:
+	// At most maxSteps steps are run per advance(), so a slow frame
+	// doesn't make the next one slower still; time past that is dropped
+	Runner(EntitySystem& es, double step = 1.0 / 60, unsigned int maxSteps = 5);
+
+	// Update system every `every` steps
+	// With batches > 1 it's told to update one batch each time (see
+	// FrameContext::batchRange()), so each batch is updated every*batches
+	// steps, and dt is the time between updates of the same batch
+	// Systems with the same rate are staggered over the steps
+	// Adds the system to the world if it isn't already
+	void add(ISystem* system, unsigned int every = 1, unsigned int batches = 1);
+
+	// Update system at about hz
+	void addAtRate(ISystem* system, double hz, unsigned int batches = 1);
+
+	// Run the steps the elapsed seconds cover, returns how many
+	unsigned int advance(double elapsed);
+
+	// Run one step now
+	void step();
+
+	// How far the leftover time is into the next step, from 0 to 1
+	// for interpolating between the last two steps
+	double alpha() const { return mAccumulator / mStep; }
+
+	double stepSize() const { return mStep; }
+	unsigned long long steps() const { return mSteps; }
+
+	// Seconds thrown away by the catch up limit
+	double droppedTime() const { return mDropped; }
+
+protected:
+	struct Scheduled {
+		ISystem* system;
+		unsigned int every;
+		unsigned int batches;
+		unsigned int phase;
+		unsigned int runs;
+	};
+
+	EntitySystem& mES;
+	double mStep;
+	unsigned int mMaxSteps;
+	double mAccumulator;
+	double mDropped;
+	unsigned long long mSteps;
+	std::vector<Scheduled> mSchedule;
+};
+
+#endif
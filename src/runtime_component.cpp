@@ -0,0 +1,277 @@
+#include "runtime_component.h"
+#include <cstring>
+
+///////////////////////////////////////////////////////////////////////////////
+// Registry
+///////////////////////////////////////////////////////////////////////////////
+
+static std::vector<ComponentType>& runtimeTypes(){
+	static std::vector<ComponentType> types;
+	return types;
+}
+
+template <typename First>
+void staticTypeNames(std::vector<const char*>& names, const TypeList<First>& tl){
+	names[First::Index()] = First::Name();
+}
+
+template <typename First, typename... Rest>
+void staticTypeNames(std::vector<const char*>& names, const TypeList<First, Rest...>& tl){
+	names[First::Index()] = First::Name();
+	if (sizeof...(Rest)){
+		staticTypeNames(names, TypeList<Rest...>());
+	}
+}
+
+// Built on first use, which may be from any world's thread
+static const std::vector<const char*>& staticTypeNames(){
+	static const std::vector<const char*> names = [](){
+		std::vector<const char*> names(NUM_COMPONENTS);
+		staticTypeNames(names, ComponentTypeList());
+		return names;
+	}();
+	return names;
+}
+
+template <typename First>
+void staticTypeFields(std::vector<const std::vector<Field>*>& fields, const TypeList<First>& tl){
+	fields[First::Index()] = &First::Fields();
+}
+
+template <typename First, typename... Rest>
+void staticTypeFields(std::vector<const std::vector<Field>*>& fields, const TypeList<First, Rest...>& tl){
+	fields[First::Index()] = &First::Fields();
+	if (sizeof...(Rest)){
+		staticTypeFields(fields, TypeList<Rest...>());
+	}
+}
+
+static const std::vector<const std::vector<Field>*>& staticTypeFields(){
+	static const std::vector<const std::vector<Field>*> fields = [](){
+		std::vector<const std::vector<Field>*> fields(NUM_COMPONENTS);
+		staticTypeFields(fields, ComponentTypeList());
+		return fields;
+	}();
+	return fields;
+}
+
+int registerComponentType(const ComponentType& type){
+	int index = findComponentType(type.name);
+	if (index >= 0){
+		assert(index >= NUM_COMPONENTS && "a compile-time type has that name");
+		return index;
+	}
+	assert(type.alignment > 0 && type.alignment <= 64 && (type.alignment & (type.alignment - 1)) == 0);
+	runtimeTypes().push_back(type);
+	return NUM_COMPONENTS + (int)runtimeTypes().size() - 1;
+}
+
+int numComponentTypes(){
+	return NUM_COMPONENTS + (int)runtimeTypes().size();
+}
+
+const ComponentType* runtimeComponentType(int index){
+	if (index < NUM_COMPONENTS || index >= numComponentTypes()) return nullptr;
+	return &runtimeTypes()[index - NUM_COMPONENTS];
+}
+
+const char* componentTypeName(int index){
+	if (index < 0 || index >= numComponentTypes()) return nullptr;
+	if (index < NUM_COMPONENTS) return staticTypeNames()[index];
+	return runtimeTypes()[index - NUM_COMPONENTS].name;
+}
+
+const std::vector<Field>& componentFields(int index){
+	assert(index >= 0 && index < numComponentTypes());
+	if (index < NUM_COMPONENTS) return *staticTypeFields()[index];
+	return runtimeTypes()[index - NUM_COMPONENTS].fields;
+}
+
+int findComponentType(const char* name){
+	for (int i = 0; i < numComponentTypes(); i++){
+		if (std::strcmp(componentTypeName(i), name) == 0) return i;
+	}
+	return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RuntimeArray
+///////////////////////////////////////////////////////////////////////////////
+
+static unsigned int roundUp(unsigned int n, unsigned int alignment){
+	return (n + alignment - 1) / alignment * alignment;
+}
+
+RuntimeArray::RuntimeArray(const ComponentType& type, Allocator* allocator) :mType(type), mNumObjects(0), mHighWater(0), mObjects(allocator){
+	unsigned int alignment = type.alignment > alignof(Header) ? type.alignment : (unsigned int)alignof(Header);
+	mValueOffset = roundUp(sizeof(Header), alignment);
+	mStride = roundUp(mValueOffset + type.size, alignment);
+	mObjects.accommodate(MAX_OBJECTS * mStride);
+	mTemp = (char*)mObjects.allocator()->allocate(mStride, 64);
+	assert(mTemp != nullptr);
+	reset();
+}
+
+RuntimeArray::~RuntimeArray(){
+	if (mType.destroy){
+		for (unsigned int i = 0; i < mNumObjects; i++) destroyValue(record(i) + mValueOffset);
+	}
+	mObjects.allocator()->deallocate(mTemp, mStride);
+}
+
+void RuntimeArray::constructValue(void* p){
+	if (mType.construct) mType.construct(p);
+	else std::memset(p, 0, mType.size);
+}
+
+void RuntimeArray::copyValue(void* dst, const void* src){
+	if (mType.copy) mType.copy(dst, src);
+	else std::memcpy(dst, src, mType.size);
+}
+
+void RuntimeArray::destroyValue(void* p){
+	if (mType.destroy) mType.destroy(p);
+}
+
+void RuntimeArray::moveObject(char* dst, char* src){
+	std::memcpy(dst, src, sizeof(Header));
+	if (mType.move) mType.move(dst + mValueOffset, src + mValueOffset);
+	else std::memcpy(dst + mValueOffset, src + mValueOffset, mType.size);
+}
+
+ID RuntimeArray::add(ID entity, const void* value){
+	repairFreelist();
+	Index& in = mIndices[mFreelistDequeue];
+	mFreelistDequeue = in.next;
+	in.index = mNumObjects++;
+	updateHighWater();
+
+	char* r = record(in.index);
+	Header& h = *(Header*)r;
+	h.id = in.id;
+	h.entity = entity;
+	if (value) copyValue(r + mValueOffset, value);
+	else constructValue(r + mValueOffset);
+	if (entity != INVALID_ID) mOwners[entity & INDEX_MASK] = in.id;
+	return in.id;
+}
+
+void RuntimeArray::assign(ID id, const void* value){
+	void* p = this->value(id);
+	if (p == value) return;
+	destroyValue(p);
+	if (value) copyValue(p, value);
+	else constructValue(p);
+}
+
+void RuntimeArray::remove(ID id){
+	Index& in = mIndices[id & INDEX_MASK];
+	char* r = record(in.index);
+	disown(id);
+	destroyValue(r + mValueOffset);
+	in.id += NEW_OBJECT_ID_ADD;
+
+	// Move the last object into the hole
+	unsigned int last = mNumObjects - 1;
+	if (in.index != last){
+		moveObject(r, record(last));
+		mIndices[((Header*)r)->id & INDEX_MASK].index = in.index;
+	}
+	mNumObjects--;
+
+	in.index = USHRT_MAX;
+	mIndices[mFreelistEnqueue].next = id & INDEX_MASK;
+	mFreelistEnqueue = id & INDEX_MASK;
+}
+
+void RuntimeArray::swapObjects(unsigned int a, unsigned int b){
+	assert(a < mNumObjects && b < mNumObjects);
+	if (a == b) return;
+	moveObject(mTemp, record(a));
+	moveObject(record(a), record(b));
+	moveObject(record(b), mTemp);
+	mIndices[header(a).id & INDEX_MASK].index = (uint16)a;
+	mIndices[header(b).id & INDEX_MASK].index = (uint16)b;
+}
+
+// As PackedArray::releaseUnusedPages()
+size_t RuntimeArray::releaseUnusedPages(size_t budget){
+	static const size_t PAGE_SIZE = 4096;
+	size_t live = ((size_t)mNumObjects * mStride + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+	size_t touched = ((size_t)mHighWater * mStride + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+	if (touched > mObjects.bytes()) touched = mObjects.bytes();
+	if (touched <= live) return 0;
+
+	size_t bytes = touched - live;
+	if (bytes > budget) bytes = budget / PAGE_SIZE * PAGE_SIZE;
+	if (bytes == 0) return 0;
+
+	size_t released = mObjects.decommit(touched - bytes, bytes);
+	if (released > 0){
+		mHighWater = (unsigned int)((touched - bytes) / mStride);
+	}
+	return released;
+}
+
+void RuntimeArray::repairFreelist(){
+	if (!mFreelistDirty) return;
+	int first = -1, last = -1;
+	for (int i = 0; i < MAX_OBJECTS; ++i) {
+		if (mIndices[i].index == USHRT_MAX){
+			if (last >= 0) mIndices[last].next = (uint16)i;
+			else first = i;
+			last = i;
+		}
+	}
+	assert(first >= 0);
+	mFreelistDequeue = (uint16)first;
+	mFreelistEnqueue = (uint16)last;
+	mFreelistDirty = false;
+}
+
+size_t RuntimeArray::copyFrom(RuntimeArray& other){
+	assert(mStride == other.mStride);
+	if (mType.destroy){
+		for (unsigned int i = 0; i < mNumObjects; i++) destroyValue(record(i) + mValueOffset);
+	}
+	mNumObjects = other.mNumObjects;
+	updateHighWater();
+	mFreelistEnqueue = other.mFreelistEnqueue;
+	mFreelistDequeue = other.mFreelistDequeue;
+	mFreelistDirty = other.mFreelistDirty;
+	size_t written = copyChangedPages(mIndices, other.mIndices, sizeof(mIndices));
+	written += copyChangedPages(mOwners, other.mOwners, sizeof(mOwners));
+
+	if (!mType.copy){
+		return written + copyChangedPages(data(), other.data(), (size_t)mNumObjects * mStride);
+	}
+	for (unsigned int i = 0; i < mNumObjects; i++){
+		header(i) = other.header(i);
+		copyValue(record(i) + mValueOffset, other.record(i) + mValueOffset);
+	}
+	return written + (size_t)mNumObjects * mStride;
+}
+
+void RuntimeArray::clear(){
+	if (mType.destroy){
+		for (unsigned int i = 0; i < mNumObjects; i++) destroyValue(record(i) + mValueOffset);
+	}
+	reset();
+}
+
+void RuntimeArray::reset(){
+	mNumObjects = 0;
+	for (unsigned i = 0; i < MAX_OBJECTS; ++i) {
+		mIndices[i].id = i;
+		mIndices[i].next = i + 1;
+		mIndices[i].index = USHRT_MAX;
+		mOwners[i] = INVALID_ID;
+	}
+	mFreelistDequeue = 0;
+	mFreelistEnqueue = MAX_OBJECTS - 1;
+	mFreelistDirty = false;
+
+	// Add invalid component
+	ID id = add(INVALID_ID, nullptr);
+	assert(id == INVALID_ID);
+}
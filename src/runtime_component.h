@@ -0,0 +1,256 @@
+#ifndef RUNTIME_COMPONENT_H
+#define RUNTIME_COMPONENT_H
+
+#include <new>
+#include <utility>
+#include <type_traits>
+
+#include "all_components.h"
+#include "packedarray.h"
+
+// Describes a component type registered at runtime, e.g., by a plugin
+// Values are stored type-erased, so the hooks say how to handle them
+// A nullptr hook means plain bytes: zeroed, memcpy'd, nothing to destroy
+struct ComponentType {
+	const char* name;
+	unsigned int size;
+	unsigned int alignment; // a power of two, at most 64
+	int version;
+	std::vector<Field> fields; // offsets into the value
+
+	void (*construct)(void* p);               // a default value
+	void (*copy)(void* dst, const void* src); // dst is uninitialised
+	void (*move)(void* dst, void* src);       // dst is uninitialised, and src is afterwards
+	void (*destroy)(void* p);
+
+	// Fill in the hooks from a C++ type
+	template <typename T>
+	static ComponentType of(const char* name, const std::vector<Field>& fields = std::vector<Field>());
+};
+
+// Register a component type, normally at startup before any worlds exist
+// (a world made earlier picks it up the first time it's used)
+// Its index follows the ComponentTypeList ones, so it works with
+// ISystem::implements() etc. Registering a name again returns the first index
+// NB: The name and hooks must outlive the worlds, and types can't be unregistered
+int registerComponentType(const ComponentType& type);
+
+// Compile-time and runtime types
+int numComponentTypes();
+
+// nullptr for compile-time types
+const ComponentType* runtimeComponentType(int index);
+
+const char* componentTypeName(int index);
+
+// Fields() of a compile-time type, or the fields of a runtime one
+// NB: Don't hold onto it across registerComponentType()
+const std::vector<Field>& componentFields(int index);
+
+// Index of a compile-time or runtime type, or -1
+int findComponentType(const char* name);
+
+// Type-erased PackedArray for runtime component types
+// Each object is [id, entity, value] and they're stride() bytes apart
+// It also keeps which component each entity has, as entities
+// only have room for the compile-time types
+class RuntimeArray : public PackedArrayBase {
+public:
+	struct Header {
+		ID id;
+		ID entity;
+	};
+
+	// Starts with just the invalid component
+	RuntimeArray(const ComponentType& type, Allocator* allocator = nullptr);
+	~RuntimeArray();
+
+	size_t sizeOf() const override {
+		return sizeof(RuntimeArray);
+	}
+
+	const ComponentType& type() const { return mType; }
+
+	bool has(ID id){
+		Index& in = mIndices[id & INDEX_MASK];
+		return in.id == id && in.index != USHRT_MAX;
+	}
+
+	// Component of an entity, or INVALID_ID
+	ID find(ID entity){
+		ID id = mOwners[entity & INDEX_MASK];
+		return (id != INVALID_ID && header(mIndices[id & INDEX_MASK].index).entity == entity) ? id : INVALID_ID;
+	}
+
+	// PRE: has(id)
+	void* value(ID id){
+		return record(mIndices[id & INDEX_MASK].index) + mValueOffset;
+	}
+
+	void* object(ID id) override {
+		return has(id) ? value(id) : nullptr;
+	}
+
+	// Add a component to entity, a copy of value or the default if nullptr
+	// PRE: entity doesn't have one
+	ID add(ID entity, const void* value);
+
+	// Replace the value of a component, with the default if nullptr
+	void assign(ID id, const void* value);
+
+	void remove(ID id);
+
+	// Stop find() returning a component, e.g., while its removal is queued
+	void disown(ID id){
+		ID& owner = mOwners[header(mIndices[id & INDEX_MASK].index).entity & INDEX_MASK];
+		if (owner == id) owner = INVALID_ID;
+	}
+
+	unsigned int size(){
+		return mNumObjects;
+	}
+
+	unsigned int numObjects() override {
+		return mNumObjects;
+	}
+
+	unsigned int position(ID id) override {
+		return has(id) ? mIndices[id & INDEX_MASK].index : UINT_MAX;
+	}
+
+	void swapObjects(unsigned int a, unsigned int b) override;
+
+	size_t releaseUnusedPages(size_t budget) override;
+
+	void renumberFreelist() override {
+		mFreelistDirty = true;
+		repairFreelist();
+	}
+
+	Header& header(unsigned int index){
+		return *(Header*)record(index);
+	}
+
+	// Raw storage, the value of the object at index i is at
+	// data() + i * stride() + valueOffset()
+	char* data() override { return mObjects.data(); }
+	unsigned int stride() const override { return mStride; }
+	unsigned int valueOffset() const { return mValueOffset; }
+
+	unsigned int highWater() const { return mHighWater; }
+	unsigned int freeSlots() const { return MAX_OBJECTS - mNumObjects; }
+	StaticArray<char>& objects(){ return mObjects; }
+
+	static unsigned int indexBytes(){
+		return (sizeof(Index) + sizeof(ID)) * MAX_OBJECTS;
+	}
+
+	// Become a copy of another array of the same type
+	// Plain byte types only write the pages which differ
+	// Returns the number of bytes written
+	size_t copyFrom(RuntimeArray& other);
+
+	// Destroy everything but the invalid component
+	void clear();
+
+protected:
+	RuntimeArray(const RuntimeArray&) = delete;
+	RuntimeArray& operator=(const RuntimeArray&) = delete;
+
+	char* record(unsigned int index){
+		return mObjects.data() + (size_t)index * mStride;
+	}
+
+	void constructValue(void* p);
+	void copyValue(void* dst, const void* src);
+	void destroyValue(void* p);
+	// Move a whole object, leaving src uninitialised
+	void moveObject(char* dst, char* src);
+	void repairFreelist();
+	void reset();
+
+	void updateHighWater(){
+		if (mNumObjects > mHighWater) mHighWater = mNumObjects;
+	}
+
+	static const int MAX_OBJECTS = 0x10000;
+	static const int INDEX_MASK = 0xffff;
+	static const int NEW_OBJECT_ID_ADD = 0x10000;
+
+	using uint16 = unsigned short;
+	struct Index {
+		ID id;
+		uint16 index;
+		uint16 next;
+	};
+
+	ComponentType mType;
+	unsigned int mValueOffset;
+	unsigned int mStride;
+	unsigned int mNumObjects;
+	unsigned int mHighWater;
+	StaticArray<char> mObjects;
+	char* mTemp; // one object, for swaps
+	Index mIndices[MAX_OBJECTS];
+	ID mOwners[MAX_OBJECTS]; // component of each entity slot, or INVALID_ID
+
+	uint16 mFreelistEnqueue;
+	uint16 mFreelistDequeue;
+	bool mFreelistDirty;
+};
+
+class Entity;
+
+// A runtime type backed by a C++ struct, for the code that defines it
+//   static RuntimeComponent<Poison> poison("Poison");
+//   poison.add(e, Poison{ 5.f });
+//   if (poison.has(e)) poison.get(e).dps *= 2;
+template <typename T>
+class RuntimeComponent {
+public:
+	explicit RuntimeComponent(const char* name, const std::vector<Field>& fields = std::vector<Field>())
+		:mIndex(registerComponentType(ComponentType::of<T>(name, fields))){}
+
+	int index() const { return mIndex; }
+
+	bool has(Entity& e) const;
+
+	// PRE: has(e)
+	T& get(Entity& e) const;
+
+	// Replaces the value if e already has one
+	T& add(Entity& e, const T& value = T()) const;
+
+	void remove(Entity& e, bool immediately = false) const;
+
+protected:
+	int mIndex;
+};
+
+template <typename T>
+ComponentType ComponentType::of(const char* name, const std::vector<Field>& fields){
+	static_assert(std::alignment_of<T>::value <= 64, "runtime components are at most cache line aligned");
+	ComponentType type;
+	type.name = name;
+	type.size = sizeof(T);
+	type.alignment = std::alignment_of<T>::value;
+	type.version = 1;
+	type.fields = fields;
+	type.construct = [](void* p){ new(p) T(); };
+	type.copy = nullptr;
+	type.move = nullptr;
+	type.destroy = nullptr;
+	if (!std::is_trivially_copyable<T>::value){
+		type.copy = [](void* dst, const void* src){ new(dst) T(*(const T*)src); };
+		type.move = [](void* dst, void* src){
+			new(dst) T(std::move(*(T*)src));
+			((T*)src)->~T();
+		};
+	}
+	if (!std::is_trivially_destructible<T>::value){
+		type.destroy = [](void* p){ ((T*)p)->~T(); };
+	}
+	return type;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#include "scratch.h"
+
+ScratchAllocator::ScratchAllocator(size_t blockSize, Allocator* backing)
+	:mBacking(backing ? backing : Allocator::heap()), mBlock(0), mOffset(0), mUsed(0), mReserved(0), mHighWater(0){
+	addBlock(blockSize);
+}
+
+ScratchAllocator::~ScratchAllocator(){
+	freeBlocks();
+}
+
+void* ScratchAllocator::allocate(size_t bytes, size_t alignment){
+	if (alignment == 0) alignment = 1;
+	for (;;){
+		if (mBlocks.empty()){
+			if (!addBlock(bytes + alignment)) return nullptr;
+			mBlock = 0;
+			mOffset = 0;
+		}
+
+		if (mBlock < mBlocks.size()){
+			Block& b = mBlocks[mBlock];
+			size_t offset = (mOffset + alignment - 1) / alignment * alignment;
+			if (offset + bytes <= b.size){
+				mOffset = offset + bytes;
+				mUsed += bytes;
+				if (mUsed > mHighWater) mHighWater = mUsed;
+				return b.data + offset;
+			}
+		}
+
+		// Overflow into the next block, making one if needed
+		if (mBlock + 1 >= mBlocks.size()){
+			size_t size = mBlocks.empty() ? 0 : mBlocks.back().size;
+			if (size < bytes + alignment) size = bytes + alignment;
+			if (!addBlock(size)) return nullptr;
+		}
+		mBlock++;
+		mOffset = 0;
+	}
+}
+
+void ScratchAllocator::reset(){
+	if (mBlocks.size() > 1){
+		// Replace the chain with one block big enough for it
+		size_t total = mReserved;
+		freeBlocks();
+		addBlock(total);
+	}
+	mBlock = 0;
+	mOffset = 0;
+	mUsed = 0;
+}
+
+bool ScratchAllocator::addBlock(size_t bytes){
+	Block b;
+	b.size = bytes;
+	b.data = (char*)mBacking->allocate(bytes, 64);
+	if (!b.data) return false;
+	mBlocks.push_back(b);
+	mReserved += bytes;
+	return true;
+}
+
+void ScratchAllocator::freeBlocks(){
+	for (Block& b : mBlocks) mBacking->deallocate(b.data, b.size);
+	mBlocks.clear();
+	mReserved = 0;
+}
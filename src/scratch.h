@@ -0,0 +1,93 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <cstddef>
+#include <vector>
+#include <new>
+
+#include "allocator.h"
+
+// Bump allocator for memory that only lives until the next sync()
+// e.g., candidate lists, sort keys or event payloads built in a system's update
+// Allocating is a pointer bump and nothing is freed individually.
+// If a frame needs more than the block, extra blocks are chained on,
+// and the next reset() merges them so later frames fit in one block.
+// NB: Not thread safe, use one per worker (see FrameContext::scratch())
+class ScratchAllocator {
+public:
+	explicit ScratchAllocator(size_t blockSize = 1 << 20, Allocator* backing = nullptr);
+	~ScratchAllocator();
+
+	// Uninitialised memory, or nullptr if the backing allocator is out
+	void* allocate(size_t bytes, size_t alignment = DEFAULT_ALIGNMENT);
+
+	template <typename T>
+	T* allocate(size_t count){
+		return (T*)allocate(count * sizeof(T), alignof(T));
+	}
+
+	// Forget everything allocated
+	void reset();
+
+	// Bytes handed out since the last reset()
+	size_t used() const { return mUsed; }
+
+	// Bytes of blocks held
+	size_t reserved() const { return mReserved; }
+
+	// Most bytes used in one frame
+	size_t highWater() const { return mHighWater; }
+
+	static const size_t DEFAULT_ALIGNMENT = 16;
+
+protected:
+	ScratchAllocator(const ScratchAllocator&) = delete;
+	ScratchAllocator& operator=(const ScratchAllocator&) = delete;
+
+	struct Block {
+		char* data;
+		size_t size;
+	};
+
+	bool addBlock(size_t bytes);
+	void freeBlocks();
+
+	Allocator* mBacking;
+	std::vector<Block> mBlocks;
+	size_t mBlock;  // current block
+	size_t mOffset; // into the current block
+	size_t mUsed;
+	size_t mReserved;
+	size_t mHighWater;
+};
+
+// Lets standard containers use scratch memory
+//   ScratchVector<ID> candidates(ScratchStlAllocator<ID>(ctx.scratch()));
+// Deallocating is a no-op, the memory goes at the next reset()
+template <typename T>
+class ScratchStlAllocator {
+public:
+	typedef T value_type;
+	template <typename U> struct rebind { typedef ScratchStlAllocator<U> other; };
+
+	ScratchStlAllocator(ScratchAllocator& scratch) :mScratch(&scratch){}
+	template <typename U> ScratchStlAllocator(const ScratchStlAllocator<U>& other) :mScratch(other.mScratch){}
+
+	T* allocate(size_t n){
+		T* p = mScratch->allocate<T>(n);
+		if (!p) throw std::bad_alloc();
+		return p;
+	}
+
+	void deallocate(T* p, size_t n){}
+
+	template <typename U> bool operator==(const ScratchStlAllocator<U>& rhs) const { return mScratch == rhs.mScratch; }
+	template <typename U> bool operator!=(const ScratchStlAllocator<U>& rhs) const { return mScratch != rhs.mScratch; }
+
+	ScratchAllocator* mScratch;
+};
+
+template <typename T>
+using ScratchVector = std::vector<T, ScratchStlAllocator<T>>;
+
+#endif
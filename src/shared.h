@@ -0,0 +1,269 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+#include "component.h"
+
+// Shared (flyweight) components
+//
+// Lots of entities often carry the same value of a component, e.g.,
+// the same Description or a default Health. A Shared<C> component is
+// just a handle to one copy of the value in the world's SharedPool<C>,
+// where values are hash deduplicated and reference counted.
+// Writing through Entity::modifyShared() first copies a value that
+// other entities use into a private one (copy on write).
+// Systems can visit each distinct value once with SharedPool::forEach().
+//
+// Values are hashed and compared by their Fields(), so C must
+// describe them, and mustn't keep data outside its record (e.g., Inventory).
+
+// Type erased pool, used by serialisation
+// Handles are in [1, capacity()), 0 means no value
+class SharedPoolBase {
+public:
+	// Each value in use is held by at least one Shared<C> component,
+	// and freed handles are reused, so there are never more handles
+	static const unsigned int MAX_CAPACITY = 0x10000;
+
+	virtual ~SharedPoolBase(){}
+
+	virtual const char* name() const = 0; // of the value type
+	virtual int version() const = 0;
+	virtual unsigned int valueSize() const = 0;
+	virtual const std::vector<Field>& fields() const = 0;    // C::Fields()
+	virtual const std::vector<Field>& allFields() const = 0; // C::AllFields()
+	virtual unsigned int capacity() const = 0;
+
+	// Raw C record of a live handle
+	virtual const char* value(unsigned int handle) const = 0;
+	// Write a default constructed C record
+	virtual void defaultValue(char* value) const = 0;
+	// Handle to a copy of a raw C record, adds a reference
+	virtual unsigned int acquireRaw(const char* value) = 0;
+
+	virtual void addRef(unsigned int handle) = 0;
+	virtual void release(unsigned int handle) = 0;
+	virtual void clear() = 0;
+	virtual void copyFrom(const SharedPoolBase& other) = 0;
+};
+
+template <typename C>
+class SharedPool : public SharedPoolBase {
+public:
+	SharedPool() :mEntries(1), mSize(0){
+		static_assert(std::is_trivially_copyable<C>::value, "shared values are copied as raw bytes");
+	}
+
+	// Handle to a copy of value, adds a reference
+	unsigned int acquire(const C& value){
+		uint32_t hash = hashValue(value);
+		auto range = mIndex.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it){
+			Entry& e = mEntries[it->second];
+			if (sameValue(e.value, value)){
+				e.refs++;
+				return it->second;
+			}
+		}
+
+		unsigned int handle = allocate();
+		Entry& e = mEntries[handle];
+		e.value = value;
+		e.value.id = INVALID_ID;
+		e.value.entity = INVALID_ID;
+		e.refs = 1;
+		e.hash = hash;
+		e.indexed = true;
+		mIndex.insert(std::make_pair(hash, handle));
+		return handle;
+	}
+
+	// NB: Don't retain the ref, it may move when values are added
+	const C& get(unsigned int handle) const {
+		return mEntries[handle].value;
+	}
+
+	// Make handle refer to a value nobody else uses, so it can be written
+	// The value is no longer deduplicated
+	C& modify(unsigned int& handle){
+		assert(handle != 0 && mEntries[handle].refs > 0);
+		if (mEntries[handle].refs == 1){
+			unindex(handle);
+			return mEntries[handle].value;
+		}
+
+		C value = mEntries[handle].value;
+		mEntries[handle].refs--;
+		handle = allocate();
+		Entry& e = mEntries[handle];
+		e.value = value;
+		e.refs = 1;
+		e.hash = 0;
+		e.indexed = false;
+		return e.value;
+	}
+
+	unsigned int refs(unsigned int handle) const {
+		return mEntries[handle].refs;
+	}
+
+	// Number of distinct values in use
+	unsigned int size() const {
+		return mSize;
+	}
+
+	// Call f(const C& value, unsigned int refs) once for each value in use
+	template <typename F>
+	void forEach(F f) const {
+		for (unsigned int i = 1; i < mEntries.size(); i++){
+			if (mEntries[i].refs) f(mEntries[i].value, mEntries[i].refs);
+		}
+	}
+
+	// SharedPoolBase
+	const char* name() const override { return C::Name(); }
+	int version() const override { return C::Version(); }
+	unsigned int valueSize() const override { return sizeof(C); }
+	const std::vector<Field>& fields() const override { return C::Fields(); }
+	const std::vector<Field>& allFields() const override { return C::AllFields(); }
+	unsigned int capacity() const override { return (unsigned int)mEntries.size(); }
+
+	const char* value(unsigned int handle) const override {
+		return (const char*)&mEntries[handle].value;
+	}
+
+	void defaultValue(char* value) const override {
+		C c;
+		std::memcpy(value, &c, sizeof(C));
+	}
+
+	unsigned int acquireRaw(const char* value) override {
+		C c;
+		std::memcpy(&c, value, sizeof(C));
+		return acquire(c);
+	}
+
+	void addRef(unsigned int handle) override {
+		if (handle != 0) mEntries[handle].refs++;
+	}
+
+	void release(unsigned int handle) override {
+		if (handle == 0) return;
+		assert(mEntries[handle].refs > 0);
+		if (--mEntries[handle].refs == 0){
+			unindex(handle);
+			mFree.push_back(handle);
+			mSize--;
+		}
+	}
+
+	void clear() override {
+		mEntries.assign(1, Entry());
+		mFree.clear();
+		mIndex.clear();
+		mSize = 0;
+	}
+
+	void copyFrom(const SharedPoolBase& other) override {
+		const SharedPool<C>& o = static_cast<const SharedPool<C>&>(other);
+		mEntries = o.mEntries;
+		mFree = o.mFree;
+		mIndex = o.mIndex;
+		mSize = o.mSize;
+	}
+
+protected:
+	struct Entry {
+		C value;
+		unsigned int refs;
+		uint32_t hash;
+		bool indexed; // false for private values
+		Entry() :refs(0), hash(0), indexed(false){}
+	};
+
+	unsigned int allocate(){
+		mSize++;
+		if (!mFree.empty()){
+			unsigned int handle = mFree.back();
+			mFree.pop_back();
+			return handle;
+		}
+		mEntries.push_back(Entry());
+		return (unsigned int)mEntries.size() - 1;
+	}
+
+	void unindex(unsigned int handle){
+		Entry& e = mEntries[handle];
+		if (!e.indexed) return;
+		auto range = mIndex.equal_range(e.hash);
+		for (auto it = range.first; it != range.second; ++it){
+			if (it->second == handle){
+				mIndex.erase(it);
+				break;
+			}
+		}
+		e.indexed = false;
+	}
+
+	// FNV-1a over the fields, so padding is ignored
+	static uint32_t hashValue(const C& value){
+		const char* p = (const char*)&value;
+		uint32_t hash = 2166136261u;
+		for (const Field& f : C::Fields()){
+			for (unsigned int i = 0; i < f.size; i++){
+				hash = (hash ^ (unsigned char)p[f.offset + i]) * 16777619u;
+			}
+		}
+		return hash;
+	}
+
+	static bool sameValue(const C& a, const C& b){
+		for (const Field& f : C::Fields()){
+			if (std::memcmp((const char*)&a + f.offset, (const char*)&b + f.offset, f.size) != 0) return false;
+		}
+		return true;
+	}
+
+	std::vector<Entry> mEntries; // by handle, 0 is unused
+	std::vector<unsigned int> mFree;
+	std::unordered_multimap<uint32_t, unsigned int> mIndex; // hash to handle
+	unsigned int mSize;
+};
+
+// A handle to a value of C in the world's SharedPool<C>
+// Add, read and write it through Entity::addShared(), getShared() and modifyShared()
+template <typename C>
+struct Shared : public Component<Shared<C>> {
+	static const char* Name(){
+		static const std::string name = std::string("Shared ") + C::Name();
+		return name.c_str();
+	}
+
+	unsigned int handle;
+
+	Shared() :handle(0){}
+
+	static const std::vector<Field>& Fields(){
+		static const std::vector<Field> fields = {
+			Field{ "handle", fieldOffset<Shared>(&Shared::handle), (unsigned int)sizeof(unsigned int), FieldType::Shared, Component<Shared<C>>::Index() }
+		};
+		return fields;
+	}
+
+	std::string what() {
+		std::ostringstream oss;
+		oss << "shared {";
+		COM_LOG(handle);
+		oss << "}";
+		return oss.str();
+	}
+};
+
+#endif
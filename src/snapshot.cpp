@@ -0,0 +1,481 @@
+#include "entity.h"
+#include "string_pool.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+///////////////////////////////////////////////////////////////////////////////
+// SnapshotWriter
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t SnapshotWriter::write(const void* data, size_t bytes){
+	uint64_t offset = mData.size();
+	const char* p = (const char*)data;
+	mData.insert(mData.end(), p, p + bytes);
+	return offset;
+}
+
+uint64_t SnapshotWriter::align(size_t alignment){
+	size_t padding = (alignment - (mData.size() % alignment)) % alignment;
+	mData.resize(mData.size() + padding, 0);
+	return mData.size();
+}
+
+bool SnapshotWriter::save(const char* path){
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out) return false;
+	out.write(mData.data(), mData.size());
+	return (bool)out;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Strings
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t SnapshotStringTable::number(unsigned int handle){
+	if (handle == 0) return 0;
+	auto it = mNumbers.find(handle);
+	if (it != mNumbers.end()) return it->second;
+	uint32_t n = (uint32_t)mHandles.size();
+	mHandles.push_back(handle);
+	mNumbers[handle] = n;
+	return n;
+}
+
+void SnapshotStringTable::remap(SnapshotWriter& writer, uint64_t offset, unsigned int count, unsigned int recordSize, const std::vector<Field>& fields){
+	for (const Field& f : fields){
+		if (f.type != FieldType::String) continue;
+		for (unsigned int i = 0; i < count; i++){
+			char* p = writer.at(offset + (uint64_t)i * recordSize + f.offset);
+			unsigned int handle;
+			std::memcpy(&handle, p, sizeof(handle));
+			uint32_t n = number(handle);
+			std::memcpy(p, &n, sizeof(n));
+		}
+	}
+}
+
+void SnapshotStringTable::write(SnapshotWriter& writer){
+	StringPool& pool = StringPool::instance();
+	uint32_t count = (uint32_t)mHandles.size();
+	writer.write(&count, sizeof(count));
+
+	std::vector<const char*> strings(count);
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < count; i++){
+		strings[i] = pool.str(mHandles[i]);
+		writer.write(&offset, sizeof(offset));
+		offset += (uint32_t)std::strlen(strings[i]) + 1;
+	}
+	for (uint32_t i = 0; i < count; i++){
+		writer.write(strings[i], std::strlen(strings[i]) + 1);
+	}
+}
+
+SnapshotStrings::SnapshotStrings(const char* data, size_t size) :mChars(nullptr), mCharsSize(0), mOffsets(nullptr), mCount(0), mValid(false){
+	if (size < sizeof(uint32_t)) return;
+	std::memcpy(&mCount, data, sizeof(uint32_t));
+	if ((uint64_t)mCount * sizeof(uint32_t) > size - sizeof(uint32_t)) return;
+	mOffsets = data + sizeof(uint32_t);
+	mChars = mOffsets + mCount * sizeof(uint32_t);
+	mCharsSize = size - (mChars - data);
+	mRemapped.assign(mCount, ~0u);
+	mValid = true;
+}
+
+unsigned int SnapshotStrings::remap(unsigned int handle){
+	if (handle == 0 || handle >= mCount) return 0;
+	if (mRemapped[handle] == ~0u){
+		uint32_t offset;
+		std::memcpy(&offset, mOffsets + handle * sizeof(uint32_t), sizeof(offset));
+		const char* end = offset < mCharsSize ? (const char*)std::memchr(mChars + offset, '\0', mCharsSize - offset) : nullptr;
+		mRemapped[handle] = end ? StringPool::instance().intern(mChars + offset, end - (mChars + offset)) : 0;
+	}
+	return mRemapped[handle];
+}
+
+void SnapshotStrings::remap(char* records, unsigned int count, unsigned int recordSize, const std::vector<Field>& fields){
+	for (const Field& f : fields){
+		if (f.type != FieldType::String) continue;
+		for (unsigned int i = 0; i < count; i++){
+			unsigned int* handle = (unsigned int*)(records + (size_t)i * recordSize + f.offset);
+			*handle = remap(*handle);
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Items
+///////////////////////////////////////////////////////////////////////////////
+
+void writeSnapshotItems(SnapshotWriter& writer, ItemSlab& items){
+	uint32_t numStacks = (uint32_t)items.stacks().size();
+	writer.write(&numStacks, sizeof(numStacks));
+	writer.write(items.freelists(), sizeof(unsigned int) * ItemSlab::NUM_CLASSES);
+	writer.write(items.stacks().data(), numStacks * sizeof(ItemAndCount));
+}
+
+bool readSnapshotItems(const char* data, size_t size, ItemSlab& items){
+	const size_t header = sizeof(uint32_t) + sizeof(unsigned int) * ItemSlab::NUM_CLASSES;
+	if (size < header) return false;
+	uint32_t numStacks;
+	std::memcpy(&numStacks, data, sizeof(numStacks));
+	if ((uint64_t)numStacks * sizeof(ItemAndCount) > size - header) return false;
+
+	std::memcpy(items.freelists(), data + sizeof(uint32_t), sizeof(unsigned int) * ItemSlab::NUM_CLASSES);
+	const ItemAndCount* stacks = (const ItemAndCount*)(data + header);
+	items.stacks().assign(stacks, stacks + numStacks);
+	return items.validFreelists();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Shared values
+///////////////////////////////////////////////////////////////////////////////
+
+void writeSnapshotShared(SnapshotWriter& writer, const std::vector<SharedPoolBase*>& pools, SnapshotStringTable& strings){
+	uint64_t numPools = 0;
+	for (SharedPoolBase* pool : pools){
+		if (pool) numPools++;
+	}
+	writer.write(&numPools, sizeof(numPools));
+
+	// Array headers are patched as each pool is written
+	uint64_t arrayOffset = writer.offset();
+	SnapshotArray blank;
+	std::memset(&blank, 0, sizeof(blank));
+	for (uint64_t i = 0; i < numPools; i++){
+		writer.write(&blank, sizeof(blank));
+	}
+
+	for (SharedPoolBase* pool : pools){
+		if (!pool) continue;
+		SnapshotArray sa;
+		std::memset(&sa, 0, sizeof(sa));
+		setSnapshotName(sa.name, pool->name());
+		sa.version = pool->version();
+		sa.objectSize = pool->valueSize();
+		sa.numObjects = pool->capacity();
+		sa.numFields = (uint32_t)pool->allFields().size();
+		sa.fieldsOffset = writeSnapshotFields(writer, pool->allFields());
+		sa.objectsOffset = writer.align();
+		for (unsigned int h = 0; h < pool->capacity(); h++){
+			writer.write(pool->value(h), pool->valueSize());
+		}
+		strings.remap(writer, sa.objectsOffset, sa.numObjects, sa.objectSize, pool->allFields());
+		writer.patch(arrayOffset, sa);
+		arrayOffset += sizeof(SnapshotArray);
+	}
+}
+
+SnapshotShared::SnapshotShared(const char* data, size_t size, uint64_t offset, SnapshotStrings& strings, const std::vector<SharedPoolBase*>& pools) 
+	:mData(data), mStrings(strings), mPools(pools), mArrays(pools.size(), nullptr), mRemapped(pools.size()), mValid(false){
+	uint64_t numPools;
+	if (offset > size || sizeof(numPools) > size - offset) return;
+	std::memcpy(&numPools, data + offset, sizeof(numPools));
+	uint64_t arraysOffset = offset + sizeof(numPools);
+	if (numPools > (size - arraysOffset) / sizeof(SnapshotArray)) return;
+
+	const SnapshotArray* arrays = (const SnapshotArray*)(data + arraysOffset);
+	for (uint64_t i = 0; i < numPools; i++){
+		const SnapshotArray& sa = arrays[i];
+		if (sa.numObjects > SharedPoolBase::MAX_CAPACITY) return;
+		if (sa.fieldsOffset > size || (uint64_t)sa.numFields * sizeof(SnapshotField) > size - sa.fieldsOffset) return;
+		if (sa.objectsOffset > size || (uint64_t)sa.numObjects * sa.objectSize > size - sa.objectsOffset) return;
+		const SnapshotField* fields = (const SnapshotField*)(data + sa.fieldsOffset);
+		for (unsigned int j = 0; j < sa.numFields; j++){
+			if ((uint64_t)fields[j].offset + fields[j].size > sa.objectSize) return;
+		}
+
+		// Pools which aren't around any more are skipped
+		for (size_t p = 0; p < pools.size(); p++){
+			if (pools[p] && std::strncmp(sa.name, pools[p]->name(), SNAPSHOT_NAME_SIZE - 1) == 0){
+				// Values of another size can only be converted field by field
+				if (sa.objectSize != pools[p]->valueSize() && sa.numFields == 0) return;
+				mArrays[p] = &sa;
+				mRemapped[p].assign(sa.numObjects, 0);
+			}
+		}
+	}
+	mValid = true;
+}
+
+unsigned int SnapshotShared::remap(int pool, unsigned int handle){
+	const SnapshotArray* sa = mArrays[pool];
+	if (handle == 0 || sa == nullptr || handle >= sa->numObjects) return 0;
+
+	SharedPoolBase* p = mPools[pool];
+	unsigned int& remapped = mRemapped[pool][handle];
+	if (remapped != 0){
+		p->addRef(remapped);
+		return remapped;
+	}
+
+	std::vector<char> value(p->valueSize());
+	const SnapshotField* srcFields = (const SnapshotField*)(mData + sa->fieldsOffset);
+	const char* src = mData + sa->objectsOffset + (size_t)handle * sa->objectSize;
+	if (sameLayout(p->allFields(), p->valueSize(), *sa, srcFields)){
+		std::memcpy(value.data(), src, p->valueSize());
+	}
+	else {
+		p->defaultValue(value.data());
+		convertRecord(value.data(), p->allFields(), src, srcFields, sa->numFields);
+	}
+	mStrings.remap(value.data(), 1, p->valueSize(), p->allFields());
+	remapped = p->acquireRaw(value.data());
+	return remapped;
+}
+
+void SnapshotShared::remap(char* records, unsigned int count, unsigned int recordSize, const std::vector<Field>& fields){
+	for (const Field& f : fields){
+		if (f.type != FieldType::Shared) continue;
+		for (unsigned int i = 0; i < count; i++){
+			unsigned int* handle = (unsigned int*)(records + (size_t)i * recordSize + f.offset);
+			*handle = remap(f.shared, *handle);
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Schema helpers
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t writeSnapshotFields(SnapshotWriter& writer, const std::vector<Field>& fields){
+	uint64_t offset = writer.align();
+	for (const Field& f : fields){
+		SnapshotField sf;
+		std::memset(&sf, 0, sizeof(sf));
+		setSnapshotName(sf.name, f.name);
+		sf.offset = f.offset;
+		sf.size = f.size;
+		sf.type = (uint32_t)f.type;
+		writer.write(&sf, sizeof(sf));
+	}
+	return offset;
+}
+
+void setSnapshotName(char* dst, const char* name){
+	std::memset(dst, 0, SNAPSHOT_NAME_SIZE);
+	std::strncpy(dst, name, SNAPSHOT_NAME_SIZE - 1);
+}
+
+static bool sameName(const char* snapshotName, const char* name){
+	return std::strncmp(snapshotName, name, SNAPSHOT_NAME_SIZE - 1) == 0;
+}
+
+void convertRecord(char* dst, const std::vector<Field>& dstFields, const char* src, const SnapshotField* srcFields, unsigned int numSrcFields){
+	for (const Field& f : dstFields){
+		for (unsigned int i = 0; i < numSrcFields; i++){
+			const SnapshotField& sf = srcFields[i];
+			if (sameName(sf.name, f.name)){
+				if (sf.size == f.size && sf.type == (uint32_t)f.type){
+					std::memcpy(dst + f.offset, src + sf.offset, f.size);
+				}
+				break;
+			}
+		}
+	}
+}
+
+bool sameLayout(const std::vector<Field>& fields, unsigned int objectSize, const SnapshotArray& array, const SnapshotField* srcFields){
+	if (array.objectSize != objectSize || array.numFields != fields.size()) return false;
+	for (unsigned int i = 0; i < array.numFields; i++){
+		const Field& f = fields[i];
+		const SnapshotField& sf = srcFields[i];
+		if (!sameName(sf.name, f.name) || sf.offset != f.offset || sf.size != f.size || sf.type != (uint32_t)f.type){
+			return false;
+		}
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Entity
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename First>
+void addEntityFields(std::vector<Field>& fields, std::vector<std::string>& names, unsigned int componentsOffset, unsigned int hasOffset, const TypeList<First>& tl){
+	names.push_back(std::string("has ") + First::Name());
+	fields.push_back(Field{ First::Name(), componentsOffset + First::Index() * (unsigned int)sizeof(ID), sizeof(ID), FieldType::UInt, 0 });
+	fields.push_back(Field{ names.back().c_str(), hasOffset + First::Index(), sizeof(bool), FieldType::Bool, 0 });
+}
+
+template <typename First, typename... Rest>
+void addEntityFields(std::vector<Field>& fields, std::vector<std::string>& names, unsigned int componentsOffset, unsigned int hasOffset, const TypeList<First, Rest...>& tl){
+	addEntityFields(fields, names, componentsOffset, hasOffset, TypeList<First>());
+	if (sizeof...(Rest)){
+		addEntityFields(fields, names, componentsOffset, hasOffset, TypeList<Rest...>());
+	}
+}
+
+const std::vector<Field>& Entity::Fields(){
+	// NB: reserved up front so the names don't move
+	// Built on first use, which may be from any world's thread
+	static std::vector<std::string> hasNames;
+	static const std::vector<Field> fields = [](){
+		std::vector<Field> fields;
+		hasNames.reserve(NUM_COMPONENTS);
+		fields.push_back(COM_FIELD(Entity, id));
+		addEntityFields(fields, hasNames, fieldOffset<Entity>(&Entity::mComponents), fieldOffset<Entity>(&Entity::mHasComponent), ComponentTypeList());
+		return fields;
+	}();
+	return fields;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// EntitySystem
+///////////////////////////////////////////////////////////////////////////////
+
+bool EntitySystem::save(const char* path){
+	SnapshotWriter writer;
+	SnapshotHeader header;
+	std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.numArrays = 1 + NUM_COMPONENTS;
+	header.indexBytes = PackedArray<Entity>::indexBytes();
+	header.stringsOffset = 0;
+	header.itemsOffset = 0;
+	header.sharedOffset = 0;
+	writer.write(&header, sizeof(header));
+
+	// Array headers are patched as each array is written
+	uint64_t arrayOffset = writer.offset();
+	SnapshotArray blank;
+	std::memset(&blank, 0, sizeof(blank));
+	for (unsigned int i = 0; i < header.numArrays; i++){
+		writer.write(&blank, sizeof(blank));
+	}
+
+	SnapshotStringTable strings;
+	saveArray(writer, strings, arrayOffset, mEntities, "Entity", 1, Entity::Fields());
+	saveComponentArrays(writer, strings, arrayOffset + sizeof(SnapshotArray), ComponentTypeList());
+
+	header.itemsOffset = writer.align();
+	writeSnapshotItems(writer, mItems);
+	header.sharedOffset = writer.align();
+	writeSnapshotShared(writer, mSharedPools, strings);
+	header.stringsOffset = writer.align();
+	strings.write(writer);
+	writer.patch(0, header);
+
+	if (!writer.save(path)){
+		std::cerr << "EntitySystem: couldn't write snapshot " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+const SnapshotArray* EntitySystem::findSnapshotArray(const MappedFile& file, const char* name){
+	const SnapshotHeader* header = (const SnapshotHeader*)file.data();
+	const SnapshotArray* arrays = (const SnapshotArray*)(file.data() + sizeof(SnapshotHeader));
+	for (unsigned int i = 0; i < header->numArrays; i++){
+		if (sameName(arrays[i].name, name)) return &arrays[i];
+	}
+	return nullptr;
+}
+
+static bool validSnapshot(const MappedFile& file){
+	if (file.size() < sizeof(SnapshotHeader)) return false;
+	const SnapshotHeader* header = (const SnapshotHeader*)file.data();
+	if (std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) return false;
+	if (header->version != SNAPSHOT_VERSION) return false;
+	if (header->indexBytes != PackedArray<Entity>::indexBytes()) return false;
+
+	uint64_t size = file.size();
+	if (header->stringsOffset > size || header->itemsOffset > size || header->sharedOffset > size) return false;
+	if (sizeof(SnapshotHeader) + (uint64_t)header->numArrays * sizeof(SnapshotArray) > size) return false;
+	const SnapshotArray* arrays = (const SnapshotArray*)(file.data() + sizeof(SnapshotHeader));
+	for (unsigned int i = 0; i < header->numArrays; i++){
+		const SnapshotArray& sa = arrays[i];
+		if (sa.numObjects > PackedArray<Entity>::maxObjects()) return false;
+		if (sa.fieldsOffset > size || (uint64_t)sa.numFields * sizeof(SnapshotField) > size - sa.fieldsOffset) return false;
+		if (sa.indicesOffset > size || header->indexBytes > size - sa.indicesOffset) return false;
+		if (sa.objectsOffset > size || (uint64_t)sa.numObjects * sa.objectSize > size - sa.objectsOffset) return false;
+		if (!PackedArray<Entity>::validIndices(sa.numObjects, file.data() + sa.indicesOffset, sa.freelistEnqueue, sa.freelistDequeue)) return false;
+		const SnapshotField* fields = (const SnapshotField*)(file.data() + sa.fieldsOffset);
+		for (unsigned int j = 0; j < sa.numFields; j++){
+			if ((uint64_t)fields[j].offset + fields[j].size > sa.objectSize) return false;
+		}
+	}
+	return true;
+}
+
+// Inventories must point at valid stacks in the slab saved with them
+static bool validSnapshotInventories(const MappedFile& file, const ItemSlab& items){
+	const SnapshotHeader* header = (const SnapshotHeader*)file.data();
+	const SnapshotArray* arrays = (const SnapshotArray*)(file.data() + sizeof(SnapshotHeader));
+	for (unsigned int i = 0; i < header->numArrays; i++){
+		const SnapshotArray& sa = arrays[i];
+		const SnapshotField* fields = (const SnapshotField*)(file.data() + sa.fieldsOffset);
+		for (unsigned int j = 0; j < sa.numFields; j++){
+			if ((FieldType)fields[j].type != FieldType::Items || fields[j].size != sizeof(ItemStacks)) continue;
+			for (unsigned int k = 0; k < sa.numObjects; k++){
+				ItemStacks stacks;
+				std::memcpy(&stacks, file.data() + sa.objectsOffset + (size_t)k * sa.objectSize + fields[j].offset, sizeof(stacks));
+				if (!items.valid(stacks)) return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool EntitySystem::load(const char* path){
+	MappedFile file;
+	if (!file.open(path)){
+		std::cerr << "EntitySystem: couldn't open snapshot " << path << std::endl;
+		return false;
+	}
+	const SnapshotArray* entities = validSnapshot(file) ? findSnapshotArray(file, "Entity") : nullptr;
+	if (entities == nullptr){
+		std::cerr << "EntitySystem: " << path << " isn't a valid snapshot" << std::endl;
+		return false;
+	}
+
+	const SnapshotHeader* header = (const SnapshotHeader*)file.data();
+	// The table runs up to the next section, if any
+	uint64_t stringsEnd = file.size();
+	for (uint64_t offset : { header->itemsOffset, header->sharedOffset }){
+		if (offset > header->stringsOffset && offset < stringsEnd) stringsEnd = offset;
+	}
+	SnapshotStrings strings(file.data() + header->stringsOffset, (size_t)(stringsEnd - header->stringsOffset));
+	if (!strings.valid()){
+		std::cerr << "EntitySystem: " << path << " has a bad string table" << std::endl;
+		return false;
+	}
+
+	ItemSlab items;
+	if (!readSnapshotItems(file.data() + header->itemsOffset, (size_t)(file.size() - header->itemsOffset), items) ||
+		!validSnapshotInventories(file, items)){
+		std::cerr << "EntitySystem: " << path << " has a bad item slab" << std::endl;
+		return false;
+	}
+
+	// Values are only added to the pools as records refer to them
+	SnapshotShared shared(file.data(), file.size(), header->sharedOffset, strings, mSharedPools);
+	if (!shared.valid()){
+		std::cerr << "EntitySystem: " << path << " has bad shared values" << std::endl;
+		return false;
+	}
+
+	// All checked, so nothing fails from here and the world can be replaced
+	std::swap(mItems, items);
+	for (SharedPoolBase* pool : mSharedPools){
+		if (pool) pool->clear();
+	}
+	mEntitiesToBeRemoved.clear();
+	for (std::vector<ID>& v : mComponentsToBeRemoved) v.clear();
+	// They'd go off for whatever the snapshot has in their entities' slots
+	mTimers.clear();
+
+	loadArray(file, strings, shared, *entities, mEntities, Entity::Fields());
+	for (unsigned int i = 0; i < mEntities.size(); i++){
+		mEntities.objects().get(i).mES = this;
+	}
+	loadComponentArrays(file, strings, shared, ComponentTypeList());
+
+	// Runtime types aren't saved
+	for (size_t i = NUM_COMPONENTS; i < mComponents.size(); i++){
+		static_cast<RuntimeArray*>(mComponents[i])->clear();
+	}
+	rebuildIndexes();
+	return true;
+}
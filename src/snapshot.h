@@ -0,0 +1,181 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+
+#include "component.h"
+
+// Binary world snapshots (see EntitySystem::save() and load())
+//
+// Layout:
+//   SnapshotHeader
+//   SnapshotArray[numArrays]  (entities first, then one per component type)
+//   For each array: SnapshotField[numFields], index table, objects
+//   Item slab: uint32 numStacks, uint32 freelists[ItemSlab::NUM_CLASSES], ItemAndCount[numStacks]
+//   Shared values: uint64 numPools, SnapshotArray[numPools], then for each 
+//     pool: SnapshotField[numFields], values by handle (no index table)
+//   String table: uint32 numStrings, uint32 offsets[numStrings], chars
+//
+// Every array stores its schema (name, version and field table)
+// so a file can still be loaded after fields are added or moved.
+// When the schema matches the objects are copied in one block,
+// otherwise they are converted field by field.
+// String fields hold StringPool handles, which only mean something in 
+// the process that wrote them, so they're written as numbers in the 
+// string table, which only holds the strings the snapshot refers to.
+// Shared fields are handles into a SharedPool, so each value is added to 
+// the loading world's pool again, which also restores the reference counts.
+
+static const char SNAPSHOT_MAGIC[4] = { 'E', 'C', 'S', 'W' };
+static const unsigned int SNAPSHOT_VERSION = 4;
+static const unsigned int SNAPSHOT_ALIGNMENT = 64;
+static const int SNAPSHOT_NAME_SIZE = 32;
+
+struct SnapshotHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t numArrays;
+	uint32_t indexBytes;
+	uint64_t stringsOffset;
+	uint64_t itemsOffset;
+	uint64_t sharedOffset;
+};
+
+struct SnapshotArray {
+	char name[SNAPSHOT_NAME_SIZE];
+	uint32_t version;
+	uint32_t objectSize;
+	uint32_t numObjects;
+	uint32_t numFields;
+	uint32_t freelistEnqueue;
+	uint32_t freelistDequeue;
+	uint64_t fieldsOffset;
+	uint64_t indicesOffset;
+	uint64_t objectsOffset;
+};
+
+struct SnapshotField {
+	char name[SNAPSHOT_NAME_SIZE];
+	uint32_t offset;
+	uint32_t size;
+	uint32_t type;
+	uint32_t pad;
+};
+
+// Accumulates a snapshot in memory so it can be written in one go
+class SnapshotWriter {
+public:
+	// Append some bytes, returns their offset
+	uint64_t write(const void* data, size_t bytes);
+
+	// Pad to a multiple of alignment, returns the new offset
+	uint64_t align(size_t alignment = SNAPSHOT_ALIGNMENT);
+
+	uint64_t offset() const { return mData.size(); }
+
+	// Overwrite something written earlier
+	template <typename T>
+	void patch(uint64_t offset, const T& t){
+		std::memcpy(&mData[(size_t)offset], &t, sizeof(T));
+	}
+
+	// Bytes written earlier, valid until the next write()
+	char* at(uint64_t offset){ return &mData[(size_t)offset]; }
+
+	bool save(const char* path);
+
+protected:
+	std::vector<char> mData;
+};
+
+// Gathers the strings a snapshot refers to as it's written
+// They're numbered from 1 in the order they're met (0 is "")
+class SnapshotStringTable {
+public:
+	SnapshotStringTable() :mHandles(1, 0){}
+
+	// Replace the String fields of the count records written at offset
+	// with their numbers in the table
+	void remap(SnapshotWriter& writer, uint64_t offset, unsigned int count, unsigned int recordSize, const std::vector<Field>& fields);
+
+	void write(SnapshotWriter& writer);
+
+protected:
+	uint32_t number(unsigned int handle);
+
+	std::unordered_map<unsigned int, uint32_t> mNumbers; // handle -> number
+	std::vector<unsigned int> mHandles; // number -> handle
+};
+
+// Write/read the ItemSlab of a world
+// Items fields are kept as they are, since the slab is restored as a block
+class ItemSlab;
+void writeSnapshotItems(SnapshotWriter& writer, ItemSlab& items);
+bool readSnapshotItems(const char* data, size_t size, ItemSlab& items);
+
+// Write the values of each SharedPool of a world
+class SharedPoolBase;
+void writeSnapshotShared(SnapshotWriter& writer, const std::vector<SharedPoolBase*>& pools, SnapshotStringTable& strings);
+
+// Write a field table, returns its offset
+uint64_t writeSnapshotFields(SnapshotWriter& writer, const std::vector<Field>& fields);
+
+// Reads the string table of a snapshot
+class SnapshotStrings {
+public:
+	SnapshotStrings(const char* data, size_t size);
+
+	bool valid() const { return mValid; }
+
+	// Map a handle from the file to a handle in the StringPool
+	unsigned int remap(unsigned int handle);
+
+	// Remap the String fields of count records
+	void remap(char* records, unsigned int count, unsigned int recordSize, const std::vector<Field>& fields);
+
+protected:
+	const char* mChars;
+	size_t mCharsSize;
+	const char* mOffsets;
+	uint32_t mCount;
+	bool mValid;
+	std::vector<unsigned int> mRemapped;
+};
+
+// Reads the shared values of a snapshot into the pools of a world
+// PRE: the pools are empty
+class SnapshotShared {
+public:
+	SnapshotShared(const char* data, size_t size, uint64_t offset, SnapshotStrings& strings, const std::vector<SharedPoolBase*>& pools);
+
+	bool valid() const { return mValid; }
+
+	// Map a handle from the file to a handle in the pool with the given
+	// Shared component index, and add a reference to it
+	unsigned int remap(int pool, unsigned int handle);
+
+	// Remap the Shared fields of count records
+	void remap(char* records, unsigned int count, unsigned int recordSize, const std::vector<Field>& fields);
+
+protected:
+	const char* mData;
+	SnapshotStrings& mStrings;
+	const std::vector<SharedPoolBase*>& mPools;
+	std::vector<const SnapshotArray*> mArrays; // by pool, or nullptr
+	std::vector<std::vector<unsigned int>> mRemapped;
+	bool mValid;
+};
+
+// Copy a record field by field into a record with a different layout
+// Fields are matched by name, and fields which changed size are left alone
+void convertRecord(char* dst, const std::vector<Field>& dstFields, const char* src, const SnapshotField* srcFields, unsigned int numSrcFields);
+
+// True if the stored field table describes exactly the given layout
+bool sameLayout(const std::vector<Field>& fields, unsigned int objectSize, const SnapshotArray& array, const SnapshotField* srcFields);
+
+void setSnapshotName(char* dst, const char* name);
+
+#endif
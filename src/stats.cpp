@@ -0,0 +1,50 @@
+#include "stats.h"
+#include <iomanip>
+
+size_t WorldStats::committedBytes() const {
+	size_t bytes = entities.committedBytes + entities.indexBytes + itemBytes + scratchBytes;
+	for (const ArrayStats& s : components) bytes += s.committedBytes + s.indexBytes;
+	return bytes;
+}
+
+size_t WorldStats::touchedBytes() const {
+	size_t bytes = entities.touchedBytes + entities.indexBytes + itemBytes + scratchHighWater;
+	for (const ArrayStats& s : components) bytes += s.touchedBytes + s.indexBytes;
+	return bytes;
+}
+
+static void writeRow(std::ostream& out, const ArrayStats& s){
+	out << std::left << std::setw(20) << s.name << std::right
+		<< std::setw(8) << s.live << std::setw(8) << s.highWater << std::setw(8) << s.capacity
+		<< std::setw(8) << s.freelist
+		<< std::setw(10) << s.committedBytes / 1024 << std::setw(10) << s.touchedBytes / 1024 << std::setw(8) << s.indexBytes / 1024
+		<< std::setw(7) << s.added << std::setw(7) << s.removed << "\n";
+}
+
+void writeStats(std::ostream& out, const WorldStats& stats){
+	out << "Frame " << stats.frame << "\n";
+	out << std::left << std::setw(20) << "array" << std::right
+		<< std::setw(8) << "live" << std::setw(8) << "high" << std::setw(8) << "cap" << std::setw(8) << "free"
+		<< std::setw(10) << "commit kb" << std::setw(10) << "touch kb" << std::setw(8) << "idx kb"
+		<< std::setw(7) << "+" << std::setw(7) << "-" << "\n";
+	writeRow(out, stats.entities);
+	for (const ArrayStats& s : stats.components) writeRow(out, s);
+	out << "Items " << stats.itemBytes / 1024 << "kb, scratch " << stats.scratchHighWater / 1024 << "/" << stats.scratchBytes / 1024
+		<< "kb, total " << stats.committedBytes() / 1024 << "kb committed, "
+		<< stats.touchedBytes() / 1024 << "kb touched\n";
+}
+
+static void writeRowJson(std::ostream& out, unsigned int frame, const ArrayStats& s){
+	out << "{\"frame\":" << frame << ",\"array\":\"" << s.name << "\",\"live\":" << s.live
+		<< ",\"capacity\":" << s.capacity << ",\"high_water\":" << s.highWater << ",\"freelist\":" << s.freelist
+		<< ",\"object_size\":" << s.objectSize << ",\"committed_bytes\":" << s.committedBytes
+		<< ",\"touched_bytes\":" << s.touchedBytes << ",\"index_bytes\":" << s.indexBytes
+		<< ",\"added\":" << s.added << ",\"removed\":" << s.removed << "}\n";
+}
+
+void writeStatsJson(std::ostream& out, const WorldStats& stats){
+	writeRowJson(out, stats.frame, stats.entities);
+	for (const ArrayStats& s : stats.components) writeRowJson(out, stats.frame, s);
+	out << "{\"frame\":" << stats.frame << ",\"item_bytes\":" << stats.itemBytes << ",\"scratch_bytes\":" << stats.scratchBytes
+		<< ",\"scratch_high_water\":" << stats.scratchHighWater << "}\n";
+}
@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <vector>
+#include <ostream>
+#include <cstddef>
+
+// Memory and occupancy of one packed array (see EntitySystem::stats())
+struct ArrayStats {
+	const char* name;
+	unsigned int live;        // objects, not counting the invalid one
+	unsigned int capacity;    // objects
+	unsigned int highWater;   // most objects held at once
+	unsigned int freelist;    // unused slots in the index table
+	size_t objectSize;
+	size_t committedBytes;    // object storage allocated
+	size_t touchedBytes;      // object storage that has ever held an object
+	size_t indexBytes;        // index table and freelist
+	unsigned int added;       // in the frame ended by the last sync()
+	unsigned int removed;
+};
+
+struct WorldStats {
+	unsigned int frame;
+	ArrayStats entities;
+	std::vector<ArrayStats> components; // by Index()
+	size_t itemBytes;                   // Inventory contents (see ItemSlab)
+	size_t scratchBytes;                // per frame scratch blocks, all workers
+	size_t scratchHighWater;            // most scratch used in a frame, summed over workers
+
+	size_t committedBytes() const;
+	size_t touchedBytes() const;
+};
+
+// Human readable table
+void writeStats(std::ostream& out, const WorldStats& stats);
+
+// One JSON object per line, e.g., for a metrics pipeline
+void writeStatsJson(std::ostream& out, const WorldStats& stats);
+
+#endif
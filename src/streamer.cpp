@@ -0,0 +1,220 @@
+#include "streamer.h"
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+WorldStreamer::WorldStreamer(EntitySystem& es, const std::string& directory, float cellSize)
+	:mES(es), mDirectory(directory), mCellSize(cellSize), mBudget(0), mBusy(false), mStop(false){
+	mThread = std::thread(&WorldStreamer::run, this);
+	mES.setStreamer(this);
+}
+
+WorldStreamer::~WorldStreamer(){
+	mES.setStreamer(nullptr);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mWake.notify_one();
+	mThread.join();
+}
+
+std::string WorldStreamer::path(PartitionKey key) const {
+	return mDirectory + "/" + std::to_string(key.x) + "_" + std::to_string(key.y) + ".part";
+}
+
+void WorldStreamer::load(PartitionKey key){
+	auto it = mPartitions.find(key);
+	if (it != mPartitions.end()){
+		// Changed our mind about unloading it
+		Partition& p = it->second;
+		p.unloadWhenIn = false;
+		if (p.state == State::Unloading) p.state = State::Resident;
+		return;
+	}
+
+	Partition& p = mPartitions[key];
+	p.state = State::Reading;
+	p.unloadWhenIn = false;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJobs.push_back(Job{ key, false, std::vector<char>() });
+	}
+	mWake.notify_one();
+}
+
+void WorldStreamer::unload(PartitionKey key){
+	auto it = mPartitions.find(key);
+	if (it == mPartitions.end()) return;
+	Partition& p = it->second;
+	if (p.state == State::Resident) p.state = State::Unloading;
+	else if (p.state != State::Unloading) p.unloadWhenIn = true;
+}
+
+void WorldStreamer::streamAround(float x, float y, float radius, float unloadRadius){
+	// Distance from (x, y) to the nearest point of a cell
+	auto distance = [&](PartitionKey key){
+		float minX = key.x * mCellSize, minY = key.y * mCellSize;
+		float dx = std::max(std::max(minX - x, x - (minX + mCellSize)), 0.f);
+		float dy = std::max(std::max(minY - y, y - (minY + mCellSize)), 0.f);
+		return std::sqrt(dx * dx + dy * dy);
+	};
+
+	std::vector<PartitionKey> far;
+	for (auto& kv : mPartitions){
+		if (distance(kv.first) > unloadRadius) far.push_back(kv.first);
+	}
+	for (PartitionKey key : far) unload(key);
+
+	PartitionKey lo = partitionOf(x - radius, y - radius, mCellSize);
+	PartitionKey hi = partitionOf(x + radius, y + radius, mCellSize);
+	for (int cy = lo.y; cy <= hi.y; cy++){
+		for (int cx = lo.x; cx <= hi.x; cx++){
+			PartitionKey key = { cx, cy };
+			if (distance(key) <= radius) load(key);
+		}
+	}
+}
+
+bool WorldStreamer::resident(PartitionKey key) const {
+	return mPartitions.find(key) != mPartitions.end();
+}
+
+unsigned int WorldStreamer::loading() const {
+	unsigned int n = 0;
+	for (auto& kv : mPartitions){
+		if (kv.second.state == State::Reading || kv.second.state == State::Integrating) n++;
+	}
+	return n;
+}
+
+unsigned int WorldStreamer::unloading() const {
+	unsigned int n = 0;
+	for (auto& kv : mPartitions){
+		if (kv.second.state == State::Unloading) n++;
+	}
+	return n;
+}
+
+void WorldStreamer::flush(){
+	std::unique_lock<std::mutex> lock(mMutex);
+	mIdle.wait(lock, [this](){ return mJobs.empty() && !mBusy; });
+}
+
+void WorldStreamer::evict(const std::vector<ID>& removing){
+	std::vector<PartitionKey> keys;
+	for (auto& kv : mPartitions){
+		if (kv.second.state == State::Unloading) keys.push_back(kv.first);
+	}
+	if (keys.empty()) return;
+
+	// One pass over the Transforms for all the cells going out
+	// Entities that are being removed anyway aren't written
+	std::vector<ID> removed(removing);
+	std::sort(removed.begin(), removed.end());
+	std::vector<std::vector<ID>> entities(keys.size());
+	for (Transform& tr : mES.components<Transform>()){
+		PartitionKey key = partitionOf(tr.x, tr.y, mCellSize);
+		auto k = std::find(keys.begin(), keys.end(), key);
+		if (k == keys.end() || !mES.lookup(tr.entity).has<Transform>()) continue;
+		if (std::binary_search(removed.begin(), removed.end(), tr.entity)) continue;
+		entities[k - keys.begin()].push_back(tr.entity);
+	}
+
+	for (size_t i = 0; i < keys.size(); i++){
+		// Written even when empty, so entities that were there don't come back
+		Job job{ keys[i], true, std::vector<char>() };
+		mES.savePartition(entities[i], job.bytes);
+		for (ID id : entities[i]) mES.remove(id);
+		mPartitions.erase(keys[i]);
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mJobs.push_back(std::move(job));
+		}
+	}
+	mWake.notify_one();
+}
+
+void WorldStreamer::integrate(){
+	mLoaded.clear();
+
+	std::vector<Read> read;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		read.swap(mRead);
+	}
+	for (Read& r : read){
+		auto it = mPartitions.find(r.key);
+		if (it == mPartitions.end() || it->second.state != State::Reading) continue;
+		it->second.data = std::move(r.data);
+		it->second.state = State::Integrating;
+		mIntegrating.push_back(r.key);
+	}
+
+	unsigned int budget = mBudget ? mBudget : UINT_MAX;
+	while (!mIntegrating.empty() && budget > 0){
+		Partition& p = mPartitions[mIntegrating.front()];
+		PartitionData& data = *p.data;
+		unsigned int first = data.integrated();
+		mIds.clear();
+		mES.integratePartition(data, budget, mIds);
+		bool malformed = false;
+		if (data.integrated() == first && !data.done()){
+			// No room, try again next time
+			if (data.valid()) break;
+			// It would never go in, so it's dropped like a file that doesn't parse
+			malformed = true;
+		}
+
+		for (size_t i = 0; i < mIds.size(); i++){
+			mLoaded.push_back(StreamedEntity{ mIntegrating.front(), data.saved()[first + i], mIds[i] });
+		}
+		budget -= (unsigned int)mIds.size();
+		if (data.done() || malformed){
+			p.data.reset();
+			p.state = p.unloadWhenIn ? State::Unloading : State::Resident;
+			mIntegrating.pop_front();
+		}
+	}
+}
+
+void WorldStreamer::run(){
+	for (;;){
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this](){ return mStop || !mJobs.empty(); });
+			// Stops once everything it was given is done
+			if (mJobs.empty()) return;
+			job = std::move(mJobs.front());
+			mJobs.pop_front();
+			mBusy = true;
+		}
+
+		std::string file = path(job.key);
+		std::unique_ptr<PartitionData> data;
+		if (job.write){
+			std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+			out.write(job.bytes.data(), job.bytes.size());
+			if (!out) std::cerr << "WorldStreamer: couldn't write " << file << std::endl;
+		}
+		else {
+			data.reset(new PartitionData());
+			std::ifstream in(file.c_str(), std::ios::binary);
+			if (in){
+				std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+				if (!data->parse(bytes)){
+					std::cerr << "WorldStreamer: " << file << " isn't a valid partition" << std::endl;
+					data.reset(new PartitionData());
+				}
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (data) mRead.push_back(Read{ job.key, std::move(data) });
+			mBusy = false;
+			if (mJobs.empty()) mIdle.notify_all();
+		}
+	}
+}
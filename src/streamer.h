@@ -0,0 +1,136 @@
+#ifndef STREAMER_H
+#define STREAMER_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "entity.h"
+
+// An entity that came in with a partition, and its id when it was saved
+struct StreamedEntity {
+	PartitionKey partition;
+	ID saved;
+	ID entity;
+};
+
+// Streams regions of a world in and out of partition files, so only
+// the part near the player has to be resident
+//
+// Entities are grouped into square cells by their Transform. Files are
+// read and written on a background thread. A partition that has been read
+// is added to the world at sync(), at most budget entities per sync() so
+// a big one doesn't cause a hitch. Each block of entities is created like
+// instantiate(). Unloading writes out the entities whose Transform is in
+// the cell, then they're removed in the same sync().
+//
+//   WorldStreamer streamer(es, "world", 64.f);
+//   streamer.setBudget(2000);
+//   ...
+//   streamer.streamAround(player.x, player.y, 128.f, 192.f);
+//   es.sync();
+//
+// Entities without a Transform are never streamed out.
+class WorldStreamer {
+public:
+	// Partition files are directory/<x>_<y>.part
+	// Attaches itself to es (see EntitySystem::setStreamer())
+	WorldStreamer(EntitySystem& es, const std::string& directory, float cellSize);
+
+	// Finishes writing the partitions that went out
+	~WorldStreamer();
+
+	// Read a partition, it's added to the world over the next sync()s
+	// A partition without a file is empty
+	void load(PartitionKey key);
+
+	// Write a partition out and remove its entities at the next sync()
+	// One that's still coming in goes out once it's all in
+	void unload(PartitionKey key);
+
+	// Load the cells within radius of (x, y) and unload the ones further
+	// than unloadRadius, which should be bigger so moving back and forth
+	// along an edge doesn't keep reloading the same cells
+	void streamAround(float x, float y, float radius, float unloadRadius);
+
+	// Most entities added per sync(), 0 for no limit
+	void setBudget(unsigned int entities){ mBudget = entities; }
+
+	// Loaded, or loading or unloading
+	bool resident(PartitionKey key) const;
+
+	// The entities added at the last sync(), e.g., to fix up saved ids
+	const std::vector<StreamedEntity>& loaded() const { return mLoaded; }
+
+	// Partitions being read or added, and ones waiting to go out
+	unsigned int loading() const;
+	unsigned int unloading() const;
+
+	// Wait until the files given to the I/O thread are read or written
+	void flush();
+
+	// Called by EntitySystem::sync(), before and after removals
+	// removing are the entities already queued to be removed
+	void evict(const std::vector<ID>& removing);
+	void integrate();
+
+	float cellSize() const { return mCellSize; }
+	std::string path(PartitionKey key) const;
+
+protected:
+	WorldStreamer(const WorldStreamer&) = delete;
+	WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+	enum class State {
+		Reading,
+		Integrating,
+		Resident,
+		Unloading
+	};
+
+	struct Partition {
+		State state;
+		bool unloadWhenIn; // unload() was called while it was coming in
+		std::unique_ptr<PartitionData> data;
+	};
+
+	struct Job {
+		PartitionKey key;
+		bool write;
+		std::vector<char> bytes; // to write
+	};
+
+	struct Read {
+		PartitionKey key;
+		std::unique_ptr<PartitionData> data;
+	};
+
+	// The I/O thread
+	void run();
+
+	EntitySystem& mES;
+	std::string mDirectory;
+	float mCellSize;
+	unsigned int mBudget;
+	std::unordered_map<PartitionKey, Partition, PartitionKeyHash> mPartitions;
+	std::deque<PartitionKey> mIntegrating; // in the order they were read
+	std::vector<StreamedEntity> mLoaded;
+	std::vector<ID> mIds;
+
+	// Shared with the I/O thread
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mIdle;
+	std::deque<Job> mJobs;
+	std::vector<Read> mRead;
+	bool mBusy;
+	bool mStop;
+	std::thread mThread;
+};
+
+#endif
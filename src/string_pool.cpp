@@ -0,0 +1,220 @@
+#include "string_pool.h"
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+
+// FNV-1a
+static unsigned int hashString(const char* str, size_t length){
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < length; i++){
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+StringPool& StringPool::instance(){
+	static StringPool pool;
+	return pool;
+}
+
+StringPool::StringPool() :mBytes(0), mTail(nullptr), mFree(0), mCollecting(false), mLive(1){
+	mTable.assign(1024, 0);
+
+	// The empty string, which is never put in the table or freed
+	mStrings.push_back("");
+	mLengths.push_back(0);
+	mHashes.push_back(hashString("", 0));
+	mGenerations.push_back(0);
+}
+
+unsigned int StringPool::intern(const char* str){
+	return intern(str, std::strlen(str));
+}
+
+unsigned int StringPool::intern(const char* str, size_t length){
+	if (length == 0) return 0;
+	std::lock_guard<std::mutex> lock(mMutex);
+	unsigned int handle = find(str, length, hashString(str, length));
+	if (handle) return handle;
+
+	reserve(length + 1);
+	std::memcpy(mTail, str, length);
+	mTail[length] = '\0';
+	return commit(length);
+}
+
+unsigned int StringPool::format(const char* fmt, va_list args){
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Try the space left in the current block first
+	va_list copy;
+	va_copy(copy, args);
+	int length = vsnprintf(mTail, mFree, fmt, copy);
+	va_end(copy);
+	if (length <= 0) return 0;
+
+	if ((size_t)length + 1 > mFree){
+		reserve(length + 1);
+		vsnprintf(mTail, mFree, fmt, args);
+	}
+	return commit(length);
+}
+
+const char* StringPool::str(unsigned int handle){
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStrings[index(handle)];
+}
+
+unsigned int StringPool::size(){
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mLive;
+}
+
+size_t StringPool::bytes(){
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mBytes;
+}
+
+void StringPool::reserve(size_t n){
+	if (n <= mFree) return;
+	// NB: The rest of the old block is wasted
+	size_t size = n > BLOCK_SIZE ? n : BLOCK_SIZE;
+	mBlocks.push_back(std::unique_ptr<char[]>(new char[size]));
+	mBytes += size;
+	mTail = mBlocks.back().get();
+	mFree = size;
+}
+
+unsigned int StringPool::commit(size_t n){
+	unsigned int hash = hashString(mTail, n);
+	unsigned int handle = find(mTail, n, hash);
+	if (handle) return handle;
+
+	unsigned int i;
+	if (!mFreeIndices.empty()){
+		i = mFreeIndices.back();
+		mFreeIndices.pop_back();
+		mStrings[i] = mTail;
+		mLengths[i] = (unsigned int)n;
+		mHashes[i] = hash;
+	}
+	else {
+		i = (unsigned int)mStrings.size();
+		if (i > INDEX_MASK) return 0; // out of handles
+		mStrings.push_back(mTail);
+		mLengths.push_back((unsigned int)n);
+		mHashes.push_back(hash);
+		mGenerations.push_back(0);
+	}
+	// Strings made while collecting are in use
+	if (mCollecting){
+		if (i >= mMarked.size()) mMarked.resize(i + 1);
+		mMarked[i] = true;
+	}
+	mLive++;
+	handle = ((unsigned int)mGenerations[i] << INDEX_BITS) | i;
+	mTail += n + 1;
+	mFree -= n + 1;
+	insert(handle);
+	return handle;
+}
+
+unsigned int StringPool::find(const char* str, size_t length, unsigned int hash){
+	size_t mask = mTable.size() - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask){
+		unsigned int handle = mTable[i];
+		if (handle == 0) return 0;
+		unsigned int j = handle & INDEX_MASK;
+		if (mHashes[j] == hash && mLengths[j] == length && std::memcmp(mStrings[j], str, length) == 0){
+			return handle;
+		}
+	}
+}
+
+void StringPool::insert(unsigned int handle){
+	// Keep the table at most half full
+	if (mLive * 2 > mTable.size()){
+		std::vector<unsigned int> old;
+		old.swap(mTable);
+		mTable.assign(old.size() * 2, 0);
+		for (unsigned int h : old){
+			if (h) place(h);
+		}
+	}
+	place(handle);
+}
+
+void StringPool::place(unsigned int handle){
+	size_t mask = mTable.size() - 1;
+	size_t i = mHashes[handle & INDEX_MASK] & mask;
+	while (mTable[i] != 0) i = (i + 1) & mask;
+	mTable[i] = handle;
+}
+
+unsigned int StringPool::index(unsigned int handle) const {
+	unsigned int i = handle & INDEX_MASK;
+	if (i >= mStrings.size() || mStrings[i] == nullptr || mGenerations[i] != handle >> INDEX_BITS) return 0;
+	return i;
+}
+
+void StringPool::beginCollect(){
+	mMutex.lock();
+	mCollecting = true;
+	mMarked.assign(mStrings.size(), false);
+}
+
+void StringPool::mark(unsigned int handle){
+	assert(mCollecting);
+	mMarked[index(handle)] = true;
+}
+
+unsigned int StringPool::endCollect(){
+	assert(mCollecting);
+	unsigned int freed = 0;
+	for (unsigned int i = 1; i < mStrings.size(); i++){
+		if (mStrings[i] == nullptr || mMarked[i]) continue;
+		mStrings[i] = nullptr;
+		mGenerations[i]++;
+		mFreeIndices.push_back(i);
+		freed++;
+	}
+	mLive -= freed;
+	mCollecting = false;
+	mMarked.clear();
+
+	if (freed){
+		compactText();
+
+		// Put back what's left
+		mTable.assign(mTable.size(), 0);
+		for (unsigned int i = 1; i < mStrings.size(); i++){
+			if (mStrings[i]) place(((unsigned int)mGenerations[i] << INDEX_BITS) | i);
+		}
+	}
+	mMutex.unlock();
+	return freed;
+}
+
+void StringPool::compactText(){
+	size_t total = 0;
+	for (unsigned int i = 1; i < mStrings.size(); i++){
+		if (mStrings[i]) total += mLengths[i] + 1;
+	}
+
+	std::vector<std::unique_ptr<char[]>> old;
+	old.swap(mBlocks);
+	mBytes = 0;
+	mTail = nullptr;
+	mFree = 0;
+	if (total == 0) return;
+
+	reserve(total);
+	for (unsigned int i = 1; i < mStrings.size(); i++){
+		if (!mStrings[i]) continue;
+		std::memcpy(mTail, mStrings[i], mLengths[i] + 1);
+		mStrings[i] = mTail;
+		mTail += mLengths[i] + 1;
+		mFree -= mLengths[i] + 1;
+	}
+}
@@ -0,0 +1,147 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <cstdarg>
+#include <functional>
+
+#include "component.h"
+
+// A process wide table of unique strings
+// Each string is stored once and referred to by a 32-bit handle
+// Handle 0 is always the empty string
+//
+// Handles are copied around as raw bytes (components are trivially
+// copyable), so there's nothing to count references with. Instead strings
+// are freed by a collection that marks every handle still in use:
+//
+//   StringPool& pool = StringPool::instance();
+//   pool.beginCollect();
+//   world.markStrings(); // each world, Prefab, etc that holds handles
+//   pool.endCollect();
+//
+// A handle that wasn't marked goes stale and reads as "" from then on,
+// until its slot has been reused GENERATIONS times. Per-entity format()ed
+// text (e.g., "Bob-%d" with a counter) in a long-running server grows the
+// pool until collected, so keep it out of InternedStrings where you can.
+class StringPool {
+public:
+	static StringPool& instance();
+
+	unsigned int intern(const char* str);
+	unsigned int intern(const char* str, size_t length);
+
+	// Format straight into the pool and intern the result
+	unsigned int format(const char* fmt, va_list args);
+
+	// Resolve a handle back to its text, "" if it's stale
+	// NB: The pointer stays valid until the next endCollect()
+	const char* str(unsigned int handle);
+
+	// Number of strings held, including ""
+	unsigned int size();
+
+	// Bytes of text storage allocated
+	size_t bytes();
+
+	// Collect the strings nothing marks
+	// The pool is locked from beginCollect() to endCollect(), so other
+	// threads wait and the collecting thread mustn't intern in between
+	// NB: Strings that are kept move, so pointers from str() don't survive
+	void beginCollect();
+
+	// PRE: Between beginCollect() and endCollect(), on the same thread
+	void mark(unsigned int handle);
+
+	// Returns the number of strings freed
+	unsigned int endCollect();
+
+	static const unsigned int INDEX_BITS = 24;
+	static const unsigned int INDEX_MASK = (1u << INDEX_BITS) - 1;
+	static const unsigned int GENERATIONS = 1u << (32 - INDEX_BITS);
+
+protected:
+	StringPool();
+	StringPool(const StringPool&);
+	StringPool& operator=(const StringPool&);
+
+	// Make space for at least n more chars at mTail
+	void reserve(size_t n);
+
+	// Intern the n chars at mTail, only keeping them if they're new
+	unsigned int commit(size_t n);
+
+	unsigned int find(const char* str, size_t length, unsigned int hash);
+	void insert(unsigned int handle);
+	void place(unsigned int handle);
+
+	// Slot of a handle that isn't stale, or 0
+	unsigned int index(unsigned int handle) const;
+
+	// Move the strings that are left into one block
+	void compactText();
+
+	static const size_t BLOCK_SIZE = 64 * 1024;
+
+	std::mutex mMutex;
+	std::vector<std::unique_ptr<char[]>> mBlocks; // text only moves in endCollect()
+	size_t mBytes;
+	char* mTail;
+	size_t mFree;
+
+	std::vector<const char*> mStrings; // index -> text, nullptr if free
+	std::vector<unsigned int> mLengths;
+	std::vector<unsigned int> mHashes;
+	std::vector<unsigned char> mGenerations; // bumped as each index is freed
+	std::vector<unsigned int> mFreeIndices;
+	std::vector<bool> mMarked; // while collecting
+	bool mCollecting;
+	unsigned int mLive;
+	std::vector<unsigned int> mTable; // open addressed hash -> handle (0 is empty)
+};
+
+// A string stored in the StringPool
+// Copying, comparing and hashing just use the handle
+// NB: The text is freed by a collection that doesn't mark it (see StringPool)
+struct InternedString {
+	unsigned int handle;
+
+	InternedString() :handle(0){}
+	explicit InternedString(const char* str) :handle(StringPool::instance().intern(str)){}
+
+	void set(const char* fmt, ...){
+		va_list args;
+		va_start(args, fmt);
+		handle = StringPool::instance().format(fmt, args);
+		va_end(args);
+	}
+
+	void setv(const char* fmt, va_list args){
+		handle = StringPool::instance().format(fmt, args);
+	}
+
+	const char* c_str() const {
+		return StringPool::instance().str(handle);
+	}
+
+	std::string str() const {
+		return std::string(c_str());
+	}
+
+	bool empty() const { return handle == 0; }
+	bool operator==(const InternedString& rhs) const { return handle == rhs.handle; }
+	bool operator!=(const InternedString& rhs) const { return handle != rhs.handle; }
+};
+
+template <> struct FieldTypeOf<InternedString> { static const FieldType value = FieldType::String; };
+
+namespace std {
+	template <> struct hash<InternedString> {
+		size_t operator()(const InternedString& s) const { return s.handle; }
+	};
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+const uint32_t TimerWheel::NONE;
+
+TimerWheel::TimerWheel(){
+	clear();
+}
+
+void TimerWheel::clear(){
+	mTimers.clear();
+	mFree = NONE;
+	for (uint32_t& s : mSlots) s = NONE;
+	mByEntity.assign(MAX_ENTITY_SLOTS, NONE);
+	mFired.clear();
+	mNow = 0;
+	mPending = 0;
+}
+
+TimerWheel::Handle TimerWheel::add(ID entity, uint32_t event, uint32_t ticks){
+	uint32_t index;
+	if (mFree != NONE){
+		index = mFree;
+		mFree = mTimers[index].next;
+	}
+	else {
+		index = (uint32_t)mTimers.size();
+		Timer t = {};
+		mTimers.push_back(t);
+	}
+
+	Timer& t = mTimers[index];
+	t.due = mNow + (ticks ? ticks : 1);
+	t.entity = entity;
+	t.event = event;
+	insert(index);
+
+	// Link in with the entity's other timers
+	uint32_t& head = mByEntity[entity & (MAX_ENTITY_SLOTS - 1)];
+	t.entityPrev = NONE;
+	t.entityNext = head;
+	if (head != NONE) mTimers[head].entityPrev = index;
+	head = index;
+
+	mPending++;
+	return ((Handle)(t.generation + 1) << 32) | index;
+}
+
+bool TimerWheel::cancel(Handle handle){
+	uint32_t index = (uint32_t)handle;
+	uint32_t generation = (uint32_t)(handle >> 32) - 1;
+	if (index >= mTimers.size()) return false;
+	Timer& t = mTimers[index];
+	if (t.generation != generation || t.slot == NONE) return false;
+	unlinkSlot(index);
+	unlinkEntity(index);
+	release(index);
+	return true;
+}
+
+void TimerWheel::cancelAll(ID entity){
+	uint32_t& head = mByEntity[entity & (MAX_ENTITY_SLOTS - 1)];
+	uint32_t index = head;
+	while (index != NONE){
+		uint32_t next = mTimers[index].entityNext;
+		unlinkSlot(index);
+		release(index);
+		index = next;
+	}
+	head = NONE;
+}
+
+void TimerWheel::timersOf(ID entity, std::vector<PendingTimer>& out) const {
+	// Newest first in the list
+	size_t first = out.size();
+	for (uint32_t index = mByEntity[entity & (MAX_ENTITY_SLOTS - 1)]; index != NONE; index = mTimers[index].entityNext){
+		const Timer& t = mTimers[index];
+		if (t.entity == entity) out.push_back(PendingTimer{ entity, t.event, (uint32_t)(t.due - mNow) });
+	}
+	std::reverse(out.begin() + first, out.end());
+}
+
+void TimerWheel::advance(uint32_t ticks){
+	mFired.clear();
+	for (uint32_t i = 0; i < ticks; i++){
+		tick();
+	}
+}
+
+// Put a timer in the slot of the lowest level whose span it's in
+void TimerWheel::insert(uint32_t index){
+	Timer& t = mTimers[index];
+	int level = 0;
+	while (level < LEVELS - 1 && (t.due >> (SLOT_BITS * (level + 1))) != (mNow >> (SLOT_BITS * (level + 1)))){
+		level++;
+	}
+	uint32_t slot = level * SLOTS + (uint32_t)((t.due >> (SLOT_BITS * level)) & (SLOTS - 1));
+	t.slot = slot;
+	t.prev = NONE;
+	t.next = mSlots[slot];
+	if (t.next != NONE) mTimers[t.next].prev = index;
+	mSlots[slot] = index;
+}
+
+void TimerWheel::unlinkSlot(uint32_t index){
+	Timer& t = mTimers[index];
+	if (t.prev != NONE) mTimers[t.prev].next = t.next;
+	else mSlots[t.slot] = t.next;
+	if (t.next != NONE) mTimers[t.next].prev = t.prev;
+}
+
+void TimerWheel::unlinkEntity(uint32_t index){
+	Timer& t = mTimers[index];
+	if (t.entityPrev != NONE) mTimers[t.entityPrev].entityNext = t.entityNext;
+	else mByEntity[t.entity & (MAX_ENTITY_SLOTS - 1)] = t.entityNext;
+	if (t.entityNext != NONE) mTimers[t.entityNext].entityPrev = t.entityPrev;
+}
+
+void TimerWheel::release(uint32_t index){
+	Timer& t = mTimers[index];
+	t.slot = NONE;
+	t.generation++;
+	t.next = mFree;
+	mFree = index;
+	mPending--;
+}
+
+// Move the timers in the current slot of a level down a level (or more)
+void TimerWheel::cascade(int level){
+	uint32_t slot = level * SLOTS + (uint32_t)((mNow >> (SLOT_BITS * level)) & (SLOTS - 1));
+	uint32_t index = mSlots[slot];
+	mSlots[slot] = NONE;
+	while (index != NONE){
+		uint32_t next = mTimers[index].next;
+		insert(index);
+		index = next;
+	}
+}
+
+void TimerWheel::tick(){
+	mNow++;
+
+	// When a level wraps, the current slot of the level above is spread
+	// out below. Highest first, as its timers may land in lower slots due now
+	int top = 0;
+	while (top + 1 < LEVELS && (mNow & ((1ull << (SLOT_BITS * (top + 1))) - 1)) == 0){
+		top++;
+	}
+	for (int level = top; level >= 1; level--){
+		cascade(level);
+	}
+
+	uint32_t slot = (uint32_t)(mNow & (SLOTS - 1));
+	uint32_t index = mSlots[slot];
+	mSlots[slot] = NONE;
+	while (index != NONE){
+		Timer& t = mTimers[index];
+		uint32_t next = t.next;
+		TimerEvent e = { t.entity, t.event };
+		mFired.push_back(e);
+		unlinkEntity(index);
+		release(index);
+		index = next;
+	}
+}
@@ -0,0 +1,96 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <vector>
+#include <cstdint>
+
+#include "component.h"
+
+// A timer going off
+struct TimerEvent {
+	ID entity;
+	uint32_t event;
+};
+
+// A timer yet to go off
+struct PendingTimer {
+	ID entity;
+	uint32_t event;
+	uint32_t ticks; // until it goes off
+};
+
+// Hierarchical timing wheel for per-entity timers
+// "Fire event X for entity E in T ticks", where a tick is one sync()
+// (see EntitySystem::timers()). Four levels of 256 slots each cover
+// 2^32 ticks. Adding, cancelling and firing a timer are O(1), and a timer
+// is touched at most once per level on its way down, so a tick costs
+// roughly the number of timers due rather than the number pending.
+// Timers of an entity are cancelled when the entity is removed.
+class TimerWheel {
+public:
+	using Handle = uint64_t;
+	static const Handle INVALID_HANDLE = 0;
+
+	TimerWheel();
+
+	// Fire event for entity after ticks ticks (at least 1)
+	Handle add(ID entity, uint32_t event, uint32_t ticks);
+
+	// Returns false if the timer already fired or was cancelled
+	bool cancel(Handle handle);
+
+	// Cancel all of an entity's timers
+	void cancelAll(ID entity);
+
+	// Append an entity's timers, in the order they were added,
+	// e.g., to add them again in another world
+	void timersOf(ID entity, std::vector<PendingTimer>& out) const;
+
+	// Move time on, collecting the timers that go off into fired()
+	void advance(uint32_t ticks = 1);
+
+	// Timers that went off in the last advance()
+	const std::vector<TimerEvent>& fired() const { return mFired; }
+
+	// Ticks so far
+	uint64_t now() const { return mNow; }
+
+	// Timers waiting to go off
+	unsigned int pending() const { return mPending; }
+
+	void clear();
+
+protected:
+	static const int LEVELS = 4;
+	static const int SLOT_BITS = 8;
+	static const int SLOTS = 1 << SLOT_BITS;
+	static const uint32_t NONE = 0xffffffff;
+	static const unsigned int MAX_ENTITY_SLOTS = 0x10000;
+
+	struct Timer {
+		uint64_t due;
+		ID entity;
+		uint32_t event;
+		uint32_t next, prev;             // in its slot, or the freelist
+		uint32_t entityNext, entityPrev; // timers of the same entity
+		uint32_t generation;             // bumped when freed, so old handles miss
+		uint32_t slot;                   // level * SLOTS + slot, or NONE if free
+	};
+
+	void insert(uint32_t index);
+	void unlinkSlot(uint32_t index);
+	void unlinkEntity(uint32_t index);
+	void release(uint32_t index);
+	void cascade(int level);
+	void tick();
+
+	std::vector<Timer> mTimers;
+	uint32_t mFree;
+	uint32_t mSlots[LEVELS * SLOTS];    // list heads
+	std::vector<uint32_t> mByEntity;    // list heads by entity index
+	std::vector<TimerEvent> mFired;
+	uint64_t mNow;
+	unsigned int mPending;
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define TRANSFORM_H
 #include "component.h"
 #include <sstream>
+#include <cstdint>
+#include <cmath>
 
 struct vec2 { float x, y; };
 struct Transform: public Component<Transform> {
@@ -11,6 +13,12 @@ struct Transform: public Component<Transform> {
 
 	Transform(float x = 0.f, float y = 0.f) :x(x), y(y){}
 	Transform(const vec2& v) :x(v.x), y(v.y){}
+
+	static const std::vector<Field>& Fields(){
+		static const std::vector<Field> fields = { COM_FIELD(Transform, x), COM_FIELD(Transform, y) };
+		return fields;
+	}
+
 	std::string what() {
 		std::ostringstream oss;
 		oss << "transform {";
@@ -21,4 +29,21 @@ struct Transform: public Component<Transform> {
 	}
 };
 
+// Interleave the bits of x and y, so nearby points get nearby keys
+inline uint32_t morton2D(uint16_t x, uint16_t y){
+	uint32_t k = 0;
+	for (int i = 0; i < 16; i++){
+		k |= ((uint32_t)((x >> i) & 1) << (2 * i)) | ((uint32_t)((y >> i) & 1) << (2 * i + 1));
+	}
+	return k;
+}
+
+// Sort key for spatial locality, e.g., es.sortBy<Transform>(...)
+// Positions are bucketed into cells, and wrap every 65536 cells
+inline uint64_t mortonKey(const Transform& tr, float cellSize){
+	int32_t cx = (int32_t)std::floor(tr.x / cellSize) + 0x8000;
+	int32_t cy = (int32_t)std::floor(tr.y / cellSize) + 0x8000;
+	return morton2D((uint16_t)cx, (uint16_t)cy);
+}
+
 #endif
@@ -0,0 +1,72 @@
+// compact() after a despawn wave: 99% of the entities are removed, then
+// the pages above the survivors are given back a budget at a time
+
+#include <memory>
+#include <vector>
+
+#include "entity.h"
+#include "test.h"
+
+int main(){
+	std::unique_ptr<EntitySystem> world(new EntitySystem());
+	EntitySystem& es = *world;
+	es.doubleBuffer<Transform>();
+
+	std::vector<ID> kept;
+	for (int i = 0; i < 60000; i++){
+		Entity& e = es.create();
+		Transform tr((float)i, 2);
+		e.add(tr);
+		Physics ph(1, 1);
+		e.add(ph);
+		if (i % 100 == 1) kept.push_back(e.id);
+	}
+	es.sync();
+
+	int n = 0;
+	for (Entity& e : es.entities()){
+		if (n++ % 100 != 1) es.remove(e.id);
+	}
+	es.sync();
+	WorldStats before;
+	es.stats(before);
+
+	// Each call stays within its budget, and they run out
+	const size_t budget = 1 << 20;
+	size_t released = 0, r;
+	int calls = 0;
+	while (calls < 1000 && (r = es.compact(budget)) > 0){
+		CHECK(r <= budget);
+		released += r;
+		calls++;
+	}
+	CHECK(calls > 1 && calls < 1000);
+	CHECK(es.compact(budget) == 0);
+	es.compact(SIZE_MAX, true);
+
+	WorldStats after;
+	es.stats(after);
+	CHECK(released > 0);
+	CHECK(after.touchedBytes() < before.touchedBytes() / 2);
+	CHECK(after.entities.live == kept.size());
+
+	// Ids stay valid, and new entities don't disturb them
+	for (ID id : kept){
+		CHECK(es.has(id) && es.lookup(id).get<Transform>().y == 2);
+	}
+	std::vector<ID> created;
+	for (int i = 0; i < 1000; i++){
+		Entity& e = es.create();
+		Transform tr(1, 3);
+		e.add(tr);
+		created.push_back(e.id);
+	}
+	es.sync();
+	for (ID id : kept){
+		CHECK(es.has(id) && es.lookup(id).get<Transform>().y == 2 && es.lookup(id).has<Physics>());
+	}
+	for (ID id : created){
+		CHECK(es.has(id) && es.lookup(id).get<Transform>().y == 3 && !es.lookup(id).has<Physics>());
+	}
+	return testResult();
+}
@@ -0,0 +1,129 @@
+// Journal record/replay: a random churn is recorded and replayed into
+// fresh worlds, which diff() must find identical to the original
+// The file journal is written to the current directory
+
+#include <climits>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "entity.h"
+#include "test.h"
+
+// Nothing created, destroyed or changed between the worlds
+static bool same(EntitySystem& a, EntitySystem& b){
+	std::vector<char> delta;
+	a.diff(b, delta);
+	DeltaHeader h;
+	std::memcpy(&h, delta.data(), sizeof(h));
+	return h.numDestroyed == 0 && h.numCreated == 0 && h.numComponentTypes == 0;
+}
+
+static unsigned int seed = 1;
+static unsigned int roll(unsigned int n){
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+// Prefabs, Shared values, strings, queued and immediate removals,
+// removing twice and moving entities to another world
+static void churn(EntitySystem& es, EntitySystem& other, int frames){
+	Prefab goblin("Goblin");
+	goblin.add(Transform(3, 4)).addShared(Description("shared %d", 1)).addItem(Item::SWORD, 2).add(ShortDescription("short"));
+	std::vector<ID> ids;
+	for (int f = 0; f < frames; f++){
+		if (f % 20 == 0) es.instantiate(goblin, 100, ids);
+		for (int i = 0; i < 30; i++){
+			Entity& e = es.create();
+			Transform tr((float)roll(100), (float)roll(100));
+			e.add(tr);
+			if (roll(2)) e.addShared(Health((float)roll(3)));
+			ids.push_back(e.id);
+		}
+		for (int i = 0; i < 40 && !ids.empty(); i++){
+			Entity& e = es.lookup(ids[roll((unsigned int)ids.size())]);
+			switch (roll(5)){
+			case 0: { Health h((float)roll(50)); e.add(h); break; }
+			case 1: e.remove<Transform>(roll(2) == 0); break;
+			case 2: { Transform tr(1, 2); e.add(tr); break; }
+			case 3: e.removeAllComponents(); break;
+			default: e.add(ShortDescription("sd %d", roll(10))); break;
+			}
+		}
+		for (int i = 0; i < 20 && !ids.empty(); i++){
+			size_t k = roll((unsigned int)ids.size());
+			es.remove(ids[k]);
+			if (roll(5) == 0) es.remove(ids[k]);
+			ids[k] = ids.back();
+			ids.pop_back();
+		}
+		if (f % 50 == 25 && ids.size() > 10){
+			std::vector<ID> moving(ids.end() - 10, ids.end()), moved;
+			ids.resize(ids.size() - 10);
+			CHECK(es.migrate(moving, other, moved));
+		}
+		es.sync();
+	}
+}
+
+int main(){
+	std::unique_ptr<EntitySystem> a(new EntitySystem()), other(new EntitySystem());
+	Journal journal;
+	a->setJournal(&journal);
+	churn(*a, *other, 200);
+	a->setJournal(nullptr);
+	CHECK(journal.ops() > 0);
+
+	// A frame at a time
+	std::vector<char> data = journal.data();
+	JournalReplay replay;
+	CHECK(replay.parse(data));
+	std::unique_ptr<EntitySystem> b(new EntitySystem());
+	bool ok = true;
+	while (!replay.done() && replay.frames() <= 200){
+		ok = b->replay(replay) && ok;
+	}
+	CHECK(ok && replay.frames() == 200);
+	CHECK(same(*a, *b));
+
+	// Again into another world
+	replay.rewind();
+	std::unique_ptr<EntitySystem> c(new EntitySystem());
+	CHECK(c->replay(replay, UINT_MAX));
+	CHECK(same(*a, *c));
+
+	// A truncated one is rejected, by parse() or by replay()
+	std::vector<char> truncated = journal.data();
+	truncated.resize(truncated.size() - 3);
+	JournalReplay broken;
+	std::unique_ptr<EntitySystem> d(new EntitySystem());
+	CHECK(!broken.parse(truncated) || !d->replay(broken, UINT_MAX));
+
+	// Written out a block at a time to a file
+	std::unique_ptr<EntitySystem> e(new EntitySystem()), elsewhere(new EntitySystem());
+	{
+		Journal file;
+		CHECK(file.open("test.journal"));
+		e->setJournal(&file);
+		seed = 2;
+		churn(*e, *elsewhere, 100);
+		for (int i = 0; i < 40000; i++){
+			Entity& x = e->create();
+			Transform tr((float)i, (float)i);
+			x.add(tr);
+			x.add(ShortDescription("e%d", i % 100));
+		}
+		e->sync();
+		e->setJournal(nullptr);
+		CHECK(file.bytes() > (1 << 20));
+	}
+	std::ifstream in("test.journal", std::ios::binary);
+	std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	JournalReplay fromFile;
+	CHECK(fromFile.parse(bytes));
+	std::unique_ptr<EntitySystem> f(new EntitySystem());
+	CHECK(f->replay(fromFile, UINT_MAX));
+	CHECK(same(*e, *f));
+	return testResult();
+}
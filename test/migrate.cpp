@@ -0,0 +1,144 @@
+// migrate() between worlds on one thread, and MigrationQueues between
+// worlds stepped on their own threads
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "migration.h"
+#include "test.h"
+
+// Counts the systems' view of Transforms coming and going
+struct CountingSystem : ISystem {
+	int setups = 0;
+	int cleanups = 0;
+
+	const char* name() override { return "Counting"; }
+	bool implements(int c) override { return c == Transform::Index(); }
+	void setup(Entity& e) override { setups++; }
+	void cleanup(Entity& e) override { cleanups++; }
+};
+
+// Runtime components are carried over with their type's hooks
+struct Tag {
+	std::string name;
+	int n;
+};
+static RuntimeComponent<Tag> tag("Tag");
+
+static unsigned int count(EntitySystem& es){
+	unsigned int n = 0;
+	for (Entity& e : es.entities()) n++;
+	return n;
+}
+
+static double sumX(EntitySystem& es){
+	double sum = 0;
+	for (Transform& tr : es.components<Transform>()) sum += tr.x;
+	return sum;
+}
+
+static int arrows(EntitySystem& es){
+	int n = 0;
+	for (Entity& e : es.entities()){
+		if (e.has<Inventory>()) n += e.inventory().count(ARROW);
+	}
+	return n;
+}
+
+int main(){
+	std::unique_ptr<EntitySystem> a(new EntitySystem()), b(new EntitySystem());
+	CountingSystem countA, countB;
+	a->addSystem(&countA);
+	b->addSystem(&countB);
+
+	Prefab archer("Archer");
+	archer.add(Transform(1, 2)).add(Health(5)).addShared(Description("An archer.")).addItem(ARROW, 3);
+	std::vector<ID> ids;
+	a->instantiate(archer, 5000, ids);
+	for (size_t i = 0; i < ids.size(); i++) a->lookup(ids[i]).get<Transform>().x = (float)i;
+	a->sync();
+	double total = sumX(*a);
+
+	// Half of them, a dead id and a repeat
+	std::vector<ID> moving(ids.begin(), ids.begin() + 2500);
+	moving.push_back(ids[0]);
+	moving.push_back(0x12345678);
+	std::vector<ID> moved;
+	CHECK(a->migrate(moving, *b, moved));
+	CHECK(moved.size() == moving.size());
+	CHECK(moved[2500] == INVALID_ID && moved[2501] == INVALID_ID);
+
+	// Gone from a straight away
+	CHECK(!a->has(ids[0]) && count(*a) == 2500 && count(*b) == 2500);
+	CHECK(countA.cleanups == 2500 && countB.setups == 2500);
+	a->sync();
+	b->sync();
+	CHECK(sumX(*a) + sumX(*b) == total);
+	CHECK(arrows(*a) == 7500 && arrows(*b) == 7500);
+	for (size_t i = 0; i < 2500; i++){
+		Entity& e = b->lookup(moved[i]);
+		CHECK(e.get<Transform>().x == (float)i && e.get<Health>().health == 5);
+		CHECK(e.getShared<Description>().description.str() == "An archer.");
+	}
+	CHECK(b->sharedPool<Description>().size() == 1);
+
+	// Timers and runtime components go along
+	ID first = moved[0];
+	tag.add(b->lookup(first), Tag{ "carried along", 7 });
+	b->timers().add(first, 42, 2);
+	ID back = b->migrate(first, *a);
+	CHECK(back != INVALID_ID && !b->has(first));
+	CHECK(tag.has(a->lookup(back)) && tag.get(a->lookup(back)).name == "carried along");
+	CHECK(a->timers().pending() == 1 && b->timers().pending() == 0);
+	a->sync();
+	a->sync();
+	CHECK(a->timers().fired().size() == 1 && a->timers().fired()[0].entity == back);
+	CHECK(b->migrate(first, *a) == INVALID_ID);
+
+	// No room, so nothing moves
+	std::unique_ptr<EntitySystem> full(new EntitySystem());
+	std::vector<ID> filler;
+	full->instantiate(archer, MAX_ENTITIES - 100, filler);
+	full->sync();
+	std::vector<ID> rest(ids.begin() + 2500, ids.end()), none;
+	CHECK(!a->migrate(rest, *full, none));
+	CHECK(none.empty() && count(*a) == 2501);
+
+	// Two worlds on their own threads swapping entities every frame
+	MigrationQueue toA(*a), toB(*b);
+	total = sumX(*a) + sumX(*b);
+	int items = arrows(*a) + arrows(*b);
+	unsigned int entities = count(*a) + count(*b);
+	std::atomic<int> done(0);
+	auto step = [&](EntitySystem& es, MigrationQueue& in, MigrationQueue& out, unsigned int seed){
+		std::vector<ID> leaving;
+		for (int f = 0; f < 300; f++){
+			in.receive(3000);
+			leaving.clear();
+			for (Entity& e : es.entities()){
+				seed = seed * 1103515245 + 12345;
+				if ((seed >> 8) % 10 == 0) leaving.push_back(e.id);
+				if (leaving.size() >= 1000) break;
+			}
+			out.send(es, leaving);
+			es.sync();
+		}
+		done++;
+		while (done < 2) std::this_thread::yield();
+		while (in.pending()){
+			in.receive();
+			es.sync();
+		}
+	};
+	std::thread threadA(step, std::ref(*a), std::ref(toA), std::ref(toB), 1u);
+	std::thread threadB(step, std::ref(*b), std::ref(toB), std::ref(toA), 2u);
+	threadA.join();
+	threadB.join();
+	CHECK(sumX(*a) + sumX(*b) == total);
+	CHECK(arrows(*a) + arrows(*b) == items);
+	CHECK(count(*a) + count(*b) == entities);
+	return testResult();
+}
@@ -0,0 +1,149 @@
+// WorldStreamer round trip: a world is written out to 16 cells and
+// streamed into another world a budget of entities per sync()
+// The cells are written to the current directory
+
+#include <memory>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <fstream>
+
+#include "streamer.h"
+#include "test.h"
+
+// What an entity holds, as it doesn't keep its id
+struct Signature {
+	float x, y, health;
+	std::string shortDescription, description;
+	int arrows;
+
+	bool operator==(const Signature& rhs) const {
+		return x == rhs.x && y == rhs.y && health == rhs.health && arrows == rhs.arrows &&
+			shortDescription == rhs.shortDescription && description == rhs.description;
+	}
+};
+
+static std::multimap<float, Signature> signatures(EntitySystem& es){
+	std::multimap<float, Signature> m;
+	for (Entity& e : es.entities()){
+		if (!e.has<Transform>()) continue;
+		Signature s;
+		s.x = e.get<Transform>().x;
+		s.y = e.get<Transform>().y;
+		s.health = e.has<Health>() ? e.get<Health>().health : -1;
+		s.shortDescription = e.has<ShortDescription>() ? e.get<ShortDescription>().shortDescription.str() : "";
+		s.description = e.has<Shared<Description>>() ? e.getShared<Description>().description.str() : "";
+		s.arrows = e.has<Inventory>() ? e.inventory().count(ARROW) : -1;
+		m.insert(std::make_pair(s.x * 1000 + s.y, s));
+	}
+	return m;
+}
+
+static bool same(const std::multimap<float, Signature>& a, const std::multimap<float, Signature>& b){
+	if (a.size() != b.size()) return false;
+	for (auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j){
+		if (!(i->second == j->second)) return false;
+	}
+	return true;
+}
+
+static unsigned int count(EntitySystem& es){
+	unsigned int n = 0;
+	for (Entity& e : es.entities()) n++;
+	return n;
+}
+
+// Sync until everything is in, checking the budget, or give up
+static bool streamIn(EntitySystem& es, WorldStreamer& streamer, unsigned int budget){
+	for (int frames = 0; frames < 1000; frames++){
+		if (!streamer.loading()) return true;
+		es.sync();
+		CHECK(streamer.loaded().size() <= budget);
+		for (const StreamedEntity& s : streamer.loaded()){
+			CHECK(es.has(s.entity));
+		}
+		if (streamer.loaded().empty()) streamer.flush();
+	}
+	return false;
+}
+
+int main(){
+	const float cellSize = 64.f;
+	std::unique_ptr<EntitySystem> a(new EntitySystem());
+	for (int i = 0; i < 5000; i++){
+		Entity& e = a->create();
+		ID id = e.id;
+		Transform tr((float)(i % 100) * 2.5f, (float)(i / 100) * 5.f);
+		e.add(tr);
+		if (i % 2 == 0){
+			Health h((float)i);
+			a->lookup(id).add(h);
+		}
+		a->lookup(id).add(ShortDescription("e%d", i));
+		if (i % 7 == 0){
+			a->lookup(id).add(Inventory());
+			a->lookup(id).inventory().add(ARROW, i % 13 + 1);
+		}
+		if (i % 11 == 0) a->lookup(id).addShared(Description("kind %d", i % 3));
+	}
+	// Never streamed out, as it has no Transform
+	a->create();
+	a->sync();
+	std::multimap<float, Signature> before = signatures(*a);
+
+	{
+		WorldStreamer out(*a, ".", cellSize);
+		for (int x = 0; x < 4; x++){
+			for (int y = 0; y < 4; y++){
+				// Left by an earlier run
+				std::remove(out.path(PartitionKey{ x, y }).c_str());
+				out.load(PartitionKey{ x, y });
+			}
+		}
+		a->sync();
+		out.flush();
+		a->sync();
+		for (int x = 0; x < 4; x++){
+			for (int y = 0; y < 4; y++){
+				CHECK(out.resident(PartitionKey{ x, y }));
+				out.unload(PartitionKey{ x, y });
+			}
+		}
+		a->sync();
+		CHECK(count(*a) == 1);
+	}
+
+	// Ids in b differ from the ones saved
+	std::unique_ptr<EntitySystem> b(new EntitySystem());
+	for (int i = 0; i < 123; i++) b->create();
+	b->sync();
+	WorldStreamer in(*b, ".", cellSize);
+	const unsigned int budget = 700;
+	in.setBudget(budget);
+	in.streamAround(128.f, 128.f, 192.f, 320.f);
+	CHECK(streamIn(*b, in, budget));
+	CHECK(same(before, signatures(*b)));
+
+	// Move to a corner, so the far cells go out, then come back
+	in.streamAround(10.f, 10.f, 30.f, 100.f);
+	b->sync();
+	in.flush();
+	CHECK(count(*b) < 123 + 5000);
+	in.streamAround(128.f, 128.f, 192.f, 320.f);
+	CHECK(streamIn(*b, in, budget));
+	CHECK(same(before, signatures(*b)));
+
+	// A file that isn't a partition adds nothing
+	PartitionKey bad = { 10, 10 };
+	{
+		std::ofstream file(in.path(bad).c_str(), std::ios::binary | std::ios::trunc);
+		file << "not a partition";
+	}
+	unsigned int entities = count(*b);
+	in.load(bad);
+	CHECK(streamIn(*b, in, budget));
+	CHECK(count(*b) == entities);
+	std::remove(in.path(bad).c_str());
+	return testResult();
+}
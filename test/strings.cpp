@@ -0,0 +1,96 @@
+// StringPool collection, and snapshots only writing the strings they use
+// The snapshot is written to the current directory
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "entity.h"
+#include "test.h"
+
+int main(){
+	StringPool& pool = StringPool::instance();
+	unsigned int start = pool.size();
+	std::unique_ptr<EntitySystem> es(new EntitySystem());
+	std::vector<ID> ids;
+	for (int i = 0; i < 5000; i++){
+		Entity& e = es->create();
+		e.add(ShortDescription("Bob-%d", i));
+		ids.push_back(e.id);
+	}
+	es->create().addShared(Description("shared %d", 7));
+	Prefab prefab("Prefab");
+	prefab.add(ShortDescription("prefab text")).addShared(Description("prefab shared"));
+	InternedString byHand("held by hand");
+	es->sync();
+	CHECK(pool.size() == start + 5004);
+
+	// Only what's marked is kept
+	for (int i = 0; i < 4990; i++) es->remove(ids[i]);
+	es->sync();
+	unsigned int gone = InternedString("Bob-1").handle;
+	pool.beginCollect();
+	es->markStrings();
+	prefab.markStrings();
+	pool.mark(byHand.handle);
+	CHECK(pool.endCollect() == 4990);
+	CHECK(pool.size() == start + 14);
+	CHECK(es->lookup(ids[4995]).get<ShortDescription>().shortDescription.str() == "Bob-4995");
+	CHECK(prefab.get<ShortDescription>().shortDescription.str() == "prefab text");
+	CHECK(prefab.getShared<Description>().description.str() == "prefab shared");
+	CHECK(byHand.str() == "held by hand");
+
+	// Stale handles read as "", even once their slot is reused
+	InternedString stale;
+	stale.handle = gone;
+	CHECK(std::strcmp(stale.c_str(), "") == 0);
+	InternedString reused("Bob-1");
+	CHECK(reused.handle != gone && reused.str() == "Bob-1" && std::strcmp(stale.c_str(), "") == 0);
+
+	// Interning still finds the survivors
+	CHECK(InternedString("Bob-4999") == es->lookup(ids[4999]).get<ShortDescription>().shortDescription);
+
+	// The prefab, the hand held strings and the reused one aren't marked this time
+	CHECK(es->collectStrings() == 4);
+	CHECK(pool.size() == start + 11);
+
+	// Only the strings the world uses are written, and ""
+	CHECK(es->save("strings.snap"));
+	std::ifstream in("strings.snap", std::ios::binary);
+	std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	SnapshotHeader header;
+	std::memcpy(&header, file.data(), sizeof(header));
+	uint32_t numStrings;
+	std::memcpy(&numStrings, file.data() + header.stringsOffset, sizeof(numStrings));
+	CHECK(numStrings == 12);
+
+	std::unique_ptr<EntitySystem> loaded(new EntitySystem());
+	CHECK(loaded->load("strings.snap"));
+	for (int i = 4990; i < 5000; i++){
+		CHECK(loaded->lookup(ids[i]).get<ShortDescription>().shortDescription.str() == "Bob-" + std::to_string(i));
+	}
+	int shared = 0;
+	for (Entity& e : loaded->entities()){
+		if (e.has<Shared<Description>>()) shared += e.getShared<Description>().description.str() == "shared 7";
+	}
+	CHECK(shared == 1);
+
+	// Churn doesn't grow the pool
+	for (int round = 0; round < 10; round++){
+		std::vector<ID> wave;
+		for (int i = 0; i < 20000; i++){
+			Entity& e = es->create();
+			e.add(ShortDescription("Wave-%d-%d", round, i));
+			wave.push_back(e.id);
+		}
+		es->sync();
+		for (ID id : wave) es->remove(id);
+		es->sync();
+		es->collectStrings();
+	}
+	CHECK(pool.size() == start + 11);
+	return testResult();
+}
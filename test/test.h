@@ -0,0 +1,27 @@
+#ifndef TEST_H
+#define TEST_H
+
+// A tiny test harness
+// CHECK() reports a failure and carries on, and main() returns
+// testResult() so ctest sees whether anything failed
+
+#include <iostream>
+
+inline int& testFailures(){
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(cond) do { \
+	if (!(cond)){ \
+		std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << std::endl; \
+		testFailures()++; \
+	} \
+} while (0)
+
+inline int testResult(){
+	if (testFailures()) std::cerr << testFailures() << " checks failed" << std::endl;
+	return testFailures() ? 1 : 0;
+}
+
+#endif